@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "modem.h"
+#include "sms_command.h"
+
+// each kernel is timed this many times, the fastest run counts
+#define BENCH_REPEATS 5
+
+// results are kept in a volatile sink, so that the compiler cannot drop the work
+static volatile uint32_t bench_sink;
+
+// modem output of a typical exchange: SMS notification, read-out, signal request and reply
+static const char bench_traffic[] =
+  "\r\n+CMTI: \"SM\",3\r\n"
+  "\r\n+CMGR: \"REC UNREAD\",\"+447700900001\",\"\",\"26/10/18,12:00:00+04\"\r\n674358 Signal?\r\n\r\nOK\r\n"
+  "\r\n+CSQ: 20,99\r\n\r\nOK\r\n"
+  "\r\n+CMGS: 12\r\n\r\nOK\r\n";
+
+// messages from the modem as read_line delivers them
+static const char* const bench_lines[] = {
+  "OK",
+  "ERROR",
+  "+CMTI: \"SM\",3",
+  "+CMGR: \"REC UNREAD\",\"+447700900001\",\"\",\"26/10/18,12:00:00+04\"",
+  "674358 Signal?",
+  "+CSQ: 20,99",
+  "+CMGS: 12",
+  "+CREG: 0,1",
+  "+CPSI: LTE,Online,234-10,0x0A2B,26451713,289,EUTRAN-BAND20,6300,3,3,-92,-1031,-735,15",
+  "+CLCC: 1,1,4,0,0,\"+447700900002\",145",
+  "+CGEV: ME PDN DEACT 1",
+  "+CPIN: READY"
+};
+#define BENCH_NUMBER_LINES (int)(sizeof(bench_lines) / sizeof(bench_lines[0]))
+
+// SMS commands, valid and invalid ones
+static const char* const bench_commands[] = {
+  "674358 Signal?",
+  "674358 Status?",
+  "674358 SMSonInput!2",
+  "674358 MessageText!1!On!Intruder alarm triggered",
+  "674358 TelephoneNumber!+447700900000",
+  "674358 Password!674358",
+  "674358 Weather?",
+  "123456 Signal?"
+};
+#define BENCH_NUMBER_COMMANDS (int)(sizeof(bench_commands) / sizeof(bench_commands[0]))
+
+// characters into the ring buffer as the interrupt handler puts them, and lines out of it as the main loop takes them
+static uint32_t bench_ring_buffer_framing(uint32_t iterations, uint64_t* bytes) {
+  char line[max_str_l];
+  uint32_t i, ops = 0;
+  int j, l;
+
+  rx_buffer_read_position = 0;
+  rx_buffer_entries = 0;
+  rx_buffer_write_position = 0;
+  rx_buffer_number_lf = 0;
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < (int)sizeof(bench_traffic) - 1; j++)
+      rx_buffer_push(bench_traffic[j]);
+    while ((l = read_line(line)) >= 0) {
+      bench_sink += l;
+      ops++;
+    }
+  }
+  *bytes += (uint64_t)iterations * (sizeof(bench_traffic) - 1);
+
+  return ops;
+}
+
+static uint32_t bench_classify_message(uint32_t iterations, uint64_t* bytes) {
+  uint32_t i;
+  int j;
+
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < BENCH_NUMBER_LINES; j++)
+      bench_sink += classify_message(bench_lines[j]);
+  for (j = 0; j < BENCH_NUMBER_LINES; j++)
+    *bytes += (uint64_t)iterations * strlen(bench_lines[j]);
+
+  return iterations * BENCH_NUMBER_LINES;
+}
+
+// extraction of the second parameter, as for the index of +CMTI
+static uint32_t bench_message_field(uint32_t iterations, uint64_t* bytes) {
+  char field[12];
+  uint32_t i;
+  int j;
+
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < BENCH_NUMBER_LINES; j++)
+      bench_sink += message_field(bench_lines[j], 1, field, sizeof(field));
+  for (j = 0; j < BENCH_NUMBER_LINES; j++)
+    *bytes += (uint64_t)iterations * strlen(bench_lines[j]);
+
+  return iterations * BENCH_NUMBER_LINES;
+}
+
+static uint32_t bench_sms_command(uint32_t iterations, uint64_t* bytes) {
+  static config_t config;
+  char reply[max_str_l];
+  bool config_changed;
+  uint32_t i;
+  int j;
+
+  config_set_defaults(&config);
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < BENCH_NUMBER_COMMANDS; j++)
+      bench_sink += handle_sms_command(bench_commands[j], &config, reply, &config_changed);
+  for (j = 0; j < BENCH_NUMBER_COMMANDS; j++)
+    *bytes += (uint64_t)iterations * strlen(bench_commands[j]);
+
+  return iterations * BENCH_NUMBER_COMMANDS;
+}
+
+// the replies are rendered by the command handler, the status reply has the most fields
+static uint32_t bench_status_reply(uint32_t iterations, uint64_t* bytes) {
+  static config_t config;
+  char reply[max_str_l];
+  bool config_changed;
+  uint32_t i;
+
+  config_set_defaults(&config);
+  for (i = 0; i < iterations; i++) {
+    handle_sms_command("674358 Status?", &config, reply, &config_changed);
+    bench_sink += reply[0];
+    *bytes += strlen(reply);
+  }
+
+  return iterations;
+}
+
+static uint32_t bench_config_serialize(uint32_t iterations, uint64_t* bytes) {
+  static uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+  static config_t config;
+  uint32_t i;
+
+  config_set_defaults(&config);
+  for (i = 0; i < iterations; i++) {
+    config_serialize(&config, flash_settings);
+    bench_sink += flash_settings[0];
+  }
+  *bytes += (uint64_t)iterations * FLASH_SETTINGS_BYTES;
+
+  return iterations;
+}
+
+static uint32_t bench_config_parse(uint32_t iterations, uint64_t* bytes) {
+  static uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+  static config_t config;
+  uint32_t i;
+
+  config_set_defaults(&config);
+  config_serialize(&config, flash_settings);
+  for (i = 0; i < iterations; i++)
+    bench_sink += config_parse(&config, flash_settings);
+  *bytes += (uint64_t)iterations * FLASH_SETTINGS_BYTES;
+
+  return iterations;
+}
+
+static uint32_t bench_config_checksum(uint32_t iterations, uint64_t* bytes) {
+  static uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+  static config_t config;
+  uint32_t i;
+
+  config_set_defaults(&config);
+  config_serialize(&config, flash_settings);
+  for (i = 0; i < iterations; i++)
+    bench_sink += config_checksum(flash_settings);
+  *bytes += (uint64_t)iterations * FLASH_SETTINGS_BYTES;
+
+  return iterations;
+}
+
+// rewrites the configuration storage area with its current contents, so that the configuration of the device survives
+// on the Pico this erases and programs the flash sector with interrupts disabled, each operation wears the flash
+static uint32_t bench_flash_commit(uint32_t iterations, uint64_t* bytes) {
+  static uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+  uint32_t i;
+
+  hal_flash_read(flash_settings, FLASH_SETTINGS_BYTES);
+  for (i = 0; i < iterations; i++)
+    hal_flash_write(flash_settings, FLASH_SETTINGS_BYTES);
+  *bytes += (uint64_t)iterations * FLASH_SETTINGS_BYTES;
+
+  return iterations;
+}
+
+const bench_kernel_t bench_kernels[] = {
+  { "ring_buffer_framing", bench_ring_buffer_framing },
+  { "classify_message",    bench_classify_message },
+  { "message_field",       bench_message_field },
+  { "sms_command",         bench_sms_command },
+  { "status_reply",        bench_status_reply },
+  { "config_serialize",    bench_config_serialize },
+  { "config_parse",        bench_config_parse },
+  { "config_checksum",     bench_config_checksum },
+  { "flash_commit",        bench_flash_commit }
+};
+const int bench_number_kernels = sizeof(bench_kernels) / sizeof(bench_kernels[0]);
+
+// times one kernel: the iterations are doubled until a run takes a tenth of time_us, then the fastest of BENCH_REPEATS
+// runs of about a fifth of time_us each counts
+// returns the time per operation in tenths of nanoseconds, and the input bytes per operation in tenths
+static void bench_kernel(const bench_kernel_t* kernel, uint32_t time_us, uint64_t* ns10_per_op, uint64_t* bytes10_per_op) {
+  uint64_t start, elapsed, bytes, ns10;
+  uint32_t iterations = 1, ops;
+  int i;
+
+  while (true) {
+    bytes = 0;
+    start = hal_time_us();
+    kernel->run(iterations, &bytes);
+    elapsed = hal_time_us() - start;
+    if ((elapsed >= time_us / 10) || (iterations >= 0x1000000))
+      break;
+    iterations *= 2;
+  }
+  if (elapsed && (elapsed < time_us / BENCH_REPEATS))
+    iterations = (uint32_t)((uint64_t)iterations * (time_us / BENCH_REPEATS) / elapsed);
+  *ns10_per_op = UINT64_MAX;
+  *bytes10_per_op = 0;
+  for (i = 0; i < BENCH_REPEATS; i++) {
+    bytes = 0;
+    start = hal_time_us();
+    ops = kernel->run(iterations, &bytes);
+    elapsed = hal_time_us() - start;
+    ns10 = ops ? elapsed * 10000 / ops : 0;
+    if (ns10 < *ns10_per_op)
+      *ns10_per_op = ns10;
+    *bytes10_per_op = ops ? bytes * 10 / ops : 0;
+  }
+}
+
+void bench_run(const char* platform, const char* filter, uint32_t time_us) {
+  uint64_t ns10, bytes10;
+  bool first = true;
+  int i;
+
+  printf("{\n  \"platform\": \"%s\",\n  \"benchmarks\": [", platform);
+  for (i = 0; i < bench_number_kernels; i++) {
+    if (filter && !strstr(bench_kernels[i].name, filter))
+      continue;
+    bench_kernel(&bench_kernels[i], time_us, &ns10, &bytes10);
+    printf("%s\n    {\"name\": \"%s\", \"ns_per_op\": %lu.%lu, \"bytes_per_op\": %lu.%lu}", first ? "" : ",",
+           bench_kernels[i].name, (unsigned long)(ns10 / 10), (unsigned long)(ns10 % 10),
+           (unsigned long)(bytes10 / 10), (unsigned long)(bytes10 % 10));
+    first = false;
+  }
+  printf("\n  ]\n}\n");
+}
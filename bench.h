@@ -0,0 +1,30 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// microbenchmarks of the hot paths of the logic (bench.c), shared by the host build (host/bench_main.c) and the firmware
+// each kernel runs an operation a number of times on typical data, the results are printed as JSON:
+//   {
+//     "platform": "host",
+//     "benchmarks": [
+//       {"name": "classify_message", "ns_per_op": 21.4, "bytes_per_op": 19.6},
+//       ...
+//     ]
+//   }
+// with one line per kernel in a fixed order, so that results of different builds can be compared with diff
+// bytes_per_op is the input processed per operation (the logic does not allocate memory)
+
+typedef struct {
+  const char* name;
+// runs the kernel, returns the number of operations and adds the number of input bytes to *bytes
+  uint32_t (*run)(uint32_t iterations, uint64_t* bytes);
+} bench_kernel_t;
+
+extern const bench_kernel_t bench_kernels[];
+extern const int bench_number_kernels;
+
+// runs the kernels whose name contains filter (all for NULL) for about time_us each, and prints the results
+void bench_run(const char* platform, const char* filter, uint32_t time_us);
+
+#endif
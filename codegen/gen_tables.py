@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+# Generates alarmdial_tables.h from the schema tables.json, run by CMake (codegen/tables.cmake) when configuring
+#
+# usage: gen_tables.py tables.json alarmdial_tables.h [profile]
+#
+# The schema holds everything that used to be kept in step by hand across the sources: the prefixes of the modem
+# messages, the multi-stage actions, the SMS commands with their argument grammar, the configuration fields with their
+# defaults, the digest of low-priority input changes, the action on a missed call, the profiles of the supported modems, and the figures of the
+# battery mode. The modem profile is the one given (CMake option ALARMDIAL_MODEM), or the default of the schema. The
+# checks below reject a schema whose parts do not fit together, the header is only rewritten if its contents change
+
+import json
+import sys
+
+ARGUMENTS = [
+    ("NONE", "nothing (anything following is ignored)"),
+    ("TEXT", "the rest of the SMS"),
+    ("INPUT", "an input number 1-GPIO_NUMBER_PINS, ending the SMS"),
+    ("INPUT_MESSAGE", "an input number, then !On! or !Off! and the message text for that input"),
+]
+
+# longest command write_command sends, including its CR (max_str_l of modem.h, less the terminating zero)
+MAX_COMMAND_LENGTH = 199
+
+
+def fail(message):
+    sys.exit("gen_tables.py: " + message)
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def c_list(items):
+    return "{ " + ", ".join(items) + " }"
+
+
+def defines(names_values):
+    width = max(len(name) for name, value in names_values)
+    return ["#define %-*s %s" % (width, name, value) for name, value in names_values]
+
+
+# messages with a profile_prefix take the prefix of that message of the modem profile (e.g. the status report)
+def messages(schema, profile):
+    entries = schema["messages"]
+    names = [entry["name"] for entry in entries]
+    prefixes = [profile[entry["profile_prefix"]]["prefix"] if "profile_prefix" in entry else entry["prefix"]
+                for entry in entries]
+    if len(set(names)) != len(names):
+        fail("duplicate message name")
+    if names[-1] != "UNKNOWN":
+        fail("the last message must be UNKNOWN, the catchall")
+    for i, prefix in enumerate(prefixes):
+        for later in prefixes[i + 1:]:
+            if later.startswith(prefix):
+                fail("message prefix %s hides %s, which comes later" % (prefix, later))
+    lines = ["// messages from the modem, classify_message tries the prefixes in this order"]
+    lines += defines([(name, str(i)) for i, name in enumerate(names)] + [("MAX_MSG", str(len(names)))])
+    lines.append("#define MESSAGE_PREFIXES " + c_list(c_string(prefix) for prefix in prefixes))
+    lines.append("#define MESSAGE_PREFIX_LENGTHS " + c_list(str(len(prefix)) for prefix in prefixes))
+    lines.append("#define MESSAGE_NAMES " + c_list(c_string(name) for name in names))
+    return lines, names
+
+
+def multi_stage_actions(schema):
+    actions = schema["multi_stage_actions"]
+    if len(set(actions)) != len(actions):
+        fail("duplicate multi-stage action")
+    lines = ["// names the multi-stage actions (0 is none)"]
+    lines += defines([("MULTI_STAGE_" + action, str(i + 1)) for i, action in enumerate(actions)] +
+                     [("MULTI_STAGE_MAX_ACTIONS", str(len(actions) + 1))])
+    return lines, actions
+
+
+def sms_commands(schema, actions):
+    commands = schema["sms_commands"]
+    names = [command["name"] for command in commands]
+    arguments = [name for name, description in ARGUMENTS]
+    if len(set(names)) != len(names):
+        fail("duplicate SMS command name")
+    texts = [command["text"] for command in commands]
+    for i, text in enumerate(texts):
+        for other in texts[:i] + texts[i + 1:]:
+            if other.startswith(text):
+                fail("SMS command %s is a prefix of %s" % (text.strip(), other.strip()))
+    entries = []
+    for command in commands:
+        if command["argument"].upper() not in arguments:
+            fail("unknown argument %s of SMS command %s" % (command["argument"], command["name"]))
+        if command["action"] not in actions:
+            fail("unknown multi-stage action %s of SMS command %s" % (command["action"], command["name"]))
+        entries.append("{ %s, %d, SMS_ARGUMENT_%s, MULTI_STAGE_%s }" %
+                       (c_string(command["text"]), len(command["text"]), command["argument"].upper(), command["action"]))
+    lines = ["// arguments of the SMS commands"]
+    width = max(len("SMS_ARGUMENT_" + name) for name in arguments)
+    for i, (name, description) in enumerate(ARGUMENTS):
+        lines.append("#define %-*s %d   // %s" % (width, "SMS_ARGUMENT_" + name, i, description))
+    lines += ["", "// SMS commands, following the password: text, its length, argument and multi-stage action"]
+    lines += defines([("SMS_COMMAND_" + name, str(i)) for i, name in enumerate(names)] +
+                     [("SMS_NUMBER_COMMANDS", str(len(names)))])
+    lines.append("#define SMS_COMMANDS { \\")
+    lines += ["  %s, \\" % entry for entry in entries[:-1]]
+    lines += ["  %s \\" % entries[-1], "}"]
+    return lines
+
+
+def config(schema):
+    config = schema["config"]
+    inputs = config["inputs"]
+    if len(config["default_password"]) != config["password_length"]:
+        fail("the default password needs %d characters" % config["password_length"])
+    if len(config["default_telephone_number"]) >= config["telephone_number_size"]:
+        fail("the default telephone number does not fit")
+    digest = config["digest"]
+    for i, settings in enumerate(inputs):
+        for key in ("on_fall", "on_rise"):
+            if len(settings[key]) >= config["message_size"]:
+                fail("the default message %s of input %d does not fit" % (key, i + 1))
+        if settings["delivery"] not in ("immediate", "digest"):
+            fail("unknown delivery %s of input %d" % (settings["delivery"], i + 1))
+    if not 0 <= digest["hour"] <= 23:
+        fail("the digest hour must be 0-23")
+    if not 1 <= digest["max_events"] <= 16:
+        fail("the digest must hold 1-16 events")
+    missed_call = config["missed_call"]
+    commands = dict((command["name"], command) for command in schema["sms_commands"])
+    for name in missed_call["commands"]:
+        if name not in commands:
+            fail("unknown SMS command %s for missed calls" % name)
+        if commands[name]["argument"] != "none":
+            fail("SMS command %s takes an argument, a missed call cannot give it" % name)
+    if missed_call["default_command"] not in missed_call["commands"]:
+        fail("the default missed call command %s is not one of the missed call commands" % missed_call["default_command"])
+    if not 1 <= missed_call["callers"] <= 8:
+        fail("the allow-list must hold 1-8 callers")
+    lines = ["// what GPIO pins to use to interface with the alarm system, and the size of the configuration fields"]
+    lines += defines([("GPIO_PIN_FIRST", str(config["first_input_pin"])),
+                      ("GPIO_NUMBER_PINS", str(len(inputs))),
+                      ("CONFIG_PASSW_LENGTH", str(config["password_length"])),
+                      ("CONFIG_TEL_NO_SIZE", str(config["telephone_number_size"])),
+                      ("CONFIG_MESSAGE_SIZE", str(config["message_size"])),
+                      ("CONFIG_MODEM_ID_SIZE", str(config["modem_id_size"])),
+                      ("CONFIG_NUMBER_CALLERS", str(missed_call["callers"]))])
+    lines += ["", "// default configuration"]
+    lines += defines([("DEFAULT_PASSW", c_string(config["default_password"])),
+                      ("DEFAULT_TEL_NO", c_string(config["default_telephone_number"])),
+                      ("DEFAULT_SEND_SMS_ON_CHANGE",
+                       c_list("true" if settings["send_sms_on_change"] else "false" for settings in inputs)),
+                      ("DEFAULT_SMS_ON_FALL", c_list(c_string(settings["on_fall"]) for settings in inputs)),
+                      ("DEFAULT_SMS_ON_RISE", c_list(c_string(settings["on_rise"]) for settings in inputs)),
+                      ("DEFAULT_DIGEST",
+                       c_list("true" if settings["delivery"] == "digest" else "false" for settings in inputs)),
+                      ("DEFAULT_MISSED_CALL_COMMAND", "SMS_COMMAND_" + missed_call["default_command"])])
+    lines += ["", "// the input changes of the inputs with digest delivery are sent together, once a day at the local hour",
+              "// DIGEST_HOUR, or as soon as DIGEST_MAX_EVENTS have been collected"]
+    lines += defines([("DIGEST_HOUR", str(digest["hour"])),
+                      ("DIGEST_MAX_EVENTS", str(digest["max_events"]))])
+    lines += ["", "// the SMS commands a missed call from an allowed caller can trigger, the configuration picks one of them"]
+    lines += defines([("MISSED_CALL_COMMANDS", c_list("SMS_COMMAND_" + name for name in missed_call["commands"])),
+                      ("MISSED_CALL_NUMBER_COMMANDS", str(len(missed_call["commands"])))])
+    return lines
+
+
+# basic commands (E0, &D0) follow each other directly, extended ones (starting with +) are separated by semicolons
+def at_text(settings):
+    command = "AT"
+    previous_extended = False
+    for i, setting in enumerate(settings):
+        extended = setting.startswith("+")
+        if i and (extended or previous_extended):
+            command += ";"
+        command += setting
+        previous_extended = extended
+    return command
+
+
+# the same as a C string, with the terminating CR
+def at_command(settings):
+    return c_string(at_text(settings))[:-1] + '\\r"'
+
+
+# the same without the terminating CR, for the parts of a command that modem.c puts together, a continuation starts
+# with the semicolon instead of AT
+def at_settings(settings, continuation=False):
+    command = at_command(settings)[:-3] + '"'
+    return '";' + command[3:] if continuation else command
+
+
+def modem_profile(schema, name):
+    profiles = schema["modem"]["profiles"]
+    if name is None:
+        name = schema["modem"]["profile"]
+    if name not in profiles:
+        fail("unknown modem profile %s, available: %s" % (name, ", ".join(sorted(profiles))))
+    profile = profiles[name]
+    if profile["vendor"] not in ("SIMCom", "Quectel"):
+        fail("unknown vendor %s of modem profile %s" % (profile["vendor"], name))
+    if not profile["sleep"]:
+        fail("the sleep configuration of modem profile %s is empty" % name)
+    status = profile["status"]
+    if ("online" in status) == ("offline" in status):
+        fail("the status of modem profile %s needs either an online or an offline marker" % name)
+    if not status["command"].startswith(status["prefix"]):
+        fail("the status command of modem profile %s does not report with its prefix" % name)
+    if sorted(status["network"]) != ["band", "plmn", "rat"] or len(set(status["network"].values())) != 3:
+        fail("the network of the status of modem profile %s needs distinct rat, plmn and band parameters" % name)
+    if not profile["ready"]:
+        fail("modem profile %s has no start-up message that tells it is ready" % name)
+    return name, profile
+
+
+# the capabilities are probed with their test command (AT+CNMI=?) once per modem and firmware, a capability with a field
+# needs value in the list of that parameter of the test response, one without is there if the modem knows the command
+# the battery and mains settings of a capability are only sent to a modem that has it
+def capabilities(modem):
+    entries = modem["capabilities"]
+    names = [entry["name"] for entry in entries]
+    if len(set(names)) != len(names):
+        fail("duplicate modem capability")
+    if len(entries) > 8:
+        fail("at most 8 modem capabilities fit into the configuration")
+    for entry in entries:
+        if ("battery" in entry) != ("mains" in entry):
+            fail("modem capability %s needs both battery and mains settings, or neither" % entry["name"])
+        if ("field" in entry) != ("value" in entry):
+            fail("modem capability %s needs both field and value, or neither" % entry["name"])
+    power_saving = [entry for entry in entries if "battery" in entry]
+    lines = ["// modem capabilities, bits of modem_capabilities, probed with the test commands of MODEM_CAPABILITY_PROBES",
+             "// (command, prefix of the response, parameter holding the list, value needed in it, -1 and 0 if any",
+             "// response will do), the power saving settings of the battery mode go to modems with the capability"]
+    lines += defines([("MODEM_CAPABILITY_" + entry["name"], "0x%02x" % (1 << i)) for i, entry in enumerate(entries)] +
+                     [("MODEM_NUMBER_CAPABILITIES", str(len(entries))),
+                      ("MODEM_CAPABILITY_NAMES", c_list(c_string(entry["description"]) for entry in entries)),
+                      ("MODEM_CAPABILITY_PROBES",
+                       "{ %s }" % ", ".join("{ %s, %s, %d, %d }" % (at_command([entry["test"] + "=?"]),
+                                                                     c_string(entry["test"] + ":"),
+                                                                     entry.get("field", -1), entry.get("value", 0))
+                                            for entry in entries)),
+                      ("MODEM_NUMBER_POWER_SAVING", str(len(power_saving))),
+                      ("MODEM_POWER_SAVING_CAPABILITIES",
+                       c_list("MODEM_CAPABILITY_" + entry["name"] for entry in power_saving)),
+                      ("MODEM_POWER_SAVING_BATTERY", c_list(at_settings([entry["battery"]], True) for entry in power_saving)),
+                      ("MODEM_POWER_SAVING_MAINS", c_list(at_settings([entry["mains"]], True) for entry in power_saving))])
+    return lines, power_saving
+
+
+# the profile adds its own settings to the common configuration, the initialisation sends the basic commands one by
+# one (the first waits for the modem to start up), the extended ones together, then clears the SMS storage
+# the configuration command is put together by modem.c: the settings (with the sleep settings in sleep mode), the SMS
+# indication or, for a modem that has the capability, the direct SMS delivery instead, the power saving settings the
+# modem has the capabilities for (only in sleep mode, as the modem is only woken through DTR), and the clock settings
+# with the clock query, so each configuration command also reads out the modem clock
+# the longest of them must fit into a command (max_str_l of modem.h)
+def modem(schema, name, profile):
+    modem = schema["modem"]
+    sleep = profile["sleep"]
+    status = profile["status"]
+    clock = modem["clock"]["configuration"] + [modem["clock"]["query"]]
+    configuration = modem["configuration"] + profile["configuration"]
+    indication = modem["direct_sms"]["indication"]
+    direct_sms = modem["direct_sms"]["configuration"]
+    if not modem["clock"]["query"].endswith("?"):
+        fail("the modem clock query must be a read command")
+    capability_lines, power_saving = capabilities(modem)
+    longest = configuration + max(indication, direct_sms, key=lambda settings: len(at_text(settings))) + sleep + \
+              clock + [max(entry["battery"], entry["mains"], key=len) for entry in power_saving]
+    if len(at_text(longest)) + 1 > MAX_COMMAND_LENGTH:
+        fail("the configuration command of modem profile %s is longer than %d characters with its CR" %
+             (name, MAX_COMMAND_LENGTH))
+    basic = [setting for setting in configuration + indication if not setting.startswith("+")]
+    extended = [setting for setting in configuration + indication if setting.startswith("+")]
+    initialisation = [at_command([setting]) for setting in basic] + [at_command(extended)] + \
+                     [at_command([setting]) for setting in modem["storage_cleanup"]]
+    lines = ["// modem profile (driver), selected when configuring: the commands for initialisation, configuration,",
+             "// reset and network status, the start-up messages of a modem that is ready (after a restart), and the",
+             "// parameter of the call report that holds the number",
+             "// the configuration settings set everything the logic relies on, the sleep variant also lets the modem",
+             "// sleep while DTR is high (MODEM_SLEEP is the default of modem_sleep), the clock settings enable the",
+             "// network time and read out the modem clock, and end every configuration command, the SMS settings",
+             "// either indicate SMS (+CMTI) or, on a modem with the capability and if MODEM_DIRECT_SMS, deliver them",
+             "// directly (+CMT)",
+             "// the status report means online if it contains MODEM_STATUS_MARKER, or if it does not, depending on",
+             "// MODEM_STATUS_MARKER_ONLINE, and gives the access technology, network (MCC and MNC) and band of the",
+             "// serving cell in the parameters MODEM_STATUS_*_FIELD"]
+    lines += defines([("MODEM_NAME", c_string(name)),
+                      ("MODEM_VENDOR", c_string(profile["vendor"])),
+                      ("MODEM_QUECTEL", "true" if profile["vendor"] == "Quectel" else "false"),
+                      ("MODEM_INIT_COMMANDS", c_list(initialisation)),
+                      ("MODEM_NUMBER_INIT_COMMANDS", str(len(initialisation))),
+                      ("MODEM_CONFIG_SETTINGS", at_settings(configuration)),
+                      ("MODEM_CONFIG_SETTINGS_SLEEP", at_settings(configuration + sleep)),
+                      ("MODEM_CLOCK_SETTINGS", '";' + at_command(clock)[3:]),
+                      ("MODEM_CLOCK_COMMAND", at_command(clock)),
+                      ("MODEM_SLEEP", "true" if modem["sleep"]["enabled"] else "false"),
+                      ("MODEM_SLEEP_COMMAND", at_command(sleep)),
+                      ("MODEM_DIRECT_SMS", "true" if modem["direct_sms"]["enabled"] else "false"),
+                      ("MODEM_SMS_INDICATION_SETTINGS", at_settings(indication, True)),
+                      ("MODEM_DIRECT_SMS_SETTINGS", at_settings(direct_sms, True)),
+                      ("MODEM_DIRECT_SMS_COMMAND", at_command(direct_sms)),
+                      ("MODEM_RESET_COMMAND", at_command([profile["reset"]])),
+                      ("MODEM_STATUS_COMMAND", at_command([status["command"]])),
+                      ("MODEM_STATUS_MARKER", c_string(status["online"] if "online" in status else status["offline"])),
+                      ("MODEM_STATUS_MARKER_ONLINE", "true" if "online" in status else "false"),
+                      ("MODEM_STATUS_RAT_FIELD", str(status["network"]["rat"])),
+                      ("MODEM_STATUS_PLMN_FIELD", str(status["network"]["plmn"])),
+                      ("MODEM_STATUS_BAND_FIELD", str(status["network"]["band"])),
+                      ("MODEM_CALL_NUMBER_FIELD", str(profile["call"]["number_field"])),
+                      ("MODEM_READY_MESSAGES", c_list(c_string(message) for message in profile["ready"])),
+                      ("MODEM_NUMBER_READY_MESSAGES", str(len(profile["ready"])))])
+    return lines + [""] + capability_lines
+
+
+def power(schema, config_schema):
+    power = schema["power"]
+    current = power["current_ua"]
+    first = config_schema["first_input_pin"]
+    if first <= power["supply_sense_pin"] < first + len(config_schema["inputs"]):
+        fail("the supply sense pin %d is an alarm input" % power["supply_sense_pin"])
+    if power["interval_factor"] < 1:
+        fail("the interval factor of the battery mode must be at least 1")
+    lines = ["// battery mode: supply sensing (the pin is low while the external supply is present), the factor by which",
+             "// the housekeeping intervals are stretched, and the figures of the energy accounting (currents of the Pico",
+             "// per clock state and of the modem per state in uA, charge of the transmission of an SMS in uAs)"]
+    lines += defines([("POWER_SUPPLY_SENSE", "true" if power["supply_sense"] else "false"),
+                      ("GPIO_PIN_SUPPLY_SENSE", str(power["supply_sense_pin"])),
+                      ("POWER_BATTERY_CAPACITY_MAH", str(power["battery_capacity_mah"])),
+                      ("POWER_INTERVAL_FACTOR", str(power["interval_factor"])),
+                      ("POWER_CURRENT_PICO_FAST_UA", str(current["pico_fast"])),
+                      ("POWER_CURRENT_PICO_SLOW_UA", str(current["pico_slow"])),
+                      ("POWER_CURRENT_PICO_SLEEP_UA", str(current["pico_sleep"])),
+                      ("POWER_CURRENT_MODEM_AWAKE_UA", str(current["modem_awake"])),
+                      ("POWER_CURRENT_MODEM_COMMAND_UA", str(current["modem_command"])),
+                      ("POWER_CURRENT_MODEM_SMS_UA", str(current["modem_sms"])),
+                      ("POWER_CURRENT_MODEM_SLEEP_UA", str(current["modem_sleep"])),
+                      ("POWER_CURRENT_MODEM_BATTERY_SLEEP_UA", str(current["modem_battery_sleep"])),
+                      ("POWER_SMS_CHARGE_UAS", str(power["sms_charge_uas"]))])
+    return lines
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit("usage: gen_tables.py tables.json alarmdial_tables.h [profile]")
+    with open(sys.argv[1]) as f:
+        schema = json.load(f)
+
+    name, profile = modem_profile(schema, sys.argv[3] if len(sys.argv) == 4 and sys.argv[3] else None)
+    message_lines, message_names = messages(schema, profile)
+    action_lines, actions = multi_stage_actions(schema)
+    sections = [message_lines, action_lines, sms_commands(schema, actions), config(schema), modem(schema, name, profile),
+                power(schema, schema["config"])]
+    lines = ["#ifndef ALARMDIAL_TABLES_H", "#define ALARMDIAL_TABLES_H", "",
+             "// generated by codegen/gen_tables.py from codegen/tables.json, do not edit", ""]
+    for section in sections:
+        lines += section + [""]
+    lines.append("#endif")
+    header = "\n".join(lines) + "\n"
+
+    try:
+        with open(sys.argv[2]) as f:
+            if f.read() == header:
+                return
+    except OSError:
+        pass
+    with open(sys.argv[2], "w") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,22 @@
+# Generates alarmdial_tables.h from the schema codegen/tables.json into the build directory, see gen_tables.py
+# This runs when configuring, and the build reconfigures whenever the schema or the generator change
+# ALARMDIAL_MODEM selects the modem profile of the schema (A7670E, SIM7600, BG95, EG91), empty for its default
+
+find_package(Python3 COMPONENTS Interpreter REQUIRED)
+
+set(ALARMDIAL_MODEM "" CACHE STRING "Modem profile of codegen/tables.json, empty for the default")
+
+set(ALARMDIAL_GENERATED_DIR ${CMAKE_BINARY_DIR}/generated)
+file(MAKE_DIRECTORY ${ALARMDIAL_GENERATED_DIR})
+execute_process(
+  COMMAND ${Python3_EXECUTABLE} ${CMAKE_CURRENT_LIST_DIR}/gen_tables.py ${CMAKE_CURRENT_LIST_DIR}/tables.json
+          ${ALARMDIAL_GENERATED_DIR}/alarmdial_tables.h "${ALARMDIAL_MODEM}"
+  RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "Generating alarmdial_tables.h from codegen/tables.json failed")
+endif()
+set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS
+  ${CMAKE_CURRENT_LIST_DIR}/tables.json
+  ${CMAKE_CURRENT_LIST_DIR}/gen_tables.py)
+
+include_directories(${ALARMDIAL_GENERATED_DIR})
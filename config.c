@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "hal.h"
+
+// default configuration
+const char* const default_passw = DEFAULT_PASSW;
+const char* const default_tel_no = DEFAULT_TEL_NO;
+const bool default_send_sms_on_change[GPIO_NUMBER_PINS] = DEFAULT_SEND_SMS_ON_CHANGE;
+const char* const default_sms_on_fall[GPIO_NUMBER_PINS] = DEFAULT_SMS_ON_FALL;
+const char* const default_sms_on_rise[GPIO_NUMBER_PINS] = DEFAULT_SMS_ON_RISE;
+const bool default_digest[GPIO_NUMBER_PINS] = DEFAULT_DIGEST;
+
+// resets all settings to the default values
+void config_set_defaults(config_t* config) {
+  int i;
+
+  strcpy(config->passw, default_passw);
+  strcpy(config->tel_no, default_tel_no);
+  for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+    strcpy(config->sms_on_fall[i], default_sms_on_fall[i]);
+    strcpy(config->sms_on_rise[i], default_sms_on_rise[i]);
+    config->send_sms_on_change[i] = default_send_sms_on_change[i];
+    config->digest[i] = default_digest[i];
+  }
+  config->modem_id[0] = 0;
+  config->modem_capabilities = 0;
+  config->network_plmn[0] = 0;
+  config->network_rat = 0;
+  config->network_band = 0;
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    config->callers[i][0] = 0;
+  config->missed_call_command = DEFAULT_MISSED_CALL_COMMAND;
+}
+
+// checksum over the stored settings, which is kept in the first byte
+uint8_t config_checksum(const uint8_t* flash_settings) {
+  uint8_t checksum = 127;
+  int i;
+
+  for (i = 1; i < FLASH_SETTINGS_BYTES; i++)
+    checksum = checksum + flash_settings[i];
+
+  return checksum;
+}
+
+// copies a string into the settings, including the terminating zero
+static int serialize_string(uint8_t* flash_settings, int l, const char* str) {
+  int i = 0;
+
+  do {
+    flash_settings[l++] = str[i];
+  } while (str[i++]);
+
+  return l;
+}
+
+// copies a string out of the settings, truncating it to the size of the target
+static int parse_string(const uint8_t* flash_settings, int l, char* str, int size) {
+  int i = 0;
+
+  while ((l < FLASH_SETTINGS_BYTES) && flash_settings[l]) {
+    if (i < size-1)
+      str[i++] = flash_settings[l];
+    l++;
+  }
+  str[i] = 0;
+
+  return l + 1;
+}
+
+// writes the configuration into the settings storage format, followed by the checksum
+void config_serialize(const config_t* config, uint8_t* flash_settings) {
+  int i, l;
+
+  memset(flash_settings, 0, FLASH_SETTINGS_BYTES);
+  l = 1;
+  l = serialize_string(flash_settings, l, config->passw);
+  l = serialize_string(flash_settings, l, config->tel_no);
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    l = serialize_string(flash_settings, l, config->sms_on_fall[i]);
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    l = serialize_string(flash_settings, l, config->sms_on_rise[i]);
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    flash_settings[l++] = config->send_sms_on_change[i];
+  flash_settings[l++] = CONFIG_LAYOUT_MARKER;
+  flash_settings[l++] = CONFIG_LAYOUT_VERSION;
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    flash_settings[l++] = config->digest[i];
+  l = serialize_string(flash_settings, l, config->modem_id);
+  flash_settings[l++] = config->modem_capabilities;
+  l = serialize_string(flash_settings, l, config->network_plmn);
+  flash_settings[l++] = config->network_rat;
+  flash_settings[l++] = config->network_band;
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    l = serialize_string(flash_settings, l, config->callers[i]);
+  flash_settings[l++] = config->missed_call_command;
+  flash_settings[0] = config_checksum(flash_settings);
+}
+
+// reads the configuration from the settings storage format
+// returns false (and leaves the configuration untouched) if the checksum does not match
+bool config_parse(config_t* config, const uint8_t* flash_settings) {
+  int i, l;
+
+  if (config_checksum(flash_settings) != flash_settings[0])
+    return false;
+  l = 1;
+  l = parse_string(flash_settings, l, config->passw, sizeof(config->passw));
+  l = parse_string(flash_settings, l, config->tel_no, sizeof(config->tel_no));
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    l = parse_string(flash_settings, l, config->sms_on_fall[i], sizeof(config->sms_on_fall[i]));
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    l = parse_string(flash_settings, l, config->sms_on_rise[i], sizeof(config->sms_on_rise[i]));
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    config->send_sms_on_change[i] = (l < FLASH_SETTINGS_BYTES) ? flash_settings[l++] : false;
+// settings of an unknown layout keep all inputs immediate, the modem is probed again and starts with a full network
+// search, and missed calls are only hung up
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    config->digest[i] = false;
+  config->modem_id[0] = 0;
+  config->modem_capabilities = 0;
+  config->network_plmn[0] = 0;
+  config->network_rat = 0;
+  config->network_band = 0;
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    config->callers[i][0] = 0;
+  config->missed_call_command = MISSED_CALL_NONE;
+  if ((l + 2 > FLASH_SETTINGS_BYTES) || (flash_settings[l] != CONFIG_LAYOUT_MARKER) ||
+      (flash_settings[l+1] != CONFIG_LAYOUT_VERSION)) {
+#ifdef DEBUG
+    printf("Flash configuration of an earlier layout, later settings take their defaults\n");
+#endif
+    return true;
+  }
+  l += 2;
+// a delivery other than 0 or 1 cannot have been stored, the input is then immediate
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    config->digest[i] = (l < FLASH_SETTINGS_BYTES) && (flash_settings[l++] == 1);
+  l = parse_string(flash_settings, l, config->modem_id, sizeof(config->modem_id));
+  config->modem_capabilities = (l < FLASH_SETTINGS_BYTES) ? flash_settings[l++] : 0;
+  l = parse_string(flash_settings, l, config->network_plmn, sizeof(config->network_plmn));
+  config->network_rat = (l < FLASH_SETTINGS_BYTES) ? flash_settings[l++] : 0;
+  config->network_band = (l < FLASH_SETTINGS_BYTES) ? flash_settings[l++] : 0;
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    l = parse_string(flash_settings, l, config->callers[i], sizeof(config->callers[i]));
+  config->missed_call_command = (l < FLASH_SETTINGS_BYTES) ? flash_settings[l++] : MISSED_CALL_NONE;
+
+  return true;
+}
+
+// restores settings from flash, if not available applies defaults
+// returns true if the defaults have been applied, so they need storing
+bool config_load(config_t* config) {
+  uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+
+  hal_flash_read(flash_settings, FLASH_SETTINGS_BYTES);
+// uncomment following line to force saving (new) defaults, run once, then comment out again
+//  flash_settings[0] = config_checksum(flash_settings) + 1;
+  if (!config_parse(config, flash_settings)) {
+#ifdef DEBUG
+    printf("Flash configuration checksum mismatch, will save defaults\n");
+#endif
+    config_set_defaults(config);
+    return true;
+  }
+
+  return false;
+}
+
+// saves the configuration to flash
+void config_store(const config_t* config) {
+  uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+
+  config_serialize(config, flash_settings);
+  hal_flash_write(flash_settings, FLASH_SETTINGS_BYTES);
+}
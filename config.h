@@ -0,0 +1,57 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarmdial_tables.h"
+
+// the GPIO pins to use to interface with the alarm system (GPIO_PIN_FIRST, GPIO_NUMBER_PINS), the field sizes and the
+// defaults are generated into alarmdial_tables.h
+
+// size of the configuration storage area in flash
+#define FLASH_SETTINGS_BYTES 1024
+
+// marker and layout version stored ahead of the settings that follow the SMS actions of the inputs, settings without
+// them (such as those of the first version, which left the rest of the sector as it was) get the defaults of old settings
+#define CONFIG_LAYOUT_MARKER 0xa5
+#define CONFIG_LAYOUT_VERSION 1
+
+// room for a network (PLMN) as MCC and MNC, e.g. "23410", with the terminating 0
+#define CONFIG_PLMN_SIZE 7
+
+// no SMS command for missed calls, they are only hung up
+#define MISSED_CALL_NONE 0xff
+
+// current configuration
+typedef struct {
+  char passw[CONFIG_PASSW_LENGTH + 1];
+  char tel_no[CONFIG_TEL_NO_SIZE];
+  bool send_sms_on_change[GPIO_NUMBER_PINS];
+  char sms_on_fall[GPIO_NUMBER_PINS][CONFIG_MESSAGE_SIZE];
+  char sms_on_rise[GPIO_NUMBER_PINS][CONFIG_MESSAGE_SIZE];
+  bool digest[GPIO_NUMBER_PINS];
+// capabilities of the modem found by the probe at the first boot with it, and the IMEI and firmware revision of that
+// modem ("imei/revision", empty if it has not been probed), so a different modem or firmware is probed again
+  char modem_id[CONFIG_MODEM_ID_SIZE];
+  uint8_t modem_capabilities;
+// the network the modem last registered with, its access technology (as for AT+COPS, e.g. 7 for LTE) and band, which
+// the modem is pointed to first after a reset (empty if none)
+  char network_plmn[CONFIG_PLMN_SIZE];
+  uint8_t network_rat;
+  uint8_t network_band;
+// the callers besides tel_no whose missed calls trigger missed_call_command (one of MISSED_CALL_COMMANDS, or
+// MISSED_CALL_NONE), empty if unused
+  char callers[CONFIG_NUMBER_CALLERS][CONFIG_TEL_NO_SIZE];
+  uint8_t missed_call_command;
+} config_t;
+
+extern const char* const default_passw;
+
+void config_set_defaults(config_t* config);
+uint8_t config_checksum(const uint8_t* flash_settings);
+void config_serialize(const config_t* config, uint8_t* flash_settings);
+bool config_parse(config_t* config, const uint8_t* flash_settings);
+bool config_load(config_t* config);
+void config_store(const config_t* config);
+
+#endif
@@ -0,0 +1,75 @@
+#include <string.h>
+#include "diagnostics.h"
+#include "hal.h"
+
+#define CR '\x0D'
+
+const char* const reboot_reason_text[REBOOT_REASON_MAX] = { "power on", "watchdog", "modem offline", "hardfault" };
+
+uint32_t stack_high_water_bytes = 0;
+uint32_t stack_size_bytes = 0;
+
+// records the reason for an intentional reboot, then reboots through the watchdog
+void reboot_device(uint32_t reason) {
+  reboot_record.reason = reason;
+  hal_reboot();
+}
+
+// evaluates the post-mortem record after boot, counts the reboot reason and prepares the record for this run
+// returns the reason for the last reboot
+uint32_t evaluate_reboot_record(void) {
+  uint32_t reason;
+  int i;
+
+  if ((reboot_record.magic != REBOOT_RECORD_MAGIC) || (reboot_record.magic_inverted != ~REBOOT_RECORD_MAGIC)) {
+// power cycle, RAM content is random
+    memset(&reboot_record, 0, sizeof(reboot_record));
+    reboot_record.magic = REBOOT_RECORD_MAGIC;
+    reboot_record.magic_inverted = ~REBOOT_RECORD_MAGIC;
+    reason = REBOOT_REASON_POWER_ON;
+  }
+  else if ((reboot_record.reason == REBOOT_REASON_MODEM_OFFLINE) || (reboot_record.reason == REBOOT_REASON_HARDFAULT))
+    reason = reboot_record.reason;
+  else if (hal_watchdog_caused_reboot())
+    reason = REBOOT_REASON_WATCHDOG;
+  else
+    reason = REBOOT_REASON_POWER_ON;
+  if (reason >= REBOOT_REASON_MAX)
+    reason = REBOOT_REASON_POWER_ON;
+  reboot_record.count[reason]++;
+  reboot_record.last_command[REBOOT_RECORD_COMMAND_LENGTH-1] = 0;
+  for (i = 0; i < REBOOT_RECORD_COMMAND_LENGTH-1; i++)
+    if ((reboot_record.last_command[i] < ' ') || (reboot_record.last_command[i] > '~'))
+      reboot_record.last_command[i] = 0;
+
+  return reason;
+}
+
+// prepares the post-mortem record for this run, after the last one has been reported
+// if the watchdog fires without an intentional reboot, the default reason indicates a hang
+void reset_reboot_record(void) {
+  reboot_record.reason = REBOOT_REASON_WATCHDOG;
+  reboot_record.loop_section = 0;
+  reboot_record.uptime_s = 0;
+  reboot_record.pc = 0;
+  reboot_record.lr = 0;
+  reboot_record.last_command[0] = 0;
+}
+
+// records an AT command for post-mortem analysis, other data (SMS text) is not recorded
+void record_command(const char* command) {
+  int l = 0;
+
+  if ((command[0] == 'A') && (command[1] == 'T')) {
+    while ((l < REBOOT_RECORD_COMMAND_LENGTH-1) && (command[l] != CR) && command[l]) {
+      reboot_record.last_command[l] = command[l];
+      l++;
+    }
+    reboot_record.last_command[l] = 0;
+  }
+}
+
+// determines the deepest stack use so far
+void check_stack_high_water(void) {
+  stack_high_water_bytes = hal_stack_check(&stack_size_bytes);
+}
@@ -0,0 +1,67 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// reasons for the last reboot, recorded before the reboot and reported after the next boot
+#define REBOOT_REASON_POWER_ON       0
+#define REBOOT_REASON_WATCHDOG       1
+#define REBOOT_REASON_MODEM_OFFLINE  2
+#define REBOOT_REASON_HARDFAULT      3
+#define REBOOT_REASON_MAX            4
+
+// names the sections of the main loop, the last section entered is recorded for post-mortem analysis
+#define LOOP_SECTION_READ_MESSAGE    1
+#define LOOP_SECTION_STATUS          2
+#define LOOP_SECTION_CREG            3
+#define LOOP_SECTION_CMTI            4
+#define LOOP_SECTION_CALL            5
+#define LOOP_SECTION_CGEV            6
+#define LOOP_SECTION_CMGR            7
+#define LOOP_SECTION_CSQ             8
+#define LOOP_SECTION_MODEM_CONFIG    9
+#define LOOP_SECTION_CMGS            10
+#define LOOP_SECTION_OK              11
+#define LOOP_SECTION_UNKNOWN         12
+#define LOOP_SECTION_TIMEOUTS        13
+#define LOOP_SECTION_GPIO            14
+#define LOOP_SECTION_PW_RESET        15
+#define LOOP_SECTION_SLEEP           16
+#define LOOP_SECTION_FLASH           17
+#define LOOP_SECTION_POWER           18
+#define LOOP_SECTION_CLOCK           19
+#define LOOP_SECTION_DIGEST          20
+#define LOOP_SECTION_CMT             21
+
+// post-mortem record in RAM that is not initialised at boot, so it survives watchdog reboots (but not power cycles)
+// updated continuously by the main loop, so after a hang it holds the last known state
+// the platform defines the record (hal_pico.c places it in no-init RAM)
+#define REBOOT_RECORD_MAGIC 0x41446d72
+#define REBOOT_RECORD_COMMAND_LENGTH 24
+typedef struct {
+  uint32_t magic;
+  uint32_t magic_inverted;
+  uint32_t reason;
+  uint32_t loop_section;
+  uint32_t uptime_s;
+  uint32_t pc;
+  uint32_t lr;
+  char last_command[REBOOT_RECORD_COMMAND_LENGTH];
+  uint32_t count[REBOOT_REASON_MAX];
+} reboot_record_t;
+extern reboot_record_t reboot_record;
+
+extern const char* const reboot_reason_text[REBOOT_REASON_MAX];
+
+// peak stack use, updated by the regular stack check
+extern uint32_t stack_high_water_bytes;
+extern uint32_t stack_size_bytes;
+
+void reboot_device(uint32_t reason);
+uint32_t evaluate_reboot_record(void);
+void reset_reboot_record(void);
+void record_command(const char* command);
+void check_stack_high_water(void);
+
+#endif
@@ -0,0 +1,899 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "diagnostics.h"
+#include "digest.h"
+#include "dialler.h"
+#include "energy.h"
+#include "format.h"
+#include "hal.h"
+#include "modem.h"
+#include "power.h"
+#include "sms_command.h"
+#include "wallclock.h"
+
+// the dialler state lives at file scope, dialler_setup initialises all of it so that a (simulated) reboot starts afresh
+
+// variables for LED action control
+static bool led_onoff;
+static uint64_t last_led_switch_time;
+
+// work variables
+static char str[max_str_l];
+
+// variables to communicate through handling levels of multi-stage actions
+static int multi_stage_handling_type;
+static char multi_stage_message[MULTI_STAGE_MAX_ACTIONS][max_str_l];
+// the caller whose missed call started the multi-stage action gets its SMS instead of the configured telephone number
+// (empty if the action has not come from a missed call)
+static char multi_stage_caller[CONFIG_TEL_NO_SIZE];
+
+// variables relating to messages and data received from modem
+static bool received[MAX_MSG];
+static char received_response[MAX_MSG][max_str_l];
+static char received_sms_text[max_str_l];
+static int unknown_message_count;
+
+// SMS delivered directly (+CMT): the text is the line after the +CMT (direct_sms_expected), and it waits in the queue
+// direct_sms_text (direct_sms of them from direct_sms_first on) until nothing else is in progress
+static char direct_sms_text[DIRECT_SMS_QUEUE_LENGTH][max_str_l];
+static int direct_sms_first, direct_sms;
+static bool direct_sms_expected;
+
+// variables relating to GPIO input pins (alarm system connections)
+static bool last_status[GPIO_NUMBER_PINS];
+static uint64_t last_status_check_time;
+
+// variables relating to GPIO input pin for password reset
+static uint64_t last_passw_reset_time, last_passw_reset_check_time;
+
+// variables indicating status of actions
+static bool awaiting_response[MAX_MSG];
+static bool received_sms;
+
+// variables storing event times to control regular actions and timeouts
+static uint64_t current_time, last_creg_check_time, last_network_status_check_time, last_modem_config_reiteration_time;
+static uint64_t last_stack_check_time, last_missed_call_time;
+static uint64_t initiate_time[MAX_MSG];
+
+// variables relating to the post-mortem report of the last reboot
+static uint32_t reboot_reason;
+
+// a configuration command has been sent and its OK is awaited
+static bool modem_config_pending;
+
+// current configuration
+static config_t config;
+static bool store_new_flash_settings;
+
+// the housekeeping intervals are stretched in battery mode
+static uint64_t housekeeping_interval_us(uint64_t interval_us) {
+  return power_mode == POWER_BATTERY ? interval_us * POWER_INTERVAL_FACTOR : interval_us;
+}
+
+// the modem state as far as the logic can tell: asleep, awaiting the response to an SMS or another command, or idle
+static int modem_energy_state(void) {
+  int i;
+
+  if (!modem_awake)
+    return ENERGY_MODEM_SLEEP;
+  if (awaiting_response[CMGS])
+    return ENERGY_MODEM_SMS;
+  for (i = 0; i < MAX_MSG-1; i++)
+    if (awaiting_response[i])
+      return ENERGY_MODEM_COMMAND;
+
+  return ENERGY_MODEM_IDLE;
+}
+
+// appends the local time of an event reported by SMS, once the wall clock has been set from the network time
+static void format_event_time(format_t* format) {
+  if (!wallclock_valid())
+    return;
+  format_str(format, " at ");
+  wallclock_format(format, current_time);
+}
+
+// starts a multi-stage action once the modem is ready for it: a signal level request reads out the signal quality first,
+// all other actions send their SMS (multi_stage_message)
+static void start_multi_stage_action(int type) {
+  if (type == MULTI_STAGE_RECEIVED_SIGNAL_REQUEST) {
+    write_command("AT+CSQ\r");
+    initiate_time[CSQ] = current_time;
+    awaiting_response[CSQ] = true;
+  }
+  else {
+#ifdef DEBUG
+    printf("Sending SMS: %s\n", multi_stage_message[type]);
+#endif
+    send_sms(multi_stage_caller[0] ? multi_stage_caller : config.tel_no, multi_stage_message[type]);
+    multi_stage_caller[0] = 0;
+    initiate_time[CMGS] = current_time;
+    awaiting_response[CMGS] = true;
+  }
+  awaiting_response[UNKNOWN] = true;
+  multi_stage_handling_type = 0;
+}
+
+// initialises hardware, configuration and modem, everything up to the main loop
+void dialler_setup(void) {
+  format_t format;
+  int i;
+
+#ifdef DEBUG
+// give some time to connect to USB interface
+  hal_sleep_ms(10000);
+  printf("Starting up\n");
+#endif
+
+// evaluate the post-mortem record of the last reboot
+  reboot_reason = evaluate_reboot_record();
+  if (reboot_reason != REBOOT_REASON_POWER_ON) {
+    format_init(&format, multi_stage_message[MULTI_STAGE_SEND_REBOOT_REPORT], max_str_l);
+    format_str(&format, "Rebooted (");
+    format_str(&format, reboot_reason_text[reboot_reason]);
+    format_str(&format, ") after ");
+    format_uint(&format, reboot_record.uptime_s);
+    format_str(&format, "s, section ");
+    format_uint(&format, reboot_record.loop_section);
+    format_str(&format, ", last ");
+    format_str(&format, reboot_record.last_command[0] ? reboot_record.last_command : "none");
+    if (reboot_reason == REBOOT_REASON_HARDFAULT) {
+      format_str(&format, ", pc ");
+      format_hex(&format, reboot_record.pc, 8);
+      format_str(&format, " lr ");
+      format_hex(&format, reboot_record.lr, 8);
+    }
+    format_str(&format, ". Reboots: ");
+    format_uint(&format, reboot_record.count[REBOOT_REASON_WATCHDOG]);
+    format_str(&format, " watchdog, ");
+    format_uint(&format, reboot_record.count[REBOOT_REASON_MODEM_OFFLINE]);
+    format_str(&format, " modem offline, ");
+    format_uint(&format, reboot_record.count[REBOOT_REASON_HARDFAULT]);
+    format_str(&format, " hardfault");
+  }
+#ifdef DEBUG
+  if (reboot_reason != REBOOT_REASON_POWER_ON)
+    printf("%s\n", multi_stage_message[MULTI_STAGE_SEND_REBOOT_REPORT]);
+  else
+    printf("Clean boot, not from watchdog\n");
+#endif
+  reset_reboot_record();
+
+// configure UART for communication with modem
+  hal_uart_init(BAUD_RATE);
+
+// configure DTR and RI for modem sleep mode
+  modem_sleep_init();
+
+// configure LED
+  hal_gpio_init_output(LED_PIN);
+  led_onoff = false;
+
+// configure GPIO pins for interfacing with the alarm system
+  for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+    hal_gpio_init_input_pullup(GPIO_PIN_FIRST + i);
+    last_status[i] = false;
+  }
+
+// configure GPIO pin for password reset
+  hal_gpio_init_input_pullup(GPIO_PIN_PW_RESET);
+
+// restore settings from flash, if not available schedule storage of defaults
+#ifdef DEBUG
+  printf("Read configuration stored in flash memory\n");
+#endif
+  store_new_flash_settings = config_load(&config);
+#ifdef DEBUG
+  if (!store_new_flash_settings) {
+    printf("Applied the following settings from flash memory:\n");
+    printf("Password: %s\n", config.passw);
+    printf("Telephone number: %s\n", config.tel_no);
+    for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+      printf("SMS on fall for pin %1d: %s\n", i, config.sms_on_fall[i]);
+      printf("SMS on rise for pin %1d: %s\n", i, config.sms_on_rise[i]);
+      printf("Send SMS on change for pin %1d: %s\n", i, config.send_sms_on_change[i] ? "Yes" : "No");
+      printf("Delivery for pin %1d: %s\n", i, config.digest[i] ? "Digest" : "Immediate");
+    }
+  }
+#endif
+
+// reboot modem and give it some time to start up
+#ifdef DEBUG
+  printf("Reboot the modem, sleep a bit, then initialise modem\n");
+#endif
+  hal_sleep_ms(10000);
+// automatic time zone update is kept by the modem, so with it enabled before the reset, the modem sets its clock from
+// the network time when it registers
+  wallclock_init();
+  write_command("AT+CTZU=1\r");
+  hal_sleep_ms(1000);
+  modem_reset();
+// the initialisation waits for the registration, so the sleep only needs to cover the restart of the modem
+  hal_sleep_ms(20000);
+// a modem (or firmware) seen for the first time is probed for its capabilities, which are kept in flash, as is the
+// network the modem registers with
+  if (initialise_modem(&config))
+    store_new_flash_settings = true;
+
+// initialise regular modem checks, GPIO checking interval, LED blinking interval
+  current_time = hal_time_us();
+  last_status_check_time = current_time;
+  last_passw_reset_time = current_time;
+  last_passw_reset_check_time = current_time;
+  last_led_switch_time = current_time;
+  last_creg_check_time = current_time;
+  last_network_status_check_time = current_time;
+  last_modem_config_reiteration_time = current_time;
+  last_stack_check_time = current_time;
+  last_missed_call_time = current_time - MISSED_CALL_HOLDOFF_US - 1;
+
+// start on mains power, the supply sensing takes over from here
+  power_init(current_time);
+  energy_init(current_time);
+  digest_init();
+
+// initialise incoming modem message and action flags
+  for (i = 0; i < MAX_MSG; i++) {
+    received[i] = 0;
+    awaiting_response[i] = false;
+    initiate_time[i] = current_time;
+  }
+  received_sms = false;
+  direct_sms_expected = false;
+  direct_sms_first = 0;
+  direct_sms = 0;
+  modem_config_pending = false;
+  multi_stage_handling_type = 0;
+  multi_stage_caller[0] = 0;
+  unknown_message_count = 0;
+
+// install interrupt handler
+  rx_buffer_read_position = 0;
+  rx_buffer_entries = 0;
+  rx_buffer_write_position = 0;
+  rx_buffer_number_lf = 0;
+  hal_uart_set_rx_handler(uart_rx_interrupt_handler);
+  if (modem_sleep)
+    hal_gpio_set_falling_edge_handler(GPIO_PIN_MODEM_RI, modem_ring_interrupt_handler);
+
+// report the reason for the last reboot with the first status SMS, after the modem has responded with OK
+  if (reboot_reason != REBOOT_REASON_POWER_ON) {
+    write_command("AT\r");
+    multi_stage_handling_type = MULTI_STAGE_SEND_REBOOT_REPORT;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+  }
+
+// enable watchdog with timeout of 8 seconds
+  hal_watchdog_enable((uint32_t)8000);
+}
+
+// one traversal of the main loop
+void dialler_loop(void) {
+  format_t format;
+  char field[12];
+  char number[CONFIG_TEL_NO_SIZE + 2];
+  int i, l;
+  int type;
+  bool status;
+
+// store one time for one loop traversal
+  current_time = hal_time_us();
+  hal_watchdog_update();
+  reboot_record.uptime_s = (uint32_t)(current_time / 1000000);
+
+// anything due now (modem messages to parse, flags, SMS to encode) is a burst of work for the fast clock, the polling in
+// between runs at the slow clock
+  if (dialler_next_deadline_us() <= current_time)
+    power_cpu_burst();
+
+// if the ring buffer has a message (a LF has arrived), then read one message
+  reboot_record.loop_section = LOOP_SECTION_READ_MESSAGE;
+  l = read_line(str);
+// the text of an SMS delivered directly is the line after its +CMT, whatever it looks like (even if empty)
+  if ((l >= 0) && direct_sms_expected) {
+    direct_sms_expected = false;
+    if (direct_sms < DIRECT_SMS_QUEUE_LENGTH)
+      strcpy(direct_sms_text[(direct_sms_first + direct_sms++) % DIRECT_SMS_QUEUE_LENGTH], str);
+#ifdef DEBUG
+    else
+      printf("Direct SMS queue full, SMS lost: %s\n", str);
+#endif
+  }
+// if there is a nonempty message, determine the type and set the action flag
+  else if (l > 0) {
+// start-up messages of a modem that has restarted by itself once SMS are available, its configuration is lost, so
+// reiterate it now (any of them will do, in case another one is garbled)
+    if (modem_ready_message(str)) {
+      type = MSG_IGNORE;
+      last_modem_config_reiteration_time = current_time - housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US) - 1;
+    }
+    else
+      type = classify_message(str);
+    if (type == OK) {
+      received[OK] = true;
+    }
+    else if (type == ERROR) {
+      received[ERROR] = true;
+#ifdef DEBUG
+      printf("Received ERROR\n");
+#endif
+    }
+    else if (type == CMT) {
+      direct_sms_expected = true;
+#ifdef DEBUG
+      printf("Received CMT: %s\n", str);
+#endif
+    }
+    else if (type < MAX_MSG) {
+      received[type] = true;
+      strcpy(received_response[type], str);
+    }
+// at this point we only have non-command related data from the modem, such as incoming SMS text
+    else if (type == MSG_TEXT) {
+      if (awaiting_response[CMGR]) {
+        received_sms = true;
+        strcpy(received_sms_text, str);
+      }
+#ifdef DEBUG
+      if (!awaiting_response[CMGR]) printf("Received unprocessed non-command string: %s\n", str);
+#endif
+    }
+  }
+
+// if there is pending action, we want to block new actions (e.g., defer the regular checks)
+// for that, we collect any specific awaiting_response entries into the UNKNOWN entry, which will be used for blocking new action
+  awaiting_response[UNKNOWN] = false;
+  for (i = 0; i < MAX_MSG-1; i++)
+    awaiting_response[UNKNOWN] = awaiting_response[UNKNOWN] || awaiting_response[i];
+
+// regular modem modem status check, including reset if necessary
+  reboot_record.loop_section = LOOP_SECTION_STATUS;
+  if (((int64_t)(current_time - last_network_status_check_time) > (int64_t)housekeeping_interval_us(NETWORK_STATUS_CHECK_INTERVAL_US)) && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Initiating regular modem status check\n");
+#endif
+    energy_set_feature(ENERGY_FEATURE_KEEP_ALIVE, current_time);
+    write_command(MODEM_STATUS_COMMAND);
+    initiate_time[STATUS] = current_time;
+    awaiting_response[STATUS] = true;
+    awaiting_response[UNKNOWN] = true;
+    last_network_status_check_time = current_time;
+  }
+  if (received[STATUS] && awaiting_response[STATUS]) {
+#ifdef DEBUG
+    printf("Received network status: %s\n", received_response[STATUS]);
+#endif
+    received[STATUS] = false;
+    awaiting_response[STATUS] = false;
+    if (modem_status_online(received_response[STATUS])) {
+// if the modem is online, send a status message via SMS
+      format_init(&format, multi_stage_message[MULTI_STAGE_SEND_STATUS_MSG], max_str_l);
+      format_str(&format, "Modem check: ");
+      format_str(&format, message_parameters(received_response[STATUS]));
+      multi_stage_handling_type = MULTI_STAGE_SEND_STATUS_MSG;
+      initiate_time[OK] = current_time;
+      awaiting_response[OK] = true;
+      awaiting_response[UNKNOWN] = true;
+    }
+    else {
+// if the modem is not online, reboot (modem is reset upon boot)
+#ifdef DEBUG
+      printf("Rebooting...\n");
+      hal_sleep_ms(1000);
+#endif
+      reboot_device(REBOOT_REASON_MODEM_OFFLINE);
+    }
+  }
+  else if (received[STATUS]) {
+    received[STATUS] = false;
+#ifdef DEBUG
+    printf("Received unexpected network status\n");
+#endif
+  }
+
+// regular network registration check, don't action response
+  reboot_record.loop_section = LOOP_SECTION_CREG;
+  if (((int64_t)(current_time - last_creg_check_time) > (int64_t)housekeeping_interval_us(CREG_CHECK_INTERVAL_US)) && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Initiating regular CREG\n");
+#endif
+    energy_set_feature(ENERGY_FEATURE_SIGNAL, current_time);
+    write_command("AT+CREG?\r");
+    initiate_time[CREG] = current_time;
+    awaiting_response[CREG] = true;
+    awaiting_response[UNKNOWN] = true;
+    last_creg_check_time = current_time;
+  }
+  if (received[CREG] && awaiting_response[CREG]) {
+#ifdef DEBUG
+    printf("Received CREG: %s\n", received_response[CREG]);
+#endif
+    received[CREG] = false;
+    awaiting_response[CREG] = false;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+  else if (received[CREG]) {
+    received[CREG] = false;
+#ifdef DEBUG
+    printf("Received unexpected CREG\n");
+#endif
+  }
+
+// process CMTI (modem signalling incoming SMS)
+  reboot_record.loop_section = LOOP_SECTION_CMTI;
+  if (received[CMTI] && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Received CMTI: %s\n", received_response[CMTI]);
+#endif
+    received[CMTI] = false;
+    energy_set_feature(ENERGY_FEATURE_COMMAND, current_time);
+// we want to process the SMS, so need to read it out from the modem first, using the index of +CMTI: "SM",3
+    l = message_field(received_response[CMTI], 1, field, sizeof(field));
+    if ((l > 0) && (l < (int)sizeof(field))) {
+      format_init(&format, str, max_str_l);
+      format_str(&format, "AT+CMGR=");
+      format_str(&format, field);
+      format_char(&format, CR);
+      write_command(str);
+      initiate_time[CMGR] = current_time;
+      awaiting_response[CMGR] = true;
+      awaiting_response[UNKNOWN] = true;
+    }
+#ifdef DEBUG
+    else
+      printf("Received CMTI without valid index\n");
+#endif
+  }
+
+// process the call report (modem signalling incoming voice call, +CLCC or +CLIP depending on the modem)
+  reboot_record.loop_section = LOOP_SECTION_CALL;
+  if (received[CALL] && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Received call: %s\n", received_response[CALL]);
+#endif
+    received[CALL] = false;
+    energy_set_feature(ENERGY_FEATURE_COMMAND, current_time);
+// a missed call from an allowed caller triggers its SMS command, the response goes to the caller once the modem has
+// hung up, so it is handed over to the OK processing (unless another action is already waiting for it)
+    l = message_field(received_response[CALL], MODEM_CALL_NUMBER_FIELD, number, sizeof(number));
+    if ((l > 0) && (l < (int)sizeof(number)) && !multi_stage_handling_type &&
+        ((int64_t)(current_time - last_missed_call_time) > (int64_t)MISSED_CALL_HOLDOFF_US)) {
+      i = handle_missed_call(number, &config, str, multi_stage_caller);
+      if (i) {
+        multi_stage_handling_type = i;
+        strcpy(multi_stage_message[i], str);
+        last_missed_call_time = current_time;
+      }
+    }
+// hang up call
+#ifdef DEBUG
+    printf("Hanging up\n");
+#endif
+    write_command("AT+CHUP\r");
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+
+// process CGEV (modem is signalling network events even though it shouldn't)
+  reboot_record.loop_section = LOOP_SECTION_CGEV;
+  if (received[CGEV] && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Received CGEV: %s\n", received_response[CGEV]);
+#endif
+    received[CGEV] = false;
+    energy_set_feature(ENERGY_FEATURE_KEEP_ALIVE, current_time);
+// reset modem configuration
+#ifdef DEBUG
+    printf("Resetting modem configuration\n");
+#endif
+    write_command(modem_config_command());
+    modem_config_pending = true;
+    received[ERROR] = false;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+
+// process CTZV (the network has sent its time, which the modem has taken over into its clock), read out the clock
+  reboot_record.loop_section = LOOP_SECTION_CLOCK;
+  if (received[CTZV] && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Received CTZV: %s\n", received_response[CTZV]);
+#endif
+    received[CTZV] = false;
+    energy_set_feature(ENERGY_FEATURE_KEEP_ALIVE, current_time);
+    message_field(received_response[CTZV], 0, field, sizeof(field));
+    wallclock_set_zone(field);
+    write_command("AT+CCLK?\r");
+    initiate_time[CCLK] = current_time;
+    awaiting_response[CCLK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+
+// process CCLK (modem clock, read out after CTZV and with each configuration command, which awaits the OK), set the
+// wall clock from it
+  if (received[CCLK]) {
+#ifdef DEBUG
+    printf("Received CCLK: %s\n", received_response[CCLK]);
+#endif
+    received[CCLK] = false;
+    wallclock_sync(received_response[CCLK], awaiting_response[CCLK] ? initiate_time[CCLK] : initiate_time[OK],
+                   current_time);
+    if (awaiting_response[CCLK]) {
+      awaiting_response[CCLK] = false;
+      initiate_time[OK] = current_time;
+      awaiting_response[OK] = true;
+      awaiting_response[UNKNOWN] = true;
+    }
+  }
+
+// process CMGR (SMS read-out from modem)
+  reboot_record.loop_section = LOOP_SECTION_CMGR;
+  if (received[CMGR] && awaiting_response[CMGR] && received_sms) {
+#ifdef DEBUG
+    printf("Received CMGR: %s\n", received_response[CMGR]);
+#endif
+    received[CMGR] = false;
+    awaiting_response[CMGR] = false;
+    received_sms = false;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+
+// now figure out what the SMS is instructing us to do, if any
+// the response is sent once the OK from the modem has arrived, so it is handed over to the OK processing
+    i = handle_sms_command(received_sms_text, &config, str, &store_new_flash_settings);
+    if (i) {
+      multi_stage_handling_type = i;
+      strcpy(multi_stage_message[i], str);
+    }
+  } else if (received[CMGR] && !awaiting_response[CMGR]) {
+    received[CMGR] = false;
+    received_sms = false;
+#ifdef DEBUG
+    printf("Received unexpected CMGR\n");
+#endif
+  } else if (!awaiting_response[CMGR] && received_sms) {
+    received_sms = false;
+#ifdef DEBUG
+    printf("Received unexpected SMS\n");
+#endif
+  }
+
+// process CSQ (readout of signal level from modem)
+  reboot_record.loop_section = LOOP_SECTION_CSQ;
+  if (received[CSQ] && awaiting_response[CSQ]) {
+#ifdef DEBUG
+    printf("Received CSQ: %s\n", received_response[CSQ]);
+#endif
+    received[CSQ] = false;
+    awaiting_response[CSQ] = false;
+// the signal quality is the first parameter of +CSQ: 20,99
+    message_field(received_response[CSQ], 0, field, sizeof(field));
+    format_init(&format, multi_stage_message[MULTI_STAGE_SEND_SIGNAL_LEVEL], max_str_l);
+    format_str(&format, "Signal quality is ");
+    format_str(&format, field);
+// we need to wait for the OK from the modem first before we can respond to the request, so signal to the OK processing
+    multi_stage_handling_type = MULTI_STAGE_SEND_SIGNAL_LEVEL;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+  else if (received[CSQ]) {
+    received[CSQ] = false;
+#ifdef DEBUG
+    printf("Received unexpected CSQ\n");
+#endif
+  }
+
+// regular modem configuration reiteration
+  reboot_record.loop_section = LOOP_SECTION_MODEM_CONFIG;
+  if (((int64_t)(current_time - last_modem_config_reiteration_time) > (int64_t)housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US)) && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Initiate regular modem config reiteration\n");
+#endif
+    energy_set_feature(ENERGY_FEATURE_KEEP_ALIVE, current_time);
+    write_command(modem_config_command());
+    modem_config_pending = true;
+    received[ERROR] = false;
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+    last_modem_config_reiteration_time = current_time;
+    unknown_message_count = 0;
+  }
+
+// process CMGS (modem response to sending SMS)
+  reboot_record.loop_section = LOOP_SECTION_CMGS;
+  if (received[CMGS] && awaiting_response[CMGS]) {
+#ifdef DEBUG
+    printf("Received CMGS: %s\n", received_response[CMGS]);
+#endif
+    received[CMGS] = false;
+    awaiting_response[CMGS] = false;
+    digest_sent(current_time);
+    initiate_time[OK] = current_time;
+    awaiting_response[OK] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+  else if (received[CMGS]) {
+    received[CMGS] = false;
+#ifdef DEBUG
+    printf("Received unexpected CMGS\n");
+#endif
+  }
+
+// process OK (modem response to pretty much any instruction)
+// we need to handle the multi-stage actions here too, as signalled
+  reboot_record.loop_section = LOOP_SECTION_OK;
+  if (received[OK] && awaiting_response[OK]) {
+#ifdef DEBUG
+    printf("Received OK\n");
+#endif
+    received[OK] = false;
+    awaiting_response[OK] = false;
+    modem_config_pending = false;
+    if (multi_stage_handling_type)
+      start_multi_stage_action(multi_stage_handling_type);
+  }
+  else if (received[OK]) {
+    received[OK] = false;
+#ifdef DEBUG
+    printf("Received unexpected OK\n");
+#endif
+  }
+// a configuration command answered with ERROR (e.g. by a modem that has only just restarted) is sent again shortly,
+// rather than at the next regular reiteration
+  else if (received[ERROR] && awaiting_response[OK] && modem_config_pending) {
+    received[ERROR] = false;
+    awaiting_response[OK] = false;
+    modem_config_pending = false;
+    last_modem_config_reiteration_time = current_time - housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US) +
+                                         MODEM_CONFIG_RETRY_US;
+  }
+
+// process unknown modem message
+  reboot_record.loop_section = LOOP_SECTION_UNKNOWN;
+  if (received[UNKNOWN] && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Received unknown modem message: %s\n", received_response[UNKNOWN]);
+#endif
+    received[UNKNOWN] = false;
+// avoid sending SMS flood in case of unknown message flood
+    if (unknown_message_count++ < 5) {
+// receiving such an SMS will be confusing for the general user, uncomment following five lines only if you can interpret such an SMS
+//      sprintf(str, "Unknown modem message: %s", received_response[UNKNOWN]);
+//      send_sms(config.tel_no, str);
+//      initiate_time[CMGS] = current_time;
+//      awaiting_response[CMGS] = true;
+//      awaiting_response[UNKNOWN] = true;
+    }
+  }
+
+// check for timeouts
+  reboot_record.loop_section = LOOP_SECTION_TIMEOUTS;
+  for (i = 0; i < MAX_MSG-1; i++) {
+    if (((int64_t)(current_time - initiate_time[i]) > ((i == OK) ? (int64_t)60000000 : (int64_t)9000000)) && \
+        awaiting_response[i]) {
+#ifdef DEBUG
+      printf("Timeout %s\n", command_code_map[i]);
+#endif
+      awaiting_response[i] = false;
+// a multi-stage action waiting for the response is dropped, rather than left to fire on some later, unrelated OK
+      if ((i == CMGR) || (i == OK)) multi_stage_handling_type = 0;
+      if ((i == CMGR) || (i == OK) || (i == CSQ)) multi_stage_caller[0] = 0;
+// an SMS without confirmation may have been the digest, which is then kept for another attempt
+      if (i == CMGS) digest_failed(current_time);
+    }
+  }
+
+// check GPIO pins, action with SMS if change detected
+  reboot_record.loop_section = LOOP_SECTION_GPIO;
+  if (((int64_t)(current_time - last_status_check_time) > 1000000) && !awaiting_response[UNKNOWN]) {
+    last_status_check_time = current_time;
+    power_sense();
+    for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+      status = !hal_gpio_get(GPIO_PIN_FIRST + i);
+      if (status != last_status[i]) {
+#ifdef DEBUG
+        printf("%s\n", status ? config.sms_on_fall[i] : config.sms_on_rise[i]);
+#endif
+        last_status[i] = !last_status[i];
+// input changes with digest delivery wait for the digest, unless it is full
+        if (config.send_sms_on_change[i] && !(config.digest[i] && digest_add(i, status, current_time))) {
+          energy_set_feature(ENERGY_FEATURE_ALARM, current_time);
+          format_init(&format, str, max_str_l);
+          format_str(&format, status ? config.sms_on_fall[i] : config.sms_on_rise[i]);
+          format_event_time(&format);
+          send_sms(config.tel_no, str);
+          initiate_time[CMGS] = current_time;
+          awaiting_response[CMGS] = true;
+          awaiting_response[UNKNOWN] = true;
+        }
+      }
+    }
+  }
+
+// process an SMS delivered directly (+CMT), there is nothing to read out, so its action starts straight away (but after
+// the input changes, which come first)
+  reboot_record.loop_section = LOOP_SECTION_CMT;
+  if (direct_sms && !awaiting_response[UNKNOWN] && !multi_stage_handling_type) {
+    i = direct_sms_first;
+    direct_sms_first = (direct_sms_first + 1) % DIRECT_SMS_QUEUE_LENGTH;
+    direct_sms--;
+    energy_set_feature(ENERGY_FEATURE_COMMAND, current_time);
+    i = handle_sms_command(direct_sms_text[i], &config, str, &store_new_flash_settings);
+    if (i) {
+      strcpy(multi_stage_message[i], str);
+      start_multi_stage_action(i);
+    }
+  }
+
+// send the digest of input changes once it is due
+  reboot_record.loop_section = LOOP_SECTION_DIGEST;
+  if ((digest_deadline_us() <= current_time) && !awaiting_response[UNKNOWN] && !multi_stage_handling_type) {
+    energy_set_feature(ENERGY_FEATURE_ALARM, current_time);
+    format_init(&format, str, max_str_l);
+    digest_format(&format, &config);
+#ifdef DEBUG
+    printf("Sending digest: %s\n", str);
+#endif
+    send_sms(config.tel_no, str);
+    initiate_time[CMGS] = current_time;
+    awaiting_response[CMGS] = true;
+    awaiting_response[UNKNOWN] = true;
+  }
+
+// check GPIO pin for password reset
+  reboot_record.loop_section = LOOP_SECTION_PW_RESET;
+  if (((int64_t)(current_time - last_passw_reset_check_time) > 1000000) && \
+      ((int64_t)(current_time - last_passw_reset_time) > 10000000) && !awaiting_response[UNKNOWN]) {
+    last_passw_reset_check_time = current_time;
+    if (!hal_gpio_get(GPIO_PIN_PW_RESET)) {
+      last_passw_reset_time = current_time;
+#ifdef DEBUG
+      printf("Password reset triggered by GPIO %i\n", GPIO_PIN_PW_RESET);
+#endif
+      strcpy(config.passw, default_passw);
+      store_new_flash_settings = true;
+      energy_set_feature(ENERGY_FEATURE_ALARM, current_time);
+      format_init(&format, str, max_str_l);
+      format_str(&format, "Password reset to default");
+      format_event_time(&format);
+      send_sms(config.tel_no, str);
+      initiate_time[CMGS] = current_time;
+      awaiting_response[CMGS] = true;
+      awaiting_response[UNKNOWN] = true;
+    }
+  }
+
+// switch between mains and battery mode once nothing else is in progress, report the change by SMS and reiterate the
+// modem configuration for the new mode straight after
+  reboot_record.loop_section = LOOP_SECTION_POWER;
+  if ((power_wanted_mode() != power_mode) && !awaiting_response[UNKNOWN] && !multi_stage_handling_type) {
+    power_set_mode(power_wanted_mode(), current_time);
+    energy_set_feature(ENERGY_FEATURE_ALARM, current_time);
+#ifdef DEBUG
+    printf("Switching to %s mode\n", power_mode == POWER_BATTERY ? "battery" : "mains");
+#endif
+    if (power_mode == POWER_BATTERY)
+      hal_gpio_put(LED_PIN, false);
+    format_init(&format, str, max_str_l);
+    format_str(&format, power_mode == POWER_BATTERY ? "Switched to battery" : "Switched to mains");
+    format_event_time(&format);
+    format_str(&format, ". ");
+    power_report(&format, current_time);
+    send_sms(config.tel_no, str);
+    initiate_time[CMGS] = current_time;
+    awaiting_response[CMGS] = true;
+    awaiting_response[UNKNOWN] = true;
+    last_modem_config_reiteration_time = current_time - housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US) - 1;
+  }
+
+// regular stack high-water-mark check
+  if ((int64_t)(current_time - last_stack_check_time) > (int64_t)housekeeping_interval_us(STACK_CHECK_INTERVAL_US)) {
+    last_stack_check_time = current_time;
+    check_stack_high_water();
+#ifdef DEBUG
+    printf("Stack high-water mark: %lu of %lu bytes\n", (unsigned long)stack_high_water_bytes, (unsigned long)stack_size_bytes);
+    printf("MCU residency: fast %lu s, slow %lu s, sleep %lu s\n",
+           (unsigned long)(power_cpu_residency(POWER_CPU_FAST, current_time) / 1000000),
+           (unsigned long)(power_cpu_residency(POWER_CPU_SLOW, current_time) / 1000000),
+           (unsigned long)(power_cpu_residency(POWER_CPU_SLEEP, current_time) / 1000000));
+#endif
+  }
+
+// let the modem sleep while nothing is in progress, the next command or RI wakes it again
+  if (modem_sleep && dialler_idle())
+    modem_allow_sleep();
+
+// the state of the modem until the next traversal for the energy accounting, the feature in progress ends once the
+// loop is idle
+  energy_set_modem(modem_energy_state(), hal_time_us());
+  if (dialler_idle())
+    energy_set_feature(ENERGY_FEATURE_BASE, hal_time_us());
+
+// loop slowdown, then sleep at the slow clock until the next deadline unless modem data or RI comes first
+  reboot_record.loop_section = LOOP_SECTION_SLEEP;
+  power_cpu_idle(10, dialler_next_deadline_us());
+
+// LED blinking to signal all is working, off in battery mode
+  if ((power_mode == POWER_MAINS) && ((int64_t)(current_time - last_led_switch_time) > 1000000)) {
+    last_led_switch_time = current_time;
+    hal_gpio_put(LED_PIN, led_onoff);
+    led_onoff = !led_onoff;
+  }
+
+// save new flash settings if necessary
+  reboot_record.loop_section = LOOP_SECTION_FLASH;
+  if (store_new_flash_settings && !awaiting_response[UNKNOWN]) {
+#ifdef DEBUG
+    printf("Saving new flash settings\n");
+#endif
+    power_cpu_burst();
+    config_store(&config);
+    store_new_flash_settings = false;
+#ifdef DEBUG
+    printf("Saved new flash settings\n");
+#endif
+  }
+}
+
+// earliest time since boot (in microseconds) at which the main loop has work to do, other than on arrival of modem data
+// the main loop sleeps through to it instead of traversing every 10 ms
+uint64_t dialler_next_deadline_us(void) {
+  uint64_t deadline;
+  int i;
+
+// pending messages, flags and power mode changes are handled in the next traversal (ERROR, CPMS and CMGD are never
+// acted upon)
+  if ((rx_buffer_number_lf > 0) || received_sms || store_new_flash_settings || (power_wanted_mode() != power_mode) || \
+      (direct_sms && !awaiting_response[UNKNOWN] && !multi_stage_handling_type))
+    return current_time;
+  for (i = 0; i < MAX_MSG; i++)
+    if (received[i] && (i != ERROR) && (i != CPMS) && (i != CMGD))
+      return current_time;
+
+// the intervals above are compared with ">", so each action is due one microsecond after its interval
+  deadline = last_network_status_check_time + housekeeping_interval_us(NETWORK_STATUS_CHECK_INTERVAL_US) + 1;
+  if (last_creg_check_time + housekeeping_interval_us(CREG_CHECK_INTERVAL_US) + 1 < deadline)
+    deadline = last_creg_check_time + housekeeping_interval_us(CREG_CHECK_INTERVAL_US) + 1;
+  if (last_modem_config_reiteration_time + housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US) + 1 < deadline)
+    deadline = last_modem_config_reiteration_time + housekeeping_interval_us(MODEM_CONFIG_REITERATION_INTERVAL_US) + 1;
+  if (last_stack_check_time + housekeeping_interval_us(STACK_CHECK_INTERVAL_US) + 1 < deadline)
+    deadline = last_stack_check_time + housekeeping_interval_us(STACK_CHECK_INTERVAL_US) + 1;
+  if (last_status_check_time + 1000001 < deadline)
+    deadline = last_status_check_time + 1000001;
+  if (last_passw_reset_check_time + 1000001 < deadline)
+    deadline = last_passw_reset_check_time + 1000001;
+  if (digest_deadline_us() < deadline)
+    deadline = digest_deadline_us();
+  if ((power_mode == POWER_MAINS) && (last_led_switch_time + 1000001 < deadline))
+    deadline = last_led_switch_time + 1000001;
+  for (i = 0; i < MAX_MSG-1; i++)
+    if (awaiting_response[i] && (initiate_time[i] + ((i == OK) ? 60000001 : 9000001) < deadline))
+      deadline = initiate_time[i] + ((i == OK) ? 60000001 : 9000001);
+
+  return deadline;
+}
+
+// whether the main loop is in its clean idle state: no response awaited, no message, flag or multi-stage action pending
+// the host simulation measures the recovery from modem faults up to this state
+bool dialler_idle(void) {
+  int i;
+
+  if ((rx_buffer_number_lf > 0) || received_sms || direct_sms || store_new_flash_settings || multi_stage_handling_type || \
+      (power_wanted_mode() != power_mode))
+    return false;
+  for (i = 0; i < MAX_MSG-1; i++)
+    if (awaiting_response[i])
+      return false;
+
+  return true;
+}
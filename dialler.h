@@ -0,0 +1,53 @@
+#ifndef DIALLER_H
+#define DIALLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarmdial_tables.h"
+
+// GPIO pin for configuration reset
+#define GPIO_PIN_PW_RESET 5
+
+// GPIO pin of the Pico's LED
+#define LED_PIN 25
+
+// time intervals for regular actions
+
+// network status check of the modem (MODEM_STATUS_COMMAND of the modem profile)
+// 2419200 sec is four weeks
+#define NETWORK_STATUS_CHECK_INTERVAL_US 2419200000000
+//#define NETWORK_STATUS_CHECK_INTERVAL_US 120000000
+
+// CREG network registration check
+// 28800 sec is eight hours
+#define CREG_CHECK_INTERVAL_US 28800000000
+//#define CREG_CHECK_INTERVAL_US 30000000
+
+// modem config reiteration
+// 86400 sec is 24 hours
+#define MODEM_CONFIG_REITERATION_INTERVAL_US 86400000000
+//#define MODEM_CONFIG_REITERATION_INTERVAL_US 45000000
+
+// retry of a modem configuration command answered with ERROR
+#define MODEM_CONFIG_RETRY_US 60000000
+
+// stack high-water-mark check
+#define STACK_CHECK_INTERVAL_US 10000000
+
+// SMS delivered directly (+CMT) wait in a queue of this length until the previous command has been replied to, the modem
+// does not keep them, so an SMS that finds the queue full is lost (a reply takes about a second, the queue covers a
+// burst of an SMS every half second for half a minute)
+#define DIRECT_SMS_QUEUE_LENGTH 16
+
+// a missed call triggers its SMS command at most once in this time, which covers the further reports of the same call
+// (+CLCC when it ends, +CLIP with each RING) and keeps repeated calls from running up SMS charges
+#define MISSED_CALL_HOLDOFF_US 60000000
+
+// the multi-stage actions MULTI_STAGE_* are generated into alarmdial_tables.h
+
+void dialler_setup(void);
+void dialler_loop(void);
+uint64_t dialler_next_deadline_us(void);
+bool dialler_idle(void);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include "digest.h"
+#include "wallclock.h"
+
+// an input change waiting for the digest: the input, its new state (true is active, low) and the time as taken with
+// wallclock_ms (0 without the wall clock)
+typedef struct {
+  uint8_t input;
+  bool status;
+  uint64_t time_ms;
+} digest_event_t;
+
+// the input changes collected, the number of them in the SMS awaiting confirmation (0 if none), whether changes that
+// were due did not fit into that SMS (they are due again once it has gone through), and when the digest is due
+static digest_event_t events[DIGEST_MAX_EVENTS];
+static int number_events;
+static int sent_events;
+static bool left_over;
+static uint64_t due_us;
+
+void digest_init(void) {
+  number_events = 0;
+  sent_events = 0;
+  left_over = false;
+}
+
+// the next digest is due at the next DIGEST_HOUR, or DIGEST_MAX_AGE_US from now without the wall clock
+static void schedule(uint64_t now_us) {
+  due_us = wallclock_next_hour_us(DIGEST_HOUR, now_us);
+  if (!due_us)
+    due_us = now_us + DIGEST_MAX_AGE_US;
+}
+
+// adds an input change, the first one of a digest sets when it is due
+// returns false if the digest is full (its SMS has not gone through yet), the change then needs an SMS of its own
+bool digest_add(int input, bool status, uint64_t now_us) {
+  if (number_events == DIGEST_MAX_EVENTS)
+    return false;
+  if (!number_events)
+    schedule(now_us);
+  events[number_events].input = (uint8_t)input;
+  events[number_events].status = status;
+  events[number_events].time_ms = wallclock_ms(now_us);
+  number_events++;
+#ifdef DEBUG
+  printf("Input change %d of %d for the digest\n", number_events, DIGEST_MAX_EVENTS);
+#endif
+  if ((number_events == DIGEST_MAX_EVENTS) && !sent_events)
+    due_us = now_us;
+
+  return true;
+}
+
+// time since boot at which the digest is to be sent, UINT64_MAX if it is empty or its SMS awaits confirmation
+uint64_t digest_deadline_us(void) {
+  return (number_events && !sent_events) ? due_us : UINT64_MAX;
+}
+
+// writes the first n input changes: the message of each input change, in the order of their first change, followed
+// by the times of all changes with that message, e.g. "Digest: Alarm system armed 07:58 19:02, Alarm system disarmed
+// 08:30", or by their number ("2x") if any of them happened before the wall clock was set
+static void format_events(format_t* format, const config_t* config, int number) {
+  bool done[DIGEST_MAX_EVENTS] = { false };
+  bool timed;
+  int i, j, n;
+
+  format_str(format, "Digest:");
+  for (i = 0; i < number; i++) {
+    if (done[i])
+      continue;
+    if (i)
+      format_char(format, ',');
+    format_char(format, ' ');
+    format_str(format, events[i].status ? config->sms_on_fall[events[i].input] : config->sms_on_rise[events[i].input]);
+    n = 0;
+    timed = true;
+    for (j = i; j < number; j++)
+      if ((events[j].input == events[i].input) && (events[j].status == events[i].status)) {
+        n++;
+        timed = timed && events[j].time_ms;
+      }
+    for (j = i; j < number; j++)
+      if ((events[j].input == events[i].input) && (events[j].status == events[i].status)) {
+        done[j] = true;
+        if (timed) {
+          format_char(format, ' ');
+          wallclock_format_time(format, events[j].time_ms);
+        }
+      }
+    if (!timed) {
+      format_char(format, ' ');
+      format_uint(format, n);
+      format_char(format, 'x');
+    }
+  }
+}
+
+// writes the digest for its SMS with as many of the input changes as fit into it (at least one, even if its message
+// does not fit), those left out go into the next digest
+void digest_format(format_t* format, const config_t* config) {
+  format_t attempt;
+  int n;
+
+  for (n = number_events; n > 1; n--) {
+    attempt = *format;
+    format_events(&attempt, config, n);
+    if (attempt.length + 1 < attempt.size)
+      break;
+  }
+  format_events(format, config, n);
+  sent_events = n;
+  left_over = n < number_events;
+#ifdef DEBUG
+  if (left_over)
+    printf("Digest holds %d of %d input changes, the rest follow\n", n, number_events);
+#endif
+}
+
+// the modem has confirmed an SMS, if it is the digest, the input changes in it are done with, and those added since
+// make up the next digest, which is due straight away if the changes did not all fit
+void digest_sent(uint64_t now_us) {
+  if (!sent_events)
+    return;
+  number_events -= sent_events;
+  memmove(events, &events[sent_events], number_events * sizeof(events[0]));
+  sent_events = 0;
+  if (left_over)
+    due_us = now_us;
+  else if (number_events)
+    schedule(now_us);
+}
+
+// an SMS has not been confirmed, if it is the digest, it is sent again later with whatever has been added since
+void digest_failed(uint64_t now_us) {
+  if (!sent_events)
+    return;
+  sent_events = 0;
+  due_us = now_us + DIGEST_RETRY_US;
+}
@@ -0,0 +1,26 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "format.h"
+
+// digest of the input changes of the inputs with digest delivery (config.digest), collected in RAM and sent as one SMS
+// at the next local hour DIGEST_HOUR, or once DIGEST_MAX_EVENTS have been collected (both in alarmdial_tables.h)
+// the input changes are kept until the modem has confirmed the SMS (+CMGS)
+
+// without the wall clock, the digest is sent this long after its first input change
+#define DIGEST_MAX_AGE_US 86400000000
+
+// a digest the modem has not confirmed is sent again after this time
+#define DIGEST_RETRY_US 3600000000
+
+void digest_init(void);
+bool digest_add(int input, bool status, uint64_t now_us);
+uint64_t digest_deadline_us(void);
+void digest_format(format_t* format, const config_t* config);
+void digest_sent(uint64_t now_us);
+void digest_failed(uint64_t now_us);
+
+#endif
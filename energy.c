@@ -0,0 +1,148 @@
+#include "energy.h"
+#include "power.h"
+
+// present state of the MCU and the modem, the feature in progress, and since when the charge has been accounted
+static int cpu_state;
+static int modem_state;
+static int feature;
+static uint64_t boot_us;
+static uint64_t last_account_us;
+
+// charge drawn per feature (in nAs) and time per modem state since boot
+static uint64_t charge_nas[ENERGY_FEATURES];
+static uint64_t modem_time_us[ENERGY_MODEM_STATES];
+
+static const uint32_t cpu_current_ua[POWER_CPU_STATES] = {
+  POWER_CURRENT_PICO_FAST_UA, POWER_CURRENT_PICO_SLOW_UA, POWER_CURRENT_PICO_SLEEP_UA
+};
+static const uint32_t modem_current_ua[ENERGY_MODEM_STATES] = {
+  POWER_CURRENT_MODEM_SLEEP_UA, POWER_CURRENT_MODEM_AWAKE_UA, POWER_CURRENT_MODEM_COMMAND_UA, POWER_CURRENT_MODEM_SMS_UA
+};
+
+// the Pico starts at the fast clock and the modem awake, boot and modem initialisation count as base load
+void energy_init(uint64_t now_us) {
+  int i;
+
+  cpu_state = POWER_CPU_FAST;
+  modem_state = ENERGY_MODEM_IDLE;
+  feature = ENERGY_FEATURE_BASE;
+  boot_us = now_us;
+  last_account_us = now_us;
+  for (i = 0; i < ENERGY_FEATURES; i++)
+    charge_nas[i] = 0;
+  for (i = 0; i < ENERGY_MODEM_STATES; i++)
+    modem_time_us[i] = 0;
+}
+
+// adds the charge since the last call to the feature in progress, at the currents of the present states
+// the modem sleeps at the current of the power saving settings in battery mode
+static void account(uint64_t now_us) {
+  uint64_t elapsed_us, current_ua;
+
+  if (now_us <= last_account_us)
+    return;
+  elapsed_us = now_us - last_account_us;
+  current_ua = cpu_current_ua[cpu_state];
+  if ((modem_state == ENERGY_MODEM_SLEEP) && (power_mode == POWER_BATTERY))
+    current_ua += POWER_CURRENT_MODEM_BATTERY_SLEEP_UA;
+  else
+    current_ua += modem_current_ua[modem_state];
+  charge_nas[feature] += elapsed_us * current_ua / 1000;
+  modem_time_us[modem_state] += elapsed_us;
+  last_account_us = now_us;
+}
+
+// the charge is only accounted when a state changes, or when it is read out
+void energy_set_cpu(int state, uint64_t now_us) {
+  if (state == cpu_state)
+    return;
+  account(now_us);
+  cpu_state = state;
+}
+
+void energy_set_modem(int state, uint64_t now_us) {
+  if (state == modem_state)
+    return;
+  account(now_us);
+  modem_state = state;
+}
+
+void energy_set_feature(int feature_in_progress, uint64_t now_us) {
+  if (feature_in_progress == feature)
+    return;
+  account(now_us);
+  feature = feature_in_progress;
+}
+
+// adds the charge of the transmission of an SMS, beyond the time the modem spends in ENERGY_MODEM_SMS
+void energy_sms(void) {
+  charge_nas[feature] += (uint64_t)POWER_SMS_CHARGE_UAS * 1000;
+}
+
+// charge drawn for a feature since boot, in nAs
+uint64_t energy_charge_nas(int feature_accounted, uint64_t now_us) {
+  account(now_us);
+
+  return charge_nas[feature_accounted];
+}
+
+// charge drawn for all features together since boot, in nAs
+uint64_t energy_total_nas(uint64_t now_us) {
+  uint64_t total = 0;
+  int i;
+
+  account(now_us);
+  for (i = 0; i < ENERGY_FEATURES; i++)
+    total += charge_nas[i];
+
+  return total;
+}
+
+uint64_t energy_modem_time_us(int state, uint64_t now_us) {
+  account(now_us);
+
+  return modem_time_us[state];
+}
+
+// value * mul / div without overflow for the charges and times of a long uptime
+static uint64_t scale(uint64_t value, uint64_t mul, uint64_t div) {
+  return value / div * mul + value % div * mul / div;
+}
+
+// writes the charge per day for each feature (nAs per us is mA, 24 mAh per day), then the share of time in each modem
+// and MCU state
+void energy_report(format_t* format, uint64_t now_us) {
+  static const char* const feature_name[ENERGY_FEATURES] = { "base", "keep-alive", "signal", "alarms", "commands" };
+  static const char* const modem_state_name[ENERGY_MODEM_STATES] = { "sleep", "idle", "cmd", "SMS" };
+  static const char* const cpu_state_name[POWER_CPU_STATES] = { "fast", "slow", "sleep" };
+  uint64_t uptime_us, hundredths;
+  int i;
+
+  account(now_us);
+  uptime_us = now_us > boot_us ? now_us - boot_us : 1;
+  format_str(format, "mAh/day:");
+  for (i = 0; i < ENERGY_FEATURES; i++) {
+    hundredths = scale(charge_nas[i], 2400, uptime_us);
+    format_str(format, i ? ", " : " ");
+    format_str(format, feature_name[i]);
+    format_char(format, ' ');
+    format_uint(format, (uint32_t)(hundredths / 100));
+    format_char(format, '.');
+    format_char(format, (char)('0' + hundredths / 10 % 10));
+    format_char(format, (char)('0' + hundredths % 10));
+  }
+  format_str(format, ". Modem %:");
+  for (i = 0; i < ENERGY_MODEM_STATES; i++) {
+    format_char(format, ' ');
+    format_str(format, modem_state_name[i]);
+    format_char(format, ' ');
+    format_uint(format, (uint32_t)scale(modem_time_us[i], 100, uptime_us));
+  }
+  format_str(format, ". MCU %:");
+  for (i = 0; i < POWER_CPU_STATES; i++) {
+    format_char(format, ' ');
+    format_str(format, cpu_state_name[i]);
+    format_char(format, ' ');
+    format_uint(format, (uint32_t)scale(power_cpu_residency(i, now_us), 100, uptime_us));
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarmdial_tables.h"
+#include "format.h"
+
+// software energy accounting: the time in each state of the modem and the MCU, multiplied by the currents of
+// alarmdial_tables.h, gives the charge drawn, which is attributed to the feature the logic is busy with
+
+// states of the modem as far as the logic can tell
+#define ENERGY_MODEM_SLEEP   0   // asleep with DTR high (sleep mode), in the power saving settings on battery
+#define ENERGY_MODEM_IDLE    1   // awake with nothing in progress
+#define ENERGY_MODEM_COMMAND 2   // a command sent, its response awaited
+#define ENERGY_MODEM_SMS     3   // an SMS submitted, +CMGS awaited
+#define ENERGY_MODEM_STATES  4
+
+// features the charge is attributed to, the base load is what is drawn while none of them is in progress
+#define ENERGY_FEATURE_BASE       0
+#define ENERGY_FEATURE_KEEP_ALIVE 1   // modem status check with its SMS, configuration reiteration
+#define ENERGY_FEATURE_SIGNAL     2   // sampling of the network registration
+#define ENERGY_FEATURE_ALARM      3   // SMS on input changes, password reset and power mode changes
+#define ENERGY_FEATURE_COMMAND    4   // incoming SMS commands with their replies, incoming calls
+#define ENERGY_FEATURES           5
+
+void energy_init(uint64_t now_us);
+void energy_set_cpu(int state, uint64_t now_us);
+void energy_set_modem(int state, uint64_t now_us);
+void energy_set_feature(int feature, uint64_t now_us);
+void energy_sms(void);
+uint64_t energy_charge_nas(int feature, uint64_t now_us);
+uint64_t energy_total_nas(uint64_t now_us);
+uint64_t energy_modem_time_us(int state, uint64_t now_us);
+void energy_report(format_t* format, uint64_t now_us);
+
+#endif
@@ -0,0 +1,51 @@
+#include "format.h"
+
+// starts an empty text in str, which has room for size characters including the terminating 0
+void format_init(format_t* format, char* str, size_t size) {
+  format->str = str;
+  format->size = size;
+  format->length = 0;
+  if (size)
+    str[0] = 0;
+}
+
+void format_char(format_t* format, char chr) {
+  if (format->length + 1 < format->size) {
+    format->str[format->length++] = chr;
+    format->str[format->length] = 0;
+  }
+}
+
+void format_str(format_t* format, const char* s) {
+  while (*s && (format->length + 1 < format->size))
+    format->str[format->length++] = *s++;
+  if (format->size)
+    format->str[format->length] = 0;
+}
+
+// appends at most n characters of s
+void format_str_n(format_t* format, const char* s, size_t n) {
+  while (n-- && *s && (format->length + 1 < format->size))
+    format->str[format->length++] = *s++;
+  if (format->size)
+    format->str[format->length] = 0;
+}
+
+// appends the decimal digits of value
+void format_uint(format_t* format, uint32_t value) {
+  char digits[10];
+  int l = 0;
+
+  do {
+    digits[l++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (l)
+    format_char(format, digits[--l]);
+}
+
+// appends value as the given number of hexadecimal digits (lower case, at most 8), leading ones are 0
+void format_hex(format_t* format, uint32_t value, int digits) {
+  while (digits--)
+    format_char(format, "0123456789abcdef"[(value >> (4 * digits)) & 0xf]);
+}
@@ -0,0 +1,23 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// small formatter for the commands and messages, instead of sprintf
+// the text is built by appending pieces to a buffer of fixed size, whatever does not fit is dropped, and the buffer
+// always holds a terminated string
+typedef struct {
+  char* str;
+  size_t size;
+  size_t length;
+} format_t;
+
+void format_init(format_t* format, char* str, size_t size);
+void format_char(format_t* format, char chr);
+void format_str(format_t* format, const char* s);
+void format_str_n(format_t* format, const char* s, size_t n);
+void format_uint(format_t* format, uint32_t value);
+void format_hex(format_t* format, uint32_t value, int digits);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// thin hardware abstraction between the AlarmDial logic and the platform
+// hal_pico.c implements it with the Pico SDK, host/hal_host.c on Linux for the host build
+
+// initialises the platform (stdio and anything else needed before the logic starts)
+void hal_init(void);
+
+// time since boot in microseconds, and blocking sleep
+uint64_t hal_time_us(void);
+void hal_sleep_ms(uint32_t ms);
+// sleep of the main loop: at least min_ms, then on up to until_us (time since boot) unless an interrupt (UART receive,
+// ring indicator) has been handled since the last call returned, the core waits for events in between
+void hal_idle(uint32_t min_ms, uint64_t until_us);
+
+// system clock, fast for bursts of work and slow while the logic only polls or sleeps
+// the UART and the timer keep their clocks, so neither the baud rate nor the time base changes with it
+void hal_clock_fast(bool fast);
+
+// UART connected to the modem
+void hal_uart_init(uint32_t baud_rate);
+void hal_uart_putc(char chr);
+bool hal_uart_is_readable(void);
+bool hal_uart_is_readable_within_us(uint32_t wait_us);
+char hal_uart_getc(void);
+// installs a handler that is called when characters arrive, the handler reads them with hal_uart_getc
+void hal_uart_set_rx_handler(void (*handler)(void));
+
+// GPIO pins
+void hal_gpio_init_input_pullup(unsigned int pin);
+void hal_gpio_init_output(unsigned int pin);
+bool hal_gpio_get(unsigned int pin);
+void hal_gpio_put(unsigned int pin, bool value);
+// installs a handler that is called on a falling edge of an input pin (one pin only, the ring indicator of the modem)
+void hal_gpio_set_falling_edge_handler(unsigned int pin, void (*handler)(void));
+
+// persistent storage area for the configuration
+void hal_flash_read(uint8_t* data, size_t length);
+void hal_flash_write(const uint8_t* data, size_t length);
+
+// watchdog and reboot
+void hal_watchdog_enable(uint32_t timeout_ms);
+void hal_watchdog_update(void);
+bool hal_watchdog_caused_reboot(void);
+void hal_reboot(void);
+
+// stack high-water-mark measurement
+// hal_stack_paint is called first thing at boot, hal_stack_check returns the peak stack use in bytes so far
+void hal_stack_paint(void);
+uint32_t hal_stack_check(uint32_t* stack_size);
+
+#endif
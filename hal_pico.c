@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/bootrom.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pll.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/uart.h"
+#include "hardware/watchdog.h"
+#include "diagnostics.h"
+#include "hal.h"
+
+// implementation of the hardware abstraction with the Pico SDK
+
+// UART parameters for communication with the modem
+// The modem needs to have been set to these values permanently as well (not handled by this program)
+#define UART_ID uart0
+#define DATA_BITS 8
+#define STOP_BITS 1
+#define PARITY UART_PARITY_NONE
+
+#define UART_TX_PIN 0
+#define UART_RX_PIN 1
+
+// system clock for bursts of work (the SDK default from the system PLL, VCO 1500 MHz divided by 6 and 2) and while idle
+// (from the USB PLL, which runs anyway for the USB stdio), the system PLL stays locked while the clock is slow and is
+// only stopped for a sleep of at least PLL_SYS_STOP_US, so that the polling while a response is awaited (every 10 ms)
+// only switches the clock source rather than locking the PLL again each time
+// the XIP flash runs at half the system clock either way, and the UART interrupt handler has 4000 cycles per character
+// at the slow clock
+#define CLOCK_FAST_KHZ 125000
+#define CLOCK_SLOW_KHZ 48000
+#define PLL_SYS_VCO_HZ (1500 * MHZ)
+#define PLL_SYS_STOP_US 100000
+
+// flash storage area for configuration
+#define FLASH_TARGET_OFFSET (512 * 1024)
+
+// stack high-water-mark measurement
+// the core 0 stack grows down from the end of SCRATCH_Y, through SCRATCH_X (core 1 is not used) to __StackLimit (end of
+// the heap), so the unused part of that region is painted with a pattern at boot and checked regularly for how far it
+// has been overwritten
+#define STACK_PAINT_PATTERN 0x5354434b
+extern uint32_t __StackLimit, __StackTop;
+
+// post-mortem record, in RAM that is not initialised at boot
+reboot_record_t __uninitialized_ram(reboot_record);
+
+static void (*uart_rx_handler)(void) = NULL;
+static void (*gpio_falling_edge_handler)(void) = NULL;
+static volatile bool interrupt_handled = false;
+static bool clock_fast = true;
+static bool pll_sys_running = true;
+
+void hal_init(void) {
+  stdio_init_all();
+// the peripherals (UART) run from the USB PLL rather than the system clock, which changes with hal_clock_fast
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, CLOCK_SLOW_KHZ * KHZ, CLOCK_SLOW_KHZ * KHZ);
+}
+
+uint64_t hal_time_us(void) {
+  return to_us_since_boot(get_absolute_time());
+}
+
+void hal_sleep_ms(uint32_t ms) {
+  sleep_ms(ms);
+}
+
+// the interrupt handlers set interrupt_handled, each ends the wait for events (WFE), as does the timer alarm at until_us
+// the system PLL is stopped for a long enough sleep at the slow clock
+void hal_idle(uint32_t min_ms, uint64_t until_us) {
+  absolute_time_t until = from_us_since_boot(until_us);
+
+  if (!clock_fast && pll_sys_running && (until_us > hal_time_us() + PLL_SYS_STOP_US)) {
+    pll_deinit(pll_sys);
+    pll_sys_running = false;
+  }
+  sleep_ms(min_ms);
+  while (!interrupt_handled && (hal_time_us() < until_us))
+    best_effort_wfe_or_timeout(until);
+  interrupt_handled = false;
+}
+
+// clk_sys switches glitch-free through clk_ref, the system PLL only needs to lock again if a long sleep has stopped it
+void hal_clock_fast(bool fast) {
+  if (fast == clock_fast)
+    return;
+  clock_fast = fast;
+  if (fast) {
+    if (!pll_sys_running) {
+      pll_init(pll_sys, 1, PLL_SYS_VCO_HZ, 6, 2);
+      pll_sys_running = true;
+    }
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, CLOCK_FAST_KHZ * KHZ, CLOCK_FAST_KHZ * KHZ);
+  }
+  else
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, CLOCK_SLOW_KHZ * KHZ, CLOCK_SLOW_KHZ * KHZ);
+}
+
+void hal_uart_init(uint32_t baud_rate) {
+  uart_init(UART_ID, baud_rate);
+  gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+  gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+  uart_set_hw_flow(UART_ID, false, false);
+  uart_set_format(UART_ID, DATA_BITS, STOP_BITS, PARITY);
+  uart_set_fifo_enabled(UART_ID, true);
+}
+
+void hal_uart_putc(char chr) {
+  uart_putc_raw(UART_ID, chr);
+}
+
+bool hal_uart_is_readable(void) {
+  return uart_is_readable(UART_ID);
+}
+
+bool hal_uart_is_readable_within_us(uint32_t wait_us) {
+  return uart_is_readable_within_us(UART_ID, wait_us);
+}
+
+char hal_uart_getc(void) {
+  return uart_getc(UART_ID);
+}
+
+static void uart_irq_handler(void) {
+  interrupt_handled = true;
+  uart_rx_handler();
+}
+
+void hal_uart_set_rx_handler(void (*handler)(void)) {
+  int uart_irq;
+
+  uart_rx_handler = handler;
+// disable FIFO buffer, the interrupt handler works better without it
+  uart_set_fifo_enabled(UART_ID, false);
+// install interrupt handler
+  uart_irq = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
+  irq_set_exclusive_handler(uart_irq, uart_irq_handler);
+  irq_set_enabled(uart_irq, true);
+  uart_set_irq_enables(UART_ID, true, false);
+}
+
+void hal_gpio_init_input_pullup(unsigned int pin) {
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_IN);
+  gpio_pull_up(pin);
+}
+
+void hal_gpio_init_output(unsigned int pin) {
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_OUT);
+}
+
+bool hal_gpio_get(unsigned int pin) {
+  return gpio_get(pin);
+}
+
+void hal_gpio_put(unsigned int pin, bool value) {
+  gpio_put(pin, value);
+}
+
+static void gpio_irq_handler(uint gpio, uint32_t events) {
+  (void)gpio;
+  (void)events;
+  interrupt_handled = true;
+  gpio_falling_edge_handler();
+}
+
+void hal_gpio_set_falling_edge_handler(unsigned int pin, void (*handler)(void)) {
+  gpio_falling_edge_handler = handler;
+  gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_FALL, true, gpio_irq_handler);
+}
+
+void hal_flash_read(uint8_t* data, size_t length) {
+  memcpy(data, (uint8_t *) (XIP_BASE + FLASH_TARGET_OFFSET), length);
+}
+
+void hal_flash_write(const uint8_t* data, size_t length) {
+  uint32_t interrupts;
+
+  interrupts = save_and_disable_interrupts();
+  flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(FLASH_TARGET_OFFSET, data, length);
+  restore_interrupts(interrupts);
+}
+
+void hal_watchdog_enable(uint32_t timeout_ms) {
+  watchdog_enable(timeout_ms, false);
+}
+
+void hal_watchdog_update(void) {
+  watchdog_update();
+}
+
+bool hal_watchdog_caused_reboot(void) {
+  return watchdog_caused_reboot();
+}
+
+void hal_reboot(void) {
+  watchdog_enable((uint32_t)1, false);
+  sleep_ms(5);
+#ifdef DEBUG
+  printf("This point should never be reached due to the watchdog\n");
+#endif
+  while(true);
+}
+
+// paints the stack region below the current stack frame, leaving some margin for this function itself
+void __attribute__((noinline)) hal_stack_paint(void) {
+  uint32_t marker;
+  uint32_t* p = &__StackLimit;
+
+  while (p < &marker - 16)
+    *p++ = STACK_PAINT_PATTERN;
+}
+
+// determines the deepest stack use so far from the lowest overwritten word of the painted region
+// if the whole region has been overwritten, the stack has grown into the heap and the result is the full region
+uint32_t hal_stack_check(uint32_t* stack_size) {
+  uint32_t* p = &__StackLimit;
+
+  while ((p < &__StackTop) && (*p == STACK_PAINT_PATTERN))
+    p++;
+  *stack_size = (uint32_t)((uint8_t*)&__StackTop - (uint8_t*)&__StackLimit);
+
+  return (uint32_t)((uint8_t*)&__StackTop - (uint8_t*)p);
+}
+
+// called from the HardFault handler with the exception stack frame (r0-r3, r12, lr, pc, xpsr)
+// records PC and LR of the faulting code and reboots
+void __attribute__((used)) hardfault_record(uint32_t* stack_frame) {
+  reboot_record.pc = stack_frame[6];
+  reboot_record.lr = stack_frame[5];
+  reboot_record.reason = REBOOT_REASON_HARDFAULT;
+  watchdog_enable((uint32_t)1, false);
+  while(true);
+}
+
+// replaces the SDK's default HardFault handler (which just halts at a breakpoint)
+// picks the stack pointer that was in use when the fault occurred and passes the stack frame on
+void __attribute__((naked)) isr_hardfault(void) {
+  __asm volatile (
+    "movs r0, #4\n"
+    "mov r1, lr\n"
+    "tst r0, r1\n"
+    "beq 1f\n"
+    "mrs r0, psp\n"
+    "b 2f\n"
+    "1:\n"
+    "mrs r0, msp\n"
+    "2:\n"
+    "ldr r1, =hardfault_record\n"
+    "bx r1\n"
+  );
+}
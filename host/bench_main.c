@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hal.h"
+
+// alarmdial_bench: runs the microbenchmarks of bench.c on the build machine and prints the results as JSON
+//
+// usage: alarmdial_bench [-t time_ms] [filter]
+//   -t  time spent on each kernel in milliseconds (default 200)
+//   filter: only runs the kernels whose name contains it
+
+int main(int argc, char* argv[]) {
+  uint32_t time_ms = 200;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    switch (opt) {
+      case 't': time_ms = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-t time_ms] [filter]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  hal_init();
+  bench_run("host", optind < argc ? argv[optind] : NULL, time_ms * 1000);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// fuzz targets of the AlarmDial logic (fuzz_framing.c, fuzz_urc.c, fuzz_sms_command.c)
+// each target implements the libFuzzer entry point, built with clang the targets link against libFuzzer, built with gcc
+// against the standalone driver fuzz_driver.c
+
+// runs the logic on one input, returns 0
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// name of the target, used by the standalone driver for crash files and reports
+extern const char* const fuzz_target_name;
+
+// the logic has to keep these properties for any input, a violation ends the run like a crash
+#define FUZZ_CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      abort(); \
+    } \
+  } while (0)
+
+#endif
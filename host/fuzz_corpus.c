@@ -0,0 +1,106 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+// alarmdial_fuzz_corpus: seeds the corpora of the fuzz targets from recorded traces (trace.h)
+//
+// usage: alarmdial_fuzz_corpus corpus_directory trace ...
+// writes into corpus_directory/framing the modem output between two commands (with a chunk size byte in front, see
+// fuzz_framing.c), into corpus_directory/urc every line from the modem, and into corpus_directory/sms_command the text
+// of every SMS read with AT+CMGR
+// files are named after a hash of their content, so inputs occurring repeatedly are only stored once
+
+#define RESPONSE_LENGTH 4096
+
+static int files_written = 0;
+
+static void write_input(const char* directory, const char* data, size_t length) {
+  char file_name[4096];
+  uint32_t hash = 2166136261u;
+  size_t i;
+  FILE* f;
+
+  for (i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+  snprintf(file_name, sizeof(file_name), "%s/%08x-%zu", directory, hash, length);
+  f = fopen(file_name, "wb");
+  if (!f) {
+    fprintf(stderr, "alarmdial_fuzz_corpus: cannot write %s\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+  fwrite(data, 1, length, f);
+  fclose(f);
+  files_written++;
+}
+
+static void make_directory(const char* path) {
+  if (mkdir(path, 0755) && (errno != EEXIST)) {
+    fprintf(stderr, "alarmdial_fuzz_corpus: cannot create %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  static trace_event_t event;
+  static char response[RESPONSE_LENGTH + 1];
+  char framing[4096], urc[4096], sms_command[4096];
+  char line[RESPONSE_LENGTH];
+  size_t response_length = 0, line_length = 0, i;
+  bool sms_follows = false;
+  int responses = 0, t;
+  FILE* f;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s corpus_directory trace ...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  snprintf(framing, sizeof(framing), "%s/framing", argv[1]);
+  snprintf(urc, sizeof(urc), "%s/urc", argv[1]);
+  snprintf(sms_command, sizeof(sms_command), "%s/sms_command", argv[1]);
+  make_directory(argv[1]);
+  make_directory(framing);
+  make_directory(urc);
+  make_directory(sms_command);
+
+  for (t = 2; t < argc; t++) {
+    f = fopen(argv[t], "r");
+    if (!f) {
+      fprintf(stderr, "alarmdial_fuzz_corpus: cannot read %s\n", argv[t]);
+      return EXIT_FAILURE;
+    }
+    while (trace_read(f, &event)) {
+// a command ends the response to the previous one, the chunk sizes vary from response to response
+      if ((event.type == TRACE_TX) && response_length) {
+        response[0] = (char)(responses++ * 37);
+        write_input(framing, response, response_length + 1);
+        response_length = 0;
+      }
+      if (event.type != TRACE_RX)
+        continue;
+      for (i = 0; i < (size_t)event.length; i++) {
+        if (response_length < RESPONSE_LENGTH)
+          response[1 + response_length++] = event.data[i];
+        if (event.data[i] == '\n') {
+          if (line_length) {
+            write_input(urc, line, line_length);
+            if (sms_follows && strncmp(line, "+CMGR", 5))
+              write_input(sms_command, line, line_length);
+            sms_follows = !strncmp(line, "+CMGR", 5);
+          }
+          line_length = 0;
+        }
+        else if ((event.data[i] != '\r') && (line_length < sizeof(line)))
+          line[line_length++] = event.data[i];
+      }
+    }
+    fclose(f);
+  }
+  if (response_length)
+    write_input(framing, response, response_length + 1);
+  printf("%d inputs written (including repeated ones) from %d traces\n", files_written, argc - 2);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,408 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef FUZZ_SANITIZERS
+#include <sanitizer/common_interface_defs.h>
+#endif
+#include "fuzz.h"
+#include "trace.h"
+
+// standalone driver for the fuzz targets, for compilers without libFuzzer (gcc)
+// the target and the logic are compiled with -fsanitize-coverage=trace-pc, the driver collects that coverage and keeps
+// mutated inputs that reach new code in the corpus, like libFuzzer does
+//
+// usage: alarmdial_fuzz_<target> [-n runs] [-r seed] [-m max_length] [-s slowest] [corpus directory or file ...]
+//   -n  number of mutated inputs to run after the corpus (default 100000, 0 only runs the corpus)
+//   -r  seed of the random mutations
+//   -m  maximum length of mutated inputs (default 1024)
+//   -s  number of slowest inputs to report (default 5)
+// new inputs are saved in the first corpus directory given, an input that crashes the target is saved as crash-<target>
+// in the current directory, and the exit status is then EXIT_FAILURE
+
+#define COVERAGE_SIZE 65536
+#define MAX_MUTATIONS 4
+
+// single timings are disturbed by the scheduler, so more candidates than reported are kept, and these are timed again
+#define SLOW_CANDIDATES_FACTOR 4
+#define SLOW_REPEATS 20
+
+typedef struct {
+  uint8_t* data;
+  size_t length;
+} input_t;
+
+typedef struct {
+  uint64_t ns;
+  input_t input;
+} slow_input_t;
+
+// edges between basic blocks, hashed, and those reached in the current run in the order of their first occurrence
+static uint8_t coverage_run[COVERAGE_SIZE];
+static uint8_t coverage_total[COVERAGE_SIZE];
+static uint32_t coverage_reached[COVERAGE_SIZE];
+static int coverage_reached_entries = 0;
+static uintptr_t coverage_previous = 0;
+static int coverage_edges = 0;
+
+static input_t* corpus = NULL;
+static int corpus_entries = 0;
+static const char* corpus_directory = NULL;
+
+static slow_input_t* slowest = NULL;
+static int slowest_entries = 0;
+static int slowest_size = 5 * SLOW_CANDIDATES_FACTOR;
+
+static const uint8_t* current_data = NULL;
+static size_t current_length = 0;
+
+static uint64_t random_state = 0x2545f4914f6cdd1dULL;
+
+// tokens of the modem protocol and the SMS commands, inserted by one of the mutations
+static const char* const dictionary[] = {
+  "\r\n", "OK", "ERROR", "> ", "+CPSI: ", "+CREG: ", "+CSQ: ", "+CMGS: ", "+CMTI: \"SM\",", "+CMGR: ", "+CLCC: ",
+  "+QNWINFO: ", "+CLIP: ", "+QIND: SMS DONE", "+CGEV: ", ",", "\"", ":", "674358 ", "Signal?", "Status?",
+  "TelephoneNumber!", "Password!", "SMSonInput!", "MessageText!", "On!", "Off!", "Defaults!", "Power!", "Energy?",
+  "Digest!", "+CTZV: ", "+CCLK: \"26/10/18,12:00:00+04\""
+};
+
+// called by the instrumented code on every basic block
+void __sanitizer_cov_trace_pc(void) {
+  uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+
+  uint32_t edge;
+
+  pc = (pc ^ (pc >> 16)) * 0x45d9f3b;
+  edge = (pc ^ coverage_previous) % COVERAGE_SIZE;
+  if (!coverage_run[edge]) {
+    coverage_run[edge] = 1;
+    coverage_reached[coverage_reached_entries++] = edge;
+  }
+  coverage_previous = pc >> 1;
+}
+
+static uint32_t random_next(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+
+  return (uint32_t)(random_state >> 32);
+}
+
+// writes the input that crashed the target, only using async-signal-safe functions
+static void save_crash(void) {
+  char file_name[64] = "crash-";
+  int f;
+
+  strncat(file_name, fuzz_target_name, sizeof(file_name) - 7);
+  f = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (f >= 0) {
+    if (current_length)
+      (void)!write(f, current_data, current_length);
+    close(f);
+  }
+  (void)!write(STDERR_FILENO, "input saved as ", 15);
+  (void)!write(STDERR_FILENO, file_name, strlen(file_name));
+  (void)!write(STDERR_FILENO, "\n", 1);
+}
+
+static void crash_signal(int signal_number) {
+  save_crash();
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+static void save_input(const input_t* input) {
+  char file_name[4096];
+  uint32_t hash = 2166136261u;
+  size_t i;
+  FILE* f;
+
+  if (!corpus_directory)
+    return;
+  for (i = 0; i < input->length; i++)
+    hash = (hash ^ input->data[i]) * 16777619u;
+  snprintf(file_name, sizeof(file_name), "%s/%08x-%zu", corpus_directory, hash, input->length);
+  f = fopen(file_name, "wb");
+  if (f) {
+    fwrite(input->data, 1, input->length, f);
+    fclose(f);
+  }
+}
+
+static void corpus_add(const uint8_t* data, size_t length) {
+  input_t* input;
+
+  corpus = realloc(corpus, (corpus_entries + 1) * sizeof(corpus[0]));
+  input = &corpus[corpus_entries++];
+  input->data = malloc(length ? length : 1);
+  if (!corpus || !input->data) {
+    fprintf(stderr, "alarmdial_fuzz: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(input->data, data, length);
+  input->length = length;
+}
+
+static void slowest_add(const uint8_t* data, size_t length, uint64_t ns) {
+  slow_input_t entry;
+  int i;
+
+  if ((slowest_entries == slowest_size) && (ns <= slowest[slowest_entries - 1].ns))
+    return;
+  if (slowest_entries == slowest_size)
+    free(slowest[--slowest_entries].input.data);
+  entry.ns = ns;
+  entry.input.data = malloc(length ? length : 1);
+  memcpy(entry.input.data, data, length);
+  entry.input.length = length;
+  for (i = slowest_entries++; (i > 0) && (slowest[i - 1].ns < ns); i--)
+    slowest[i] = slowest[i - 1];
+  slowest[i] = entry;
+}
+
+// times the candidates for the slowest inputs again, taking the fastest of several runs, and sorts them
+static void retime_slowest(void) {
+  struct timespec start, stop;
+  slow_input_t entry;
+  uint64_t ns;
+  uint8_t* copy;
+  int i, j;
+
+  for (i = 0; i < slowest_entries; i++) {
+    copy = malloc(slowest[i].input.length ? slowest[i].input.length : 1);
+    slowest[i].ns = UINT64_MAX;
+    for (j = 0; j < SLOW_REPEATS; j++) {
+      memcpy(copy, slowest[i].input.data, slowest[i].input.length);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      LLVMFuzzerTestOneInput(copy, slowest[i].input.length);
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      ns = (uint64_t)(stop.tv_sec - start.tv_sec) * 1000000000 + (stop.tv_nsec - start.tv_nsec);
+      if (ns < slowest[i].ns)
+        slowest[i].ns = ns;
+    }
+    free(copy);
+  }
+  for (i = 1; i < slowest_entries; i++) {
+    entry = slowest[i];
+    for (j = i; (j > 0) && (slowest[j - 1].ns < entry.ns); j--)
+      slowest[j] = slowest[j - 1];
+    slowest[j] = entry;
+  }
+}
+
+// runs the target on an exactly sized copy of the input, so that reading past its end is caught
+// returns whether the input has reached new code
+static bool run(const uint8_t* data, size_t length) {
+  struct timespec start, stop;
+  uint8_t* copy = malloc(length ? length : 1);
+  bool new_coverage = false;
+  int i;
+
+  memcpy(copy, data, length);
+  current_data = copy;
+  current_length = length;
+  coverage_previous = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  LLVMFuzzerTestOneInput(copy, length);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  slowest_add(data, length, (uint64_t)(stop.tv_sec - start.tv_sec) * 1000000000 + (stop.tv_nsec - start.tv_nsec));
+  for (i = 0; i < coverage_reached_entries; i++) {
+    if (!coverage_total[coverage_reached[i]]) {
+      coverage_total[coverage_reached[i]] = 1;
+      coverage_edges++;
+      new_coverage = true;
+    }
+    coverage_run[coverage_reached[i]] = 0;
+  }
+  coverage_reached_entries = 0;
+  current_data = NULL;
+  current_length = 0;
+  free(copy);
+
+  return new_coverage;
+}
+
+static void load_file(const char* file_name) {
+  static uint8_t data[65536];
+  size_t length;
+  FILE* f;
+
+  f = fopen(file_name, "rb");
+  if (!f)
+    return;
+  length = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  corpus_add(data, length);
+}
+
+static void load_corpus(const char* path) {
+  char file_name[4096];
+  struct dirent* entry;
+  struct stat status;
+  DIR* directory;
+
+  if (stat(path, &status)) {
+    fprintf(stderr, "alarmdial_fuzz: cannot read %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  if (!S_ISDIR(status.st_mode)) {
+    load_file(path);
+    return;
+  }
+  if (!corpus_directory)
+    corpus_directory = path;
+  directory = opendir(path);
+  while (directory && (entry = readdir(directory))) {
+    snprintf(file_name, sizeof(file_name), "%s/%s", path, entry->d_name);
+    if (!stat(file_name, &status) && S_ISREG(status.st_mode))
+      load_file(file_name);
+  }
+  if (directory)
+    closedir(directory);
+}
+
+// derives a new input from a corpus entry with a few random mutations
+static size_t mutate(uint8_t* data, size_t max_length) {
+  const input_t* input;
+  const input_t* other;
+  const char* token;
+  size_t length = 0, position, n;
+  int mutations, i;
+
+  if (corpus_entries) {
+    input = &corpus[random_next() % corpus_entries];
+    length = input->length < max_length ? input->length : max_length;
+    memcpy(data, input->data, length);
+  }
+  mutations = 1 + random_next() % MAX_MUTATIONS;
+  for (i = 0; i < mutations; i++) {
+    position = length ? random_next() % (length + 1) : 0;
+    switch (random_next() % 8) {
+      case 0:
+        if (position < length)
+          data[position] ^= 1 << (random_next() % 8);
+        break;
+      case 1:
+        if (position < length)
+          data[position] = (uint8_t)random_next();
+        break;
+      case 2:
+        if (position < length)
+          data[position] = "\r\n,\":! ?\0\x1a\xff"[random_next() % 11];
+        break;
+      case 3:
+        if (length < max_length) {
+          memmove(&data[position + 1], &data[position], length - position);
+          data[position] = (uint8_t)random_next();
+          length++;
+        }
+        break;
+      case 4:
+        if (position < length) {
+          n = 1 + random_next() % (length - position);
+          memmove(&data[position], &data[position + n], length - position - n);
+          length -= n;
+        }
+        break;
+      case 5:
+        token = dictionary[random_next() % (sizeof(dictionary) / sizeof(dictionary[0]))];
+        n = strlen(token);
+        if (length + n <= max_length) {
+          memmove(&data[position + n], &data[position], length - position);
+          memcpy(&data[position], token, n);
+          length += n;
+        }
+        break;
+      case 6:
+// duplicates a part of the input, e.g. to make lines overlong
+        if (position < length) {
+          n = 1 + random_next() % (length - position);
+          if (length + n <= max_length) {
+            memmove(&data[position + n], &data[position], length - position);
+            length += n;
+          }
+        }
+        break;
+      default:
+// splices in the end of another corpus entry
+        if (corpus_entries) {
+          other = &corpus[random_next() % corpus_entries];
+          n = other->length ? random_next() % other->length : 0;
+          if (position + other->length - n <= max_length) {
+            memcpy(&data[position], &other->data[n], other->length - n);
+            length = position + other->length - n;
+          }
+        }
+        break;
+    }
+  }
+
+  return length;
+}
+
+int main(int argc, char* argv[]) {
+  struct timespec start, stop;
+  uint8_t* data;
+  long runs = 100000, i;
+  size_t max_length = 1024, length;
+  int new_inputs = 0, loaded, opt;
+  double wall_s;
+
+  while ((opt = getopt(argc, argv, "n:r:m:s:")) != -1) {
+    switch (opt) {
+      case 'n': runs = atol(optarg); break;
+      case 'r': random_state = (uint64_t)atol(optarg) * 0x9e3779b97f4a7c15ULL + 1; break;
+      case 'm': max_length = (size_t)atol(optarg) > 0 ? (size_t)atol(optarg) : 1; break;
+      case 's': slowest_size = (atoi(optarg) > 0 ? atoi(optarg) : 1) * SLOW_CANDIDATES_FACTOR; break;
+      default:
+        fprintf(stderr, "usage: %s [-n runs] [-r seed] [-m max_length] [-s slowest] [corpus directory or file ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  signal(SIGABRT, crash_signal);
+  signal(SIGSEGV, crash_signal);
+  signal(SIGBUS, crash_signal);
+  signal(SIGFPE, crash_signal);
+#ifdef FUZZ_SANITIZERS
+  __sanitizer_set_death_callback(save_crash);
+#endif
+  slowest = malloc(slowest_size * sizeof(slowest[0]));
+  data = malloc(max_length);
+  for (; optind < argc; optind++)
+    load_corpus(argv[optind]);
+  loaded = corpus_entries;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+// the corpus first, then mutations of it, keeping those that reach new code
+  for (i = 0; i < loaded; i++)
+    run(corpus[i].data, corpus[i].length);
+  printf("%s: %d corpus inputs, %d edges\n", fuzz_target_name, loaded, coverage_edges);
+  for (i = 0; i < runs; i++) {
+    length = mutate(data, max_length);
+    if (run(data, length)) {
+      corpus_add(data, length);
+      save_input(&corpus[corpus_entries - 1]);
+      new_inputs++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  wall_s = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("%s: %ld runs in %.1f s (%.0f/s), %d new inputs, %d edges\n", fuzz_target_name, loaded + runs, wall_s,
+         (loaded + runs) / (wall_s > 0 ? wall_s : 1e-9), new_inputs, coverage_edges);
+  retime_slowest();
+  printf("slowest inputs (fastest of %d runs):\n", SLOW_REPEATS);
+  for (i = 0; i < slowest_entries / SLOW_CANDIDATES_FACTOR; i++) {
+    printf("  %8.1f us  %4zu bytes  ", slowest[i].ns / 1e3, slowest[i].input.length);
+    trace_write_escaped(stdout, (const char*)slowest[i].input.data,
+                        slowest[i].input.length < 80 ? slowest[i].input.length : 80);
+    printf("%s\n", slowest[i].input.length > 80 ? "..." : "");
+  }
+  free(data);
+
+  return EXIT_SUCCESS;
+}
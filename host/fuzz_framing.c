@@ -0,0 +1,89 @@
+#include <string.h>
+#include "fuzz.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "modem.h"
+
+// fuzz target: line framing, i.e. the UART interrupt handler filling the ring buffer and read_line taking lines out of
+// it (modem.c), with each line then classified as in the main loop
+// the first byte of the input is the number of characters (1 to 256) arriving between two traversals of the main loop,
+// the rest is the data from the modem
+// the ring buffer does not check for overflow (see modem.c), so the data is limited to its size
+
+const char* const fuzz_target_name = "framing";
+
+static const uint8_t* uart_data;
+static size_t uart_length, uart_available;
+
+// the UART peer of hal_sim hands over the characters released for the current traversal
+static void uart_receive(void* context, const char* data, size_t length, uint64_t now_us) {
+  (void)context;
+  (void)data;
+  (void)length;
+  (void)now_us;
+}
+
+static size_t uart_transmit(void* context, char* data, size_t length, uint64_t now_us) {
+  (void)context;
+  (void)now_us;
+  if (length > uart_available)
+    length = uart_available;
+  memcpy(data, uart_data, length);
+  uart_data += length;
+  uart_length -= length;
+  uart_available -= length;
+
+  return length;
+}
+
+static uint64_t uart_next_event_us(void* context) {
+  (void)context;
+
+  return uart_available ? 0 : UINT64_MAX;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool initialised = false;
+  hal_sim_uart_peer_t peer = { NULL, uart_receive, uart_transmit, uart_next_event_us };
+  char line[max_str_l];
+  size_t chunk;
+  int l, lines = 0, lf = 0;
+
+  if (!initialised) {
+    hal_init();
+    hal_sim_attach_uart(&peer);
+    initialised = true;
+  }
+  if (size < 1)
+    return 0;
+  chunk = data[0] + 1;
+  uart_data = data + 1;
+  uart_length = size - 1;
+  if (uart_length > RX_BUFFER_SIZE)
+    uart_length = RX_BUFFER_SIZE;
+  for (l = 0; l < (int)uart_length; l++)
+    lf += uart_data[l] == LF;
+
+  rx_buffer_read_position = 0;
+  rx_buffer_entries = 0;
+  rx_buffer_write_position = 0;
+  rx_buffer_number_lf = 0;
+  while (uart_length || (rx_buffer_number_lf > 0)) {
+    uart_available = uart_length < chunk ? uart_length : chunk;
+    uart_rx_interrupt_handler();
+    FUZZ_CHECK((rx_buffer_entries >= 0) && (rx_buffer_entries <= RX_BUFFER_SIZE));
+    while ((l = read_line(line)) >= 0) {
+      FUZZ_CHECK((l < max_str_l) && ((int)strlen(line) <= l));
+      FUZZ_CHECK(!strchr(line, CR) && !strchr(line, LF));
+      FUZZ_CHECK(rx_buffer_entries >= 0);
+      FUZZ_CHECK(rx_buffer_number_lf >= 0);
+      if (l > 0)
+        classify_message(line);
+      lines++;
+    }
+  }
+// every LF ends a line, and overlong lines are truncated, so there are as many lines as LFs
+  FUZZ_CHECK(lines == lf);
+
+  return 0;
+}
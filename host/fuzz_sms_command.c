@@ -0,0 +1,53 @@
+#include <string.h>
+#include "config.h"
+#include "dialler.h"
+#include "fuzz.h"
+#include "modem.h"
+#include "sms_command.h"
+
+// fuzz target: the SMS command parser (sms_command.c) with the default configuration
+// the input is the SMS text as the main loop hands it over, i.e. one line of at most max_str_l-1 characters, and
+// then the caller number of a missed call
+
+const char* const fuzz_target_name = "sms_command";
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  config_t config;
+  char reply[max_str_l];
+  char caller[CONFIG_TEL_NO_SIZE];
+  bool config_changed = false;
+  char* text;
+  int action, i;
+
+// an exactly sized copy, so that reading past the end of the text is caught by the address sanitizer
+  if (size > max_str_l - 1)
+    size = max_str_l - 1;
+  text = malloc(size + 1);
+  memcpy(text, data, size);
+  text[size] = 0;
+
+// the defaults do not fill the strings, the rest of them must not be relied upon
+  memset(&config, 0xa5, sizeof(config));
+  config_set_defaults(&config);
+  action = handle_sms_command(text, &config, reply, &config_changed);
+  FUZZ_CHECK((action >= 0) && (action < MULTI_STAGE_MAX_ACTIONS));
+  FUZZ_CHECK(strlen(reply) < max_str_l);
+  FUZZ_CHECK(!action || (action == MULTI_STAGE_RECEIVED_SIGNAL_REQUEST) || reply[0]);
+// whatever the SMS contained, the configuration has to remain storable
+  FUZZ_CHECK(strlen(config.passw) == sizeof(config.passw) - 1);
+  FUZZ_CHECK(strlen(config.tel_no) < sizeof(config.tel_no));
+  for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+    FUZZ_CHECK(strlen(config.sms_on_fall[i]) < sizeof(config.sms_on_fall[i]));
+    FUZZ_CHECK(strlen(config.sms_on_rise[i]) < sizeof(config.sms_on_rise[i]));
+  }
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    FUZZ_CHECK(strlen(config.callers[i]) < sizeof(config.callers[i]));
+  caller[0] = 0;
+  action = handle_missed_call(text, &config, reply, caller);
+  FUZZ_CHECK((action >= 0) && (action < MULTI_STAGE_MAX_ACTIONS));
+  FUZZ_CHECK(strlen(reply) < max_str_l);
+  FUZZ_CHECK(!action || (caller[0] && (strlen(caller) < sizeof(caller))));
+  free(text);
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+#include <string.h>
+#include "fuzz.h"
+#include "modem.h"
+
+// fuzz target: classification of a line from the modem and extraction of its parameters (modem.c), as in the main loop
+// the input is one line as read_line delivers it, i.e. without CR and LF and at most max_str_l-1 characters
+
+const char* const fuzz_target_name = "urc";
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  char field[8];
+  const char* parameters;
+  char* line;
+  int type, index, l;
+
+// an exactly sized copy, so that reading past the end of the line is caught by the address sanitizer
+  if (size > max_str_l - 1)
+    size = max_str_l - 1;
+  line = malloc(size + 1);
+  memcpy(line, data, size);
+  line[size] = 0;
+
+  type = classify_message(line);
+  FUZZ_CHECK((type >= 0) && (type <= MSG_IGNORE));
+  parameters = message_parameters(line);
+  FUZZ_CHECK((parameters >= line) && (parameters <= line + strlen(line)));
+// the field buffer is small, so that the truncation is exercised as well
+  for (index = 0; index < 4; index++) {
+    l = message_field(line, index, field, sizeof(field));
+    FUZZ_CHECK(strlen(field) < sizeof(field));
+    FUZZ_CHECK((l < 0) ? !field[0] : ((int)strlen(field) == (l < (int)sizeof(field) ? l : (int)sizeof(field) - 1)));
+  }
+  free(line);
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "diagnostics.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "modem.h"
+#include "trace.h"
+
+// implementation of the hardware abstraction on Linux, for running the AlarmDial logic without a Pico
+//
+// configured through environment variables
+//   ALARMDIAL_UART   serial device or pseudo-terminal of the modem, without it the modem is absent
+//   ALARMDIAL_FLASH  file holding the configuration storage area, without it the storage is kept in memory
+//   ALARMDIAL_GPIO   file with one character '0' or '1' per pin number, re-read whenever an input pin is read
+//   ALARMDIAL_TRACE  file to record the UART traffic and input changes in, for alarmdial_replay (see trace.h)
+//
+// the DTR and RI pins of the modem (modem sleep mode) map to the modem control lines of the serial device
+
+#define UART_READ_BUFFER_SIZE 256
+
+reboot_record_t reboot_record;
+
+static struct timespec start_time;
+
+static int uart_fd = -1;
+static char uart_read_buffer[UART_READ_BUFFER_SIZE];
+static int uart_read_position = 0;
+static int uart_read_entries = 0;
+static void (*uart_rx_handler)(void) = NULL;
+
+static bool gpio_value[HAL_HOST_GPIO_PINS];
+static const char* gpio_file = NULL;
+static void (*gpio_falling_edge_handler)(void) = NULL;
+static unsigned int gpio_falling_edge_pin;
+static bool ring_active = false;
+static bool interrupt_handled = false;
+
+static uint8_t flash_memory[4096];
+static const char* flash_file = NULL;
+
+static FILE* trace = NULL;
+static char trace_tx[TRACE_DATA_LENGTH];
+static int trace_tx_length = 0;
+
+static uint32_t watchdog_timeout_ms = 0;
+static uint64_t watchdog_last_update_us = 0;
+
+void hal_init(void) {
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  for (i = 0; i < HAL_HOST_GPIO_PINS; i++)
+    gpio_value[i] = true;
+  memset(flash_memory, 0xff, sizeof(flash_memory));
+  gpio_file = getenv("ALARMDIAL_GPIO");
+  flash_file = getenv("ALARMDIAL_FLASH");
+  if (getenv("ALARMDIAL_TRACE") && !(trace = fopen(getenv("ALARMDIAL_TRACE"), "w")))
+    fprintf(stderr, "alarmdial_host: cannot open %s: %s\n", getenv("ALARMDIAL_TRACE"), strerror(errno));
+}
+
+uint64_t hal_time_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - start_time.tv_sec) * 1000000 + (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+// characters sent are traced per command (up to CR or CTRL-Z), and before anything else is traced
+static void trace_flush_tx(void) {
+  if (trace && trace_tx_length) {
+    trace_write_data(trace, hal_time_us(), TRACE_TX, trace_tx, trace_tx_length);
+    fflush(trace);
+  }
+  trace_tx_length = 0;
+}
+
+// fills the read buffer from the UART, waiting at most the specified time for data
+static bool uart_fill(int wait_ms) {
+  struct pollfd pfd;
+  ssize_t n;
+
+  if (uart_read_entries > 0)
+    return true;
+  if (uart_fd < 0) {
+    if (wait_ms > 0)
+      usleep((useconds_t)wait_ms * 1000);
+    return false;
+  }
+  pfd.fd = uart_fd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, wait_ms) <= 0)
+    return false;
+  n = read(uart_fd, uart_read_buffer, UART_READ_BUFFER_SIZE);
+  if (n <= 0)
+    return false;
+  uart_read_position = 0;
+  uart_read_entries = (int)n;
+  if (trace) {
+    trace_flush_tx();
+    trace_write_data(trace, hal_time_us(), TRACE_RX, uart_read_buffer, n);
+    fflush(trace);
+  }
+
+  return true;
+}
+
+// checks the emulated watchdog, which reboots (exits) if the logic has not updated it within the timeout
+static void watchdog_check(void) {
+  if (watchdog_timeout_ms && (hal_time_us() - watchdog_last_update_us > (uint64_t)watchdog_timeout_ms * 1000)) {
+    fprintf(stderr, "alarmdial_host: watchdog timeout\n");
+    hal_reboot();
+  }
+}
+
+// the ring indicator of the serial device stands in for the RI pin, which falls when the ring indicator turns on
+static void ring_check(void) {
+  int status;
+  bool ring;
+
+  if ((uart_fd < 0) || !gpio_falling_edge_handler || (gpio_falling_edge_pin != GPIO_PIN_MODEM_RI) || \
+      (ioctl(uart_fd, TIOCMGET, &status) < 0))
+    return;
+  ring = (status & TIOCM_RNG) != 0;
+  if (ring && !ring_active) {
+    interrupt_handled = true;
+    gpio_falling_edge_handler();
+  }
+  ring_active = ring;
+}
+
+// sleeping is when characters arriving on the UART are handed to the receive handler, as the interrupt would
+void hal_sleep_ms(uint32_t ms) {
+  uint64_t end = hal_time_us() + (uint64_t)ms * 1000;
+  uint64_t now;
+
+  ring_check();
+  while ((now = hal_time_us()) < end) {
+    if (uart_fill((int)((end - now + 999) / 1000)) && uart_rx_handler) {
+      interrupt_handled = true;
+      uart_rx_handler();
+    }
+    else if (!uart_rx_handler && (uart_read_entries > 0))
+      usleep((useconds_t)(end - now));
+  }
+  watchdog_check();
+}
+
+// the ring indicator is only sampled between sleeps, so the sleep beyond min_ms goes in steps of up to 10 ms
+void hal_idle(uint32_t min_ms, uint64_t until_us) {
+  uint64_t now;
+
+  hal_sleep_ms(min_ms);
+  while (!interrupt_handled && ((now = hal_time_us()) < until_us))
+    hal_sleep_ms(until_us - now < 10000 ? (uint32_t)((until_us - now + 999) / 1000) : 10);
+  interrupt_handled = false;
+}
+
+// the host runs at whatever clock it has
+void hal_clock_fast(bool fast) {
+  (void)fast;
+}
+
+void hal_uart_init(uint32_t baud_rate) {
+  const char* device = getenv("ALARMDIAL_UART");
+  struct termios tio;
+
+  if (!device)
+    return;
+  uart_fd = open(device, O_RDWR | O_NOCTTY);
+  if (uart_fd < 0) {
+    fprintf(stderr, "alarmdial_host: cannot open %s: %s\n", device, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (!tcgetattr(uart_fd, &tio)) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, baud_rate == 9600 ? B9600 : B115200);
+    tcsetattr(uart_fd, TCSANOW, &tio);
+  }
+}
+
+void hal_uart_putc(char chr) {
+  if (trace) {
+    trace_tx[trace_tx_length++] = chr;
+    if ((chr == '\r') || (chr == '\x1a') || (trace_tx_length == TRACE_DATA_LENGTH))
+      trace_flush_tx();
+  }
+  if (uart_fd >= 0)
+    while ((write(uart_fd, &chr, 1) < 0) && (errno == EINTR));
+}
+
+bool hal_uart_is_readable(void) {
+  return uart_fill(0);
+}
+
+bool hal_uart_is_readable_within_us(uint32_t wait_us) {
+  return uart_fill((int)((wait_us + 999) / 1000));
+}
+
+char hal_uart_getc(void) {
+  while (!uart_fill(1000));
+  uart_read_entries--;
+  return uart_read_buffer[uart_read_position++];
+}
+
+void hal_uart_set_rx_handler(void (*handler)(void)) {
+  uart_rx_handler = handler;
+}
+
+void hal_gpio_init_input_pullup(unsigned int pin) {
+  if (pin < HAL_HOST_GPIO_PINS)
+    gpio_value[pin] = true;
+}
+
+void hal_gpio_init_output(unsigned int pin) {
+  (void)pin;
+}
+
+bool hal_gpio_get(unsigned int pin) {
+  char values[HAL_HOST_GPIO_PINS];
+  size_t n;
+  FILE* f;
+
+  if (pin >= HAL_HOST_GPIO_PINS)
+    return false;
+  if (gpio_file && (f = fopen(gpio_file, "r"))) {
+    n = fread(values, 1, HAL_HOST_GPIO_PINS, f);
+    fclose(f);
+    if ((pin < n) && (gpio_value[pin] != (values[pin] != '0'))) {
+      gpio_value[pin] = values[pin] != '0';
+      if (trace) {
+        trace_flush_tx();
+        trace_write_gpio(trace, hal_time_us(), pin, gpio_value[pin]);
+      }
+    }
+  }
+
+  return gpio_value[pin];
+}
+
+// DTR of the serial device is on while the DTR pin is low
+void hal_gpio_put(unsigned int pin, bool value) {
+  int dtr = TIOCM_DTR;
+
+  if ((pin == GPIO_PIN_MODEM_DTR) && (uart_fd >= 0))
+    ioctl(uart_fd, value ? TIOCMBIC : TIOCMBIS, &dtr);
+  if (pin < HAL_HOST_GPIO_PINS)
+    gpio_value[pin] = value;
+}
+
+void hal_gpio_set_falling_edge_handler(unsigned int pin, void (*handler)(void)) {
+  gpio_falling_edge_pin = pin;
+  gpio_falling_edge_handler = handler;
+}
+
+void hal_host_set_gpio(unsigned int pin, bool value) {
+  if (pin < HAL_HOST_GPIO_PINS) {
+    if (gpio_falling_edge_handler && (pin == gpio_falling_edge_pin) && gpio_value[pin] && !value)
+      gpio_falling_edge_handler();
+    gpio_value[pin] = value;
+  }
+}
+
+void hal_flash_read(uint8_t* data, size_t length) {
+  FILE* f;
+
+  if (length > sizeof(flash_memory))
+    length = sizeof(flash_memory);
+  if (flash_file && (f = fopen(flash_file, "rb"))) {
+    if (fread(flash_memory, 1, sizeof(flash_memory), f) == 0)
+      memset(flash_memory, 0xff, sizeof(flash_memory));
+    fclose(f);
+  }
+  memcpy(data, flash_memory, length);
+}
+
+void hal_flash_write(const uint8_t* data, size_t length) {
+  FILE* f;
+
+  if (length > sizeof(flash_memory))
+    length = sizeof(flash_memory);
+  memset(flash_memory, 0xff, sizeof(flash_memory));
+  memcpy(flash_memory, data, length);
+  if (flash_file && (f = fopen(flash_file, "wb"))) {
+    fwrite(flash_memory, 1, sizeof(flash_memory), f);
+    fclose(f);
+  }
+}
+
+void hal_watchdog_enable(uint32_t timeout_ms) {
+  watchdog_timeout_ms = timeout_ms;
+  watchdog_last_update_us = hal_time_us();
+}
+
+void hal_watchdog_update(void) {
+  watchdog_last_update_us = hal_time_us();
+}
+
+bool hal_watchdog_caused_reboot(void) {
+  return false;
+}
+
+// there is no reboot on the host, the process ends instead
+void hal_reboot(void) {
+  trace_flush_tx();
+  fprintf(stderr, "alarmdial_host: reboot (reason %lu)\n", (unsigned long)reboot_record.reason);
+  exit(3);
+}
+
+// the host stack is not measured
+void hal_stack_paint(void) {
+}
+
+uint32_t hal_stack_check(uint32_t* stack_size) {
+  *stack_size = 0;
+  return 0;
+}
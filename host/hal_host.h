@@ -0,0 +1,14 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdbool.h>
+
+// host-only extensions of the hardware abstraction, used by harnesses around the host build
+
+// number of GPIO pins of the RP2040
+#define HAL_HOST_GPIO_PINS 30
+
+// drives an input pin as the alarm panel would (pins are high when not driven, as with the pull-ups)
+void hal_host_set_gpio(unsigned int pin, bool value);
+
+#endif
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include "diagnostics.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "hal_sim.h"
+#include "modem.h"
+#include "trace.h"
+
+// implementation of the hardware abstraction in virtual time, see hal_sim.h
+//
+// the UART sends one character per MODEM_SIM_CHAR_TIME_US without a FIFO, as on the Pico, so sending advances time
+// received characters are handed to the receive handler while the logic sleeps, as the interrupt would
+// writing the flash takes as long as on the Pico, with interrupts disabled, so characters arriving meanwhile beyond
+// what the UART receive FIFO holds are lost
+// the DTR pin drives DTR of the simulated modem, each RI pulse of the modem is a falling edge of the RI pin, handed to
+// its handler while the logic sleeps
+
+#define UART_RX_BUFFER_SIZE 256
+#define UART_RX_FIFO_SIZE 32
+
+// typical times of the flash chip of the Pico (W25Q16JV) for erasing a 4 KB sector and programming a 256 byte page
+#define FLASH_SECTOR_ERASE_US 45000
+#define FLASH_PAGE_PROGRAM_US 700
+#define FLASH_PAGE_SIZE 256
+
+reboot_record_t reboot_record;
+jmp_buf hal_sim_reboot;
+
+static uint64_t now_us = 0;
+static uint64_t boot_time_us = 0;
+
+static hal_sim_uart_peer_t uart_peer;
+static bool uart_connected = false;
+static FILE* trace = NULL;
+static char trace_tx[TRACE_DATA_LENGTH];
+static int trace_tx_length = 0;
+static char uart_rx_buffer[UART_RX_BUFFER_SIZE];
+static int uart_rx_position = 0;
+static int uart_rx_entries = 0;
+static void (*uart_rx_handler)(void) = NULL;
+static uint64_t tx_chars = 0;
+static uint32_t rx_overruns = 0;
+
+static uint64_t (*run_events)(uint64_t now_us) = NULL;
+static uint64_t next_event_us = 0;
+static bool interrupt_handled = false;
+
+static bool gpio_value[HAL_HOST_GPIO_PINS];
+static modem_sim_t* modem_pins = NULL;
+static uint32_t rings_seen = 0;
+static bool ring_pending = false;
+static void (*gpio_falling_edge_handler)(void) = NULL;
+
+static uint8_t flash_memory[4096];
+
+static uint32_t watchdog_timeout_ms = 0;
+static uint64_t watchdog_last_update_us = 0;
+static bool watchdog_reboot = false;
+static uint32_t watchdog_timeouts = 0;
+
+static void modem_receive(void* context, const char* data, size_t length, uint64_t now_us) {
+  modem_sim_receive((modem_sim_t*)context, data, length, now_us);
+}
+
+static size_t modem_transmit(void* context, char* data, size_t length, uint64_t now_us) {
+  return modem_sim_transmit((modem_sim_t*)context, data, length, now_us);
+}
+
+static uint64_t modem_next_event_us(void* context) {
+  return modem_sim_next_event_us((modem_sim_t*)context);
+}
+
+void hal_sim_attach_modem(modem_sim_t* modem) {
+  hal_sim_uart_peer_t peer = { modem, modem_receive, modem_transmit, modem_next_event_us };
+
+  hal_sim_attach_uart(&peer);
+  hal_sim_attach_modem_pins(modem);
+}
+
+void hal_sim_attach_uart(const hal_sim_uart_peer_t* peer) {
+  uart_peer = *peer;
+  uart_connected = true;
+}
+
+void hal_sim_attach_modem_pins(modem_sim_t* modem) {
+  modem_pins = modem;
+  rings_seen = modem->rings;
+}
+
+void hal_sim_set_trace(FILE* trace_file) {
+  trace = trace_file;
+}
+
+// characters sent are traced per command (up to CR or CTRL-Z), and before anything else is traced
+static void trace_flush_tx(void) {
+  if (trace && trace_tx_length)
+    trace_write_data(trace, now_us, TRACE_TX, trace_tx, trace_tx_length);
+  trace_tx_length = 0;
+}
+
+void hal_sim_set_event_handler(uint64_t (*handler)(uint64_t now_us)) {
+  run_events = handler;
+  next_event_us = now_us;
+}
+
+uint64_t hal_sim_now_us(void) {
+  return now_us;
+}
+
+uint64_t hal_sim_boot_time_us(void) {
+  return boot_time_us;
+}
+
+uint64_t hal_sim_tx_chars(void) {
+  return tx_chars;
+}
+
+uint32_t hal_sim_watchdog_timeouts(void) {
+  return watchdog_timeouts;
+}
+
+uint32_t hal_sim_rx_overruns(void) {
+  return rx_overruns;
+}
+
+// moves characters that the modem has sent by now into the receive buffer
+static void uart_pump(void) {
+  char data[UART_RX_BUFFER_SIZE];
+  size_t l, i;
+
+  if (!uart_connected || (uart_rx_entries == UART_RX_BUFFER_SIZE))
+    return;
+  l = uart_peer.transmit(uart_peer.context, data, UART_RX_BUFFER_SIZE - uart_rx_entries, now_us);
+  if (l && trace) {
+    trace_flush_tx();
+    trace_write_data(trace, now_us, TRACE_RX, data, l);
+  }
+  for (i = 0; i < l; i++)
+    uart_rx_buffer[(uart_rx_position + uart_rx_entries++) % UART_RX_BUFFER_SIZE] = data[i];
+}
+
+// a pulse of RI is a falling edge for the handler, if one is installed
+static void ring_sample(void) {
+  if (modem_pins && (modem_pins->rings != rings_seen)) {
+    rings_seen = modem_pins->rings;
+    ring_pending = gpio_falling_edge_handler != NULL;
+  }
+}
+
+// advances virtual time up to end, running the scenario events and collecting modem output on the way
+// with stop_on_rx, returns as soon as characters have arrived (true), otherwise returns whether any are waiting
+// with stop_on_ring, also returns as soon as a falling edge of RI is pending
+static bool run_until(uint64_t end, bool stop_on_rx, bool stop_on_ring) {
+  uint64_t next;
+
+  while (true) {
+    while (run_events && (next_event_us <= now_us))
+      next_event_us = run_events(now_us);
+    uart_pump();
+    ring_sample();
+    if ((stop_on_rx && uart_rx_entries) || (stop_on_ring && ring_pending) || (now_us >= end))
+      return uart_rx_entries > 0;
+    next = end;
+    if (uart_connected && (uart_rx_entries < UART_RX_BUFFER_SIZE) && (uart_peer.next_event_us(uart_peer.context) < next))
+      next = uart_peer.next_event_us(uart_peer.context);
+    if (run_events && (next_event_us < next))
+      next = next_event_us;
+    now_us = next > now_us ? next : end;
+  }
+}
+
+// the watchdog reboots if the logic has not updated it within the timeout
+static void watchdog_check(void) {
+  if (watchdog_timeout_ms && (now_us - watchdog_last_update_us > (uint64_t)watchdog_timeout_ms * 1000)) {
+    watchdog_timeouts++;
+    hal_reboot();
+  }
+}
+
+void hal_sim_power_cycle(void) {
+  int i;
+
+  trace_flush_tx();
+  now_us = 0;
+  boot_time_us = 0;
+  next_event_us = 0;
+  uart_rx_handler = NULL;
+  uart_rx_entries = 0;
+  gpio_falling_edge_handler = NULL;
+  ring_pending = false;
+  interrupt_handled = false;
+  watchdog_timeout_ms = 0;
+  watchdog_reboot = false;
+  memset(&reboot_record, 0, sizeof(reboot_record));
+  for (i = 0; i < HAL_HOST_GPIO_PINS; i++)
+    gpio_value[i] = true;
+}
+
+void hal_init(void) {
+  int i;
+
+  for (i = 0; i < HAL_HOST_GPIO_PINS; i++)
+    gpio_value[i] = true;
+  memset(flash_memory, 0xff, sizeof(flash_memory));
+}
+
+uint64_t hal_time_us(void) {
+  return now_us - boot_time_us;
+}
+
+// received characters and RI pulses are handed to their handlers while sleeping, up to extended_end, but once the
+// requested time (end) is over, only until the next of them
+static void sleep_until(uint64_t end, uint64_t extended_end) {
+  bool rx;
+
+  while (now_us < extended_end) {
+    rx = run_until(extended_end, uart_rx_handler != NULL, true);
+    if (ring_pending) {
+      ring_pending = false;
+      interrupt_handled = true;
+      gpio_falling_edge_handler();
+    }
+    if (rx && uart_rx_handler) {
+      interrupt_handled = true;
+      uart_rx_handler();
+      if (now_us >= end)
+        break;
+    }
+  }
+  watchdog_check();
+}
+
+void hal_sleep_ms(uint32_t ms) {
+  uint64_t end = now_us + (uint64_t)ms * 1000;
+
+  sleep_until(end, end);
+}
+
+// when nothing is waiting to be handled, the sleep extends to the deadline given by the logic, or to the next scenario
+// event if that comes first (the logic then sees its effect straight away)
+void hal_idle(uint32_t min_ms, uint64_t until_us) {
+  uint64_t end = now_us + (uint64_t)min_ms * 1000;
+  uint64_t extended_end = end;
+
+  if (!uart_rx_entries && !interrupt_handled) {
+    if (boot_time_us + until_us > extended_end)
+      extended_end = boot_time_us + until_us;
+    if (run_events && (next_event_us < extended_end))
+      extended_end = next_event_us > end ? next_event_us : end;
+  }
+  sleep_until(end, extended_end);
+  interrupt_handled = false;
+}
+
+// the clock is not simulated, the logic accounts its residency itself
+void hal_clock_fast(bool fast) {
+  (void)fast;
+}
+
+void hal_uart_init(uint32_t baud_rate) {
+  (void)baud_rate;
+}
+
+void hal_uart_putc(char chr) {
+  now_us += MODEM_SIM_CHAR_TIME_US;
+  tx_chars++;
+  if (trace) {
+    trace_tx[trace_tx_length++] = chr;
+    if ((chr == '\r') || (chr == '\x1a') || (trace_tx_length == TRACE_DATA_LENGTH))
+      trace_flush_tx();
+  }
+  if (uart_connected)
+    uart_peer.receive(uart_peer.context, &chr, 1, now_us);
+  run_until(now_us, false, false);
+}
+
+bool hal_uart_is_readable(void) {
+  return run_until(now_us, false, false);
+}
+
+bool hal_uart_is_readable_within_us(uint32_t wait_us) {
+  return run_until(now_us + wait_us, true, false);
+}
+
+// the logic only reads after checking for data, so an empty buffer reads as 0 rather than blocking forever
+char hal_uart_getc(void) {
+  char chr;
+
+  if (!uart_rx_entries && !run_until(now_us + 1000000, true, false))
+    return 0;
+  chr = uart_rx_buffer[uart_rx_position];
+  uart_rx_position = (uart_rx_position + 1) % UART_RX_BUFFER_SIZE;
+  uart_rx_entries--;
+
+  return chr;
+}
+
+void hal_uart_set_rx_handler(void (*handler)(void)) {
+  uart_rx_handler = handler;
+}
+
+void hal_gpio_init_input_pullup(unsigned int pin) {
+  (void)pin;
+}
+
+void hal_gpio_init_output(unsigned int pin) {
+  (void)pin;
+}
+
+bool hal_gpio_get(unsigned int pin) {
+  return (pin < HAL_HOST_GPIO_PINS) ? gpio_value[pin] : false;
+}
+
+void hal_gpio_put(unsigned int pin, bool value) {
+  if (modem_pins && (pin == GPIO_PIN_MODEM_DTR))
+    modem_sim_set_dtr(modem_pins, value, now_us);
+  if (pin < HAL_HOST_GPIO_PINS)
+    gpio_value[pin] = value;
+}
+
+void hal_gpio_set_falling_edge_handler(unsigned int pin, void (*handler)(void)) {
+  (void)pin;
+  gpio_falling_edge_handler = handler;
+}
+
+void hal_host_set_gpio(unsigned int pin, bool value) {
+  if (pin < HAL_HOST_GPIO_PINS) {
+    if (trace && (gpio_value[pin] != value)) {
+      trace_flush_tx();
+      trace_write_gpio(trace, now_us, pin, value);
+    }
+    gpio_value[pin] = value;
+  }
+}
+
+void hal_flash_read(uint8_t* data, size_t length) {
+  if (length > sizeof(flash_memory))
+    length = sizeof(flash_memory);
+  memcpy(data, flash_memory, length);
+}
+
+void hal_sim_load_flash(const uint8_t* data, size_t length) {
+  if (length > sizeof(flash_memory))
+    length = sizeof(flash_memory);
+  memset(flash_memory, 0xff, sizeof(flash_memory));
+  memcpy(flash_memory, data, length);
+}
+
+// the modem output of the write time goes into the FIFO until it is full, the rest of it is lost
+void hal_flash_write(const uint8_t* data, size_t length) {
+  char data_rx[UART_RX_BUFFER_SIZE];
+  int fifo_free;
+  size_t l, i;
+
+  hal_sim_load_flash(data, length);
+  if (length > sizeof(flash_memory))
+    length = sizeof(flash_memory);
+  run_until(now_us, false, false);
+  fifo_free = (uart_rx_entries < UART_RX_FIFO_SIZE) ? UART_RX_FIFO_SIZE - uart_rx_entries : 0;
+  now_us += FLASH_SECTOR_ERASE_US + (length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_PROGRAM_US;
+  while (uart_connected && (l = uart_peer.transmit(uart_peer.context, data_rx, sizeof(data_rx), now_us))) {
+    if (trace) {
+      trace_flush_tx();
+      trace_write_data(trace, now_us, TRACE_RX, data_rx, l);
+    }
+    for (i = 0; i < l; i++) {
+      if (fifo_free) {
+        uart_rx_buffer[(uart_rx_position + uart_rx_entries++) % UART_RX_BUFFER_SIZE] = data_rx[i];
+        fifo_free--;
+      }
+      else
+        rx_overruns++;
+    }
+  }
+}
+
+void hal_watchdog_enable(uint32_t timeout_ms) {
+  watchdog_timeout_ms = timeout_ms;
+  watchdog_last_update_us = now_us;
+}
+
+void hal_watchdog_update(void) {
+  watchdog_last_update_us = now_us;
+}
+
+bool hal_watchdog_caused_reboot(void) {
+  return watchdog_reboot;
+}
+
+// the Pico reboots through the watchdog, which is then disabled again, the receive buffer and handlers are gone, the
+// GPIO outputs are released (the modem pulls DTR high), and the no-init RAM (reboot_record) survives
+void hal_reboot(void) {
+  watchdog_reboot = true;
+  watchdog_timeout_ms = 0;
+  uart_rx_handler = NULL;
+  uart_rx_entries = 0;
+  gpio_falling_edge_handler = NULL;
+  ring_pending = false;
+  interrupt_handled = false;
+  hal_gpio_put(GPIO_PIN_MODEM_DTR, true);
+  boot_time_us = now_us;
+  longjmp(hal_sim_reboot, 1);
+}
+
+// the stack is not measured in the simulation
+void hal_stack_paint(void) {
+}
+
+uint32_t hal_stack_check(uint32_t* stack_size) {
+  *stack_size = 0;
+  return 0;
+}
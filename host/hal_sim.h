@@ -0,0 +1,55 @@
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "modem_sim.h"
+
+// implementation of the hardware abstraction in virtual time, for simulations in a single process (hal_sim.c)
+// the UART is connected to a simulated modem, time only advances while the logic sleeps or waits for (or sends)
+// characters, and it jumps straight to the next deadline, so months of operation pass in seconds
+
+// reboots return here (longjmp), the simulation driver then runs dialler_setup again
+extern jmp_buf hal_sim_reboot;
+
+// the device at the other end of the UART, driven by explicit timestamps like the simulated modem
+typedef struct {
+  void* context;
+  void (*receive)(void* context, const char* data, size_t length, uint64_t now_us);
+  size_t (*transmit)(void* context, char* data, size_t length, uint64_t now_us);
+  uint64_t (*next_event_us)(void* context);
+} hal_sim_uart_peer_t;
+
+// connects the simulated modem, or another peer (e.g. a recorded trace), to the UART
+// attaching the modem also connects its DTR and RI lines (hal_sim_attach_modem_pins), for a modem behind another peer
+// they are connected separately
+void hal_sim_attach_modem(modem_sim_t* modem);
+void hal_sim_attach_uart(const hal_sim_uart_peer_t* peer);
+void hal_sim_attach_modem_pins(modem_sim_t* modem);
+
+// records the UART traffic and the input changes (hal_host_set_gpio) in the trace format of trace.h
+void hal_sim_set_trace(FILE* trace);
+
+// power cycle: the virtual clock starts again at 0 and the no-init RAM is lost, the flash keeps its content
+void hal_sim_power_cycle(void);
+
+// fills the flash without taking time, as a programmer would before power-up (hal_flash_write takes as long as on the
+// Pico)
+void hal_sim_load_flash(const uint8_t* data, size_t length);
+
+// scenario events of the simulation driver, run_events runs all events due by now_us and returns the time of the next one
+void hal_sim_set_event_handler(uint64_t (*run_events)(uint64_t now_us));
+
+// absolute virtual time since the start of the simulation, and of the last (simulated) boot
+uint64_t hal_sim_now_us(void);
+uint64_t hal_sim_boot_time_us(void);
+
+// number of characters transmitted to the modem, reboots by watchdog timeout, and characters from the modem lost while
+// writing the flash (receive FIFO overrun)
+uint64_t hal_sim_tx_chars(void);
+uint32_t hal_sim_watchdog_timeouts(void);
+uint32_t hal_sim_rx_overruns(void);
+
+#endif
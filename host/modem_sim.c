@@ -0,0 +1,926 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modem_sim.h"
+
+#define CR '\x0D'
+#define LF '\x0A'
+#define CTRL_Z '\x1A'
+#define ESC '\x1B'
+
+// queues output for the terminal equipment after the specified delay
+// output is serialised at the UART speed, so each chunk is due no earlier than the end of the previous one
+static void queue_output(modem_sim_t* sim, const char* text, uint32_t delay_us, uint64_t now_us) {
+  modem_sim_chunk_t* chunk;
+  uint64_t due;
+  int length = (int)strlen(text);
+
+  if (sim->queue_entries == MODEM_SIM_QUEUE_LENGTH) {
+    sim->queue_overflows++;
+    return;
+  }
+  if (length > MODEM_SIM_LINE_LENGTH)
+    length = MODEM_SIM_LINE_LENGTH;
+  due = now_us + delay_us;
+  if (due < sim->last_due_us)
+    due = sim->last_due_us;
+  due += (uint64_t)length * MODEM_SIM_CHAR_TIME_US;
+  sim->last_due_us = due;
+  chunk = &sim->queue[(sim->queue_read + sim->queue_entries++) % MODEM_SIM_QUEUE_LENGTH];
+  chunk->due_us = due;
+  chunk->length = length;
+  chunk->sent = 0;
+  memcpy(chunk->data, text, length);
+}
+
+// small deterministic random number generator (xorshift), so simulations can be repeated
+uint32_t modem_sim_random(modem_sim_t* sim) {
+  uint32_t x = sim->random_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sim->random_state = x;
+
+  return x;
+}
+
+// decides whether to inject a protocol fault, and reports it
+// no random number is drawn for faults that are disabled, so runs without faults are not changed by them
+static bool inject_fault(modem_sim_t* sim, int fault, uint64_t now_us) {
+  if ((sim->fault_permille[fault] <= 0) || ((int)(modem_sim_random(sim) % 1000) >= sim->fault_permille[fault]))
+    return false;
+  sim->faults[fault]++;
+  if (sim->fault)
+    sim->fault(sim->fault_context, fault, now_us);
+
+  return true;
+}
+
+// queues a line framed as the modem does, with CR LF before and after
+// a final OK may go missing, a line may be preceded by random bytes, or cut short without its CR LF
+static void queue_line(modem_sim_t* sim, const char* line, uint32_t delay_us, uint64_t now_us) {
+  char framed[MODEM_SIM_LINE_LENGTH];
+  char garbage[9];
+  int i, n;
+
+  if (!strcmp(line, "OK") && inject_fault(sim, MODEM_SIM_FAULT_MISSING_OK, now_us))
+    return;
+  if (inject_fault(sim, MODEM_SIM_FAULT_GARBAGE, now_us)) {
+    n = 1 + modem_sim_random(sim) % (sizeof(garbage) - 1);
+    for (i = 0; i < n; i++)
+      garbage[i] = (char)(1 + modem_sim_random(sim) % 255);
+    garbage[n] = 0;
+    queue_output(sim, garbage, delay_us, now_us);
+    delay_us = 0;
+  }
+  snprintf(framed, sizeof(framed), "\r\n%s\r\n", line);
+  if (line[0] && inject_fault(sim, MODEM_SIM_FAULT_TRUNCATED, now_us))
+    framed[2 + modem_sim_random(sim) % strlen(line)] = 0;
+  queue_output(sim, framed, delay_us, now_us);
+}
+
+// sleep mode (AT+CSCLK=1): the modem falls asleep once DTR is high and it has been quiet for sleep_delay_us, its UART
+// is then off and characters sent to it are lost
+// the state is brought up to date at each interaction, with the time the modem actually fell asleep
+static void update_sleep(modem_sim_t* sim, uint64_t now_us) {
+  uint64_t start = (sim->activity_us > sim->last_due_us ? sim->activity_us : sim->last_due_us) + sim->sleep_delay_us;
+
+  if (!sim->asleep && sim->sleep_clock && sim->dtr && !sim->booting && !sim->in_prompt && (now_us >= start)) {
+    sim->asleep = true;
+    sim->sleep_start_us = start;
+  }
+}
+
+// splits a sleep from start_us to end_us into the time in eDRX and in PSM, the modem enters PSM once the active time
+// has passed, before that it is in eDRX if enabled (otherwise in plain sleep mode)
+static void sleep_split(const modem_sim_t* sim, uint64_t start_us, uint64_t end_us, uint64_t* edrx_us, uint64_t* psm_us) {
+  uint64_t light_us = end_us - start_us;
+
+  *psm_us = 0;
+  if (sim->psm && (light_us > sim->psm_active_us)) {
+    *psm_us = light_us - sim->psm_active_us;
+    light_us = sim->psm_active_us;
+  }
+  *edrx_us = sim->edrx ? light_us : 0;
+}
+
+// the modem wakes up (or stays awake), its UART works again after wake_time_us (psm_wake_time_us from PSM), and the
+// network delivers what it has held back from then on
+// returns whether it has been asleep
+static bool wake(modem_sim_t* sim, uint64_t now_us) {
+  uint64_t edrx_us, psm_us;
+  bool asleep;
+  int i;
+
+  update_sleep(sim, now_us);
+  asleep = sim->asleep;
+  if (asleep) {
+    sleep_split(sim, sim->sleep_start_us, now_us, &edrx_us, &psm_us);
+    sim->asleep = false;
+    sim->sleep_time_us += now_us - sim->sleep_start_us;
+    sim->edrx_time_us += edrx_us;
+    sim->psm_time_us += psm_us;
+    sim->uart_ready_us = now_us + (psm_us ? sim->psm_wake_time_us : sim->wake_time_us);
+    for (i = 0; i < sim->deferred_entries; i++)
+      if (sim->deferred[i].due_us > sim->uart_ready_us)
+        sim->deferred[i].due_us = sim->uart_ready_us;
+  }
+  sim->activity_us = now_us;
+
+  return asleep;
+}
+
+// time at which the network reaches the modem for an SMS or call arriving now: straight away while it is awake or in
+// plain sleep mode, at the next paging occasion in eDRX, and at the next periodic tracking area update in PSM
+static uint64_t reachable_us(modem_sim_t* sim, uint64_t now_us) {
+  uint64_t psm_start_us, paging_us;
+
+  update_sleep(sim, now_us);
+  if (!sim->asleep || (!sim->psm && !sim->edrx))
+    return now_us;
+  psm_start_us = sim->sleep_start_us + sim->psm_active_us;
+  if (sim->psm && (now_us >= psm_start_us))
+    return psm_start_us + ((now_us - psm_start_us) / sim->psm_tau_us + 1) * sim->psm_tau_us;
+  if (!sim->edrx)
+    return now_us;
+  paging_us = sim->sleep_start_us + ((now_us - sim->sleep_start_us) / sim->edrx_cycle_us + 1) * sim->edrx_cycle_us;
+  if (sim->psm && (paging_us >= psm_start_us))
+    return psm_start_us + sim->psm_tau_us;
+
+  return paging_us;
+}
+
+// the network holds back an SMS or call until due_us, returns false if its list is full
+static bool defer(modem_sim_t* sim, bool call, const char* sender, const char* text, uint64_t due_us, uint64_t now_us) {
+  modem_sim_deferred_t* entry;
+
+  if (sim->deferred_entries == MODEM_SIM_DEFERRED_LENGTH)
+    return false;
+  entry = &sim->deferred[sim->deferred_entries++];
+  entry->arrival_us = now_us;
+  entry->due_us = due_us;
+  entry->call = call;
+  snprintf(entry->sender, sizeof(entry->sender), "%s", sender);
+  snprintf(entry->text, sizeof(entry->text), "%s", text);
+
+  return true;
+}
+
+// queues an unsolicited result code, which may be sent twice
+// RI pulses low for each, and in sleep mode the modem wakes up to send it
+static void queue_urc(modem_sim_t* sim, const char* line, uint64_t now_us) {
+  uint32_t delay_us = wake(sim, now_us) ? (uint32_t)(sim->uart_ready_us - now_us) : 0;
+
+  sim->rings++;
+  queue_line(sim, line, delay_us, now_us);
+  if (inject_fault(sim, MODEM_SIM_FAULT_DUPLICATE, now_us))
+    queue_line(sim, line, 0, now_us);
+}
+
+// the modem restarts, it is gone for reset_time_us and then reports with its start-up messages (check_ready)
+static void restart(modem_sim_t* sim, uint64_t now_us) {
+  wake(sim, now_us);
+  sim->sleep_clock = false;
+  sim->psm = false;
+  sim->edrx = false;
+  sim->time_zone_report = false;
+  sim->waking = false;
+  sim->booting = true;
+  sim->ready_time_us = now_us + sim->reset_time_us;
+  sim->registered_us = sim->ready_time_us + sim->search_time_us;
+  sim->final_result_us = 0;
+  sim->echo = true;
+  sim->text_mode = false;
+  strcpy(sim->memory, "SM");
+  sim->direct_sms = false;
+  sim->in_prompt = false;
+  sim->call_active = false;
+  sim->line_length = 0;
+}
+
+void modem_sim_init(modem_sim_t* sim, uint32_t seed) {
+  memset(sim, 0, sizeof(*sim));
+  sim->latency_us = 20000;
+  sim->prompt_latency_us = 20000;
+  sim->reset_time_us = 15000000;
+  sim->search_time_us = 45000000;
+  sim->cached_search_time_us = 4000000;
+  sim->wake_time_us = 20000;
+  sim->sleep_delay_us = 1000000;
+  sim->psm_wake_time_us = 1000000;
+  sim->dtr = true;
+  sim->online = true;
+  sim->csq = 20;
+  sim->echo = true;
+  sim->model = "A7670E";
+  strcpy(sim->imei, "860000041234561");
+  strcpy(sim->revision, "A011B07A7670M7");
+  strcpy(sim->memory, "SM");
+  sim->random_state = seed ? seed : 0x2545f491;
+}
+
+// whether the modem has network service, which it only has once it has registered after a restart
+static bool registered(const modem_sim_t* sim, uint64_t now_us) {
+  return sim->online && (now_us >= sim->registered_us);
+}
+
+// the modem is ready again after a reset, and reports with its start-up messages, then registers with the network
+static void check_ready(modem_sim_t* sim, uint64_t now_us) {
+  if (sim->booting && (now_us >= sim->ready_time_us)) {
+    sim->booting = false;
+    sim->last_due_us = sim->ready_time_us;
+    queue_line(sim, "RDY", 0, sim->ready_time_us);
+    if (sim->quectel)
+      queue_line(sim, "APP RDY", 0, sim->ready_time_us);
+    queue_line(sim, "+CPIN: READY", 0, sim->ready_time_us);
+    queue_line(sim, sim->quectel ? "+QIND: SMS DONE" : "SMS DONE", 0, sim->ready_time_us);
+    queue_line(sim, sim->quectel ? "+QIND: PB DONE" : "PB DONE", 0, sim->ready_time_us);
+    if (sim->online)
+      modem_sim_network_time(sim, sim->ready_time_us);
+  }
+}
+
+// network time by now, in milliseconds since 1970 (UTC)
+uint64_t modem_sim_network_time_ms(const modem_sim_t* sim, uint64_t now_us) {
+  return (uint64_t)MODEM_SIM_NETWORK_TIME_S * 1000 + now_us / 1000 + (int64_t)(now_us / 1000) * sim->clock_ppm / 1000000;
+}
+
+// the modem clock as reported by +CCLK, local time with the zone in quarter hours, from 1970 until the network time has
+// set it
+static void clock_response(const modem_sim_t* sim, char* response, size_t size, uint64_t now_us) {
+  time_t local_s = 0;
+  struct tm local;
+
+  if (sim->clock_set)
+    local_s = (time_t)(modem_sim_network_time_ms(sim, now_us) / 1000) + MODEM_SIM_TIME_ZONE * 900;
+  gmtime_r(&local_s, &local);
+  snprintf(response, size, "+CCLK: \"%02d/%02d/%02d,%02d:%02d:%02d%+03d\"", local.tm_year % 100, local.tm_mon + 1,
+           local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec, sim->clock_set ? MODEM_SIM_TIME_ZONE : 0);
+}
+
+// decodes a GPRS timer 2 (T3324) or GPRS timer 3 (T3412) of 3GPP TS 24.008, given as a string of 8 bits with the unit
+// in bits 8 to 6 and the value in bits 5 to 1
+// returns the time in microseconds, 0 if the timer is deactivated or the string is not valid
+static uint64_t gprs_timer_us(const char* bits, bool timer3) {
+  static const uint64_t timer2_unit_s[8] = { 2, 60, 360, 60, 60, 60, 60, 0 };
+  static const uint64_t timer3_unit_s[8] = { 600, 3600, 36000, 2, 30, 60, 1152000, 0 };
+  int i, value = 0;
+
+  if (strlen(bits) != 8)
+    return 0;
+  for (i = 0; i < 8; i++) {
+    if ((bits[i] != '0') && (bits[i] != '1'))
+      return 0;
+    value = (value << 1) | (bits[i] - '0');
+  }
+
+  return (timer3 ? timer3_unit_s : timer2_unit_s)[value >> 5] * (value & 0x1f) * 1000000;
+}
+
+// copies field index of a comma-separated setting, without quotes, returns false if there is no such field
+static bool setting_field(const char* setting, int index, char* field, int size) {
+  int l = 0;
+
+  while (index && *setting)
+    if (*setting++ == ',')
+      index--;
+  if (index)
+    return false;
+  while (*setting && (*setting != ',') && (l < size - 1))
+    if (*setting++ != '"')
+      field[l++] = setting[-1];
+  field[l] = 0;
+
+  return true;
+}
+
+// AT+CPSMS=<mode>,,,<T3412>,<T3324>: the requested timers are taken as granted by the network
+static bool power_saving_mode(modem_sim_t* sim, const char* setting) {
+  char field[16];
+  uint64_t tau_us, active_us;
+
+  if (atoi(setting) != 1) {
+    sim->psm = false;
+    return true;
+  }
+  if (!setting_field(setting, 3, field, sizeof(field)) || !(tau_us = gprs_timer_us(field, true)))
+    return false;
+  if (!setting_field(setting, 4, field, sizeof(field)) || !(active_us = gprs_timer_us(field, false)))
+    return false;
+  sim->psm = true;
+  sim->psm_tau_us = tau_us;
+  sim->psm_active_us = active_us;
+
+  return true;
+}
+
+// AT+CEDRXS=<mode>,<access technology>,<eDRX value>: the cycle is 5.12 s times the factor of the 4 bit value (E-UTRAN)
+static bool extended_drx(modem_sim_t* sim, const char* setting) {
+  static const uint32_t cycle_factor[16] = { 1, 2, 4, 8, 12, 16, 20, 24, 28, 32, 64, 128, 256, 512, 1024, 2048 };
+  char field[16];
+  int i, value = 0;
+
+  if ((atoi(setting) != 1) && (atoi(setting) != 2)) {
+    sim->edrx = false;
+    return true;
+  }
+  if (!setting_field(setting, 2, field, sizeof(field)) || (strlen(field) != 4))
+    return false;
+  for (i = 0; i < 4; i++) {
+    if ((field[i] != '0') && (field[i] != '1'))
+      return false;
+    value = (value << 1) | (field[i] - '0');
+  }
+  sim->edrx = true;
+  sim->edrx_cycle_us = (uint64_t)cycle_factor[value] * 5120000;
+
+  return true;
+}
+
+// results of extended commands
+#define COMMAND_OK        0
+#define COMMAND_ERROR     1
+#define COMMAND_REPORTED  2
+
+// handles one extended command (starting with "+") of a command line
+// info responses are queued directly, as are error reports other than plain ERROR (COMMAND_REPORTED)
+// responses to the test commands the modem supports, as the A7670E answers them (the Quectel modules only differ in
+// the details)
+static const char* const test_responses[] = {
+  "+CNMI: (0-2),(0-3),(0,2),(0-2),(0,1)",
+  "+CPSMS: (0,1),,,(\"00000000\"-\"11111111\"),(\"00000000\"-\"11111111\")",
+  "+CEDRXS: (0-3),(2,4,5),(\"0000\"-\"1111\")",
+  "+CMUX: (0),(0),(1-7),(1-1500),(0-255),(0-100),(2-255),(1-255),(1-7)",
+  "+IPR: (300,600,1200,2400,4800,9600,19200,38400,57600,115200,230400,460800,921600,3000000,3200000,3686400)",
+  "+CMGF: (0,1)",
+  "+CSQ: (0-31,99),(0-7,99)"
+};
+
+// answers a test command (e.g. AT+CNMI=?) with the parameters the command takes, ERROR for unknown commands
+static int test_command(modem_sim_t* sim, const char* command, uint64_t now_us) {
+  int i, l = (int)strlen(command) - 2;
+
+  sim->test_commands++;
+  for (i = 0; i < (int)(sizeof(test_responses) / sizeof(test_responses[0])); i++)
+    if (!strncmp(test_responses[i], command, l) && (test_responses[i][l] == ':')) {
+      queue_line(sim, test_responses[i], sim->latency_us, now_us);
+      return COMMAND_OK;
+    }
+
+  return COMMAND_ERROR;
+}
+
+static int extended_command(modem_sim_t* sim, const char* command, uint64_t now_us) {
+  char response[MODEM_SIM_LINE_LENGTH];
+  const char* q;
+  int i, used;
+
+  q = strstr(command, "=?");
+  if (q && !q[2])
+    return test_command(sim, command, now_us);
+  if (!strncmp(command, "+CMGF=", 6))
+    sim->text_mode = command[6] == '1';
+  else if (!strncmp(command, sim->quectel ? "+QSCLK=" : "+CSCLK=", 7))
+    sim->sleep_clock = command[7] == '1';
+  else if (!strncmp(command, "+CPSMS=", 7)) {
+    if (!power_saving_mode(sim, &command[7]))
+      return COMMAND_ERROR;
+  }
+  else if (!strncmp(command, "+CEDRXS=", 8)) {
+    if (!extended_drx(sim, &command[8]))
+      return COMMAND_ERROR;
+  }
+  else if (!strncmp(command, "+CTZU=", 6))
+    sim->time_zone_update = command[6] == '1';
+  else if (!strncmp(command, "+CTZR=", 6))
+    sim->time_zone_report = command[6] == '1';
+  else if (!strcmp(command, "+CCLK?")) {
+    clock_response(sim, response, sizeof(response), now_us);
+    queue_line(sim, response, sim->latency_us, now_us);
+  }
+  else if (!strncmp(command, "+CNMI=", 6)) {
+    q = strchr(command, ',');
+    sim->direct_sms = q && (q[1] == '2');
+  }
+  else if (!strncmp(command, "+CSCS=", 6) || !strncmp(command, "+CGEREP=", 8) || \
+           !strncmp(command, "+CVHU=", 6) || !strncmp(command, "+CLIP=", 6) || !strncmp(command, "+CNMP=", 6) || \
+           !strncmp(command, "+CLCC=", 6) || (sim->quectel && !strncmp(command, "+QCFG=", 6)))
+    ;
+  else if (!strncmp(command, "+CPMS=", 6)) {
+    if ((command[6] == '"') && command[7] && command[8]) {
+      sim->memory[0] = command[7];
+      sim->memory[1] = command[8];
+      sim->memory[2] = 0;
+    }
+    used = 0;
+    for (i = 0; i < MODEM_SIM_STORAGE_SLOTS; i++)
+      used += sim->storage[i].used;
+    snprintf(response, sizeof(response), "+CPMS: %d,%d,%d,%d,%d,%d", used, MODEM_SIM_STORAGE_SLOTS, used,
+             MODEM_SIM_STORAGE_SLOTS, used, MODEM_SIM_STORAGE_SLOTS);
+    queue_line(sim, response, sim->latency_us, now_us);
+  }
+  else if (!strncmp(command, "+CMGD=", 6)) {
+    i = atoi(&command[6]);
+    q = strchr(command, ',');
+    if (q && (atoi(q + 1) == 4))
+      for (i = 0; i < MODEM_SIM_STORAGE_SLOTS; i++)
+        sim->storage[i].used = false;
+    else if ((i >= 0) && (i < MODEM_SIM_STORAGE_SLOTS))
+      sim->storage[i].used = false;
+    else
+      return COMMAND_ERROR;
+  }
+  else if (!strncmp(command, "+CMGR=", 6)) {
+    i = atoi(&command[6]);
+    if ((i < 0) || (i >= MODEM_SIM_STORAGE_SLOTS) || !sim->storage[i].used) {
+      queue_line(sim, "+CMS ERROR: 321", sim->latency_us, now_us);
+      return COMMAND_REPORTED;
+    }
+    snprintf(response, sizeof(response), "+CMGR: \"%s\",\"%s\",\"\",\"26/10/18,12:00:00+04\"",
+             sim->storage[i].read ? "REC READ" : "REC UNREAD", sim->storage[i].sender);
+    queue_line(sim, response, sim->latency_us, now_us);
+    snprintf(response, sizeof(response), "%s\r\n", sim->storage[i].text);
+    queue_output(sim, response, 0, now_us);
+    sim->storage[i].read = true;
+  }
+  else if (!strcmp(command, "+CGSN"))
+    queue_line(sim, sim->imei, sim->latency_us, now_us);
+  else if (!strcmp(command, "+CGMR")) {
+    snprintf(response, sizeof(response), sim->quectel ? "%s" : "+CGMR: %s", sim->revision);
+    queue_line(sim, response, sim->latency_us, now_us);
+  }
+  else if (!strcmp(command, "+CSQ")) {
+    snprintf(response, sizeof(response), "+CSQ: %d,99", sim->csq);
+    queue_line(sim, response, sim->latency_us, now_us);
+  }
+  else if (!strcmp(command, "+CREG?")) {
+    snprintf(response, sizeof(response), "+CREG: 0,%d", registered(sim, now_us) ? 1 : 2);
+    queue_line(sim, response, sim->latency_us, now_us);
+  }
+// manual selection with automatic fallback finds the network quickly if it is the one the modem is on, otherwise the
+// full search goes on, either way the command only completes once the modem has registered (ERROR without network)
+  else if (!strncmp(command, "+COPS=", 6)) {
+    snprintf(response, sizeof(response), "+COPS=4,2,\"%s\",%d", MODEM_SIM_PLMN, MODEM_SIM_RAT);
+    if (!strcmp(command, response) && (sim->registered_us > now_us + sim->cached_search_time_us))
+      sim->registered_us = (now_us > sim->ready_time_us ? now_us : sim->ready_time_us) + sim->cached_search_time_us;
+    if (!strncmp(command, "+COPS=4", 7)) {
+      if (!sim->online)
+        return COMMAND_ERROR;
+      sim->final_result_us = sim->registered_us;
+    }
+  }
+  else if (!sim->quectel && !strcmp(command, "+CPSI?")) {
+    if (registered(sim, now_us))
+      queue_line(sim, "+CPSI: LTE,Online,234-10,0x0A2B,26451713,289,EUTRAN-BAND20,6300,3,3,-92,-1031,-735,14",
+                 sim->latency_us, now_us);
+    else
+      queue_line(sim, "+CPSI: NO SERVICE,Offline", sim->latency_us, now_us);
+  }
+  else if (sim->quectel && !strcmp(command, "+QNWINFO")) {
+    if (registered(sim, now_us))
+      queue_line(sim, "+QNWINFO: \"FDD LTE\",\"23410\",\"LTE BAND 20\",6300", sim->latency_us, now_us);
+    else
+      queue_line(sim, "+QNWINFO: No Service", sim->latency_us, now_us);
+  }
+  else if (!strcmp(command, "+CHUP")) {
+    if (sim->call_active && !sim->quectel)
+      queue_line(sim, "+CLCC: 1,1,6,0,0,\"\",129", sim->latency_us, now_us);
+    sim->call_active = false;
+  }
+  else
+    return COMMAND_ERROR;
+
+  return COMMAND_OK;
+}
+
+// the product identification of ATI, as a SIMCom or Quectel module reports it
+static void identification(modem_sim_t* sim, uint64_t now_us) {
+  char lines[MODEM_SIM_LINE_LENGTH];
+
+  if (sim->quectel)
+    snprintf(lines, sizeof(lines), "Quectel\r\n%s\r\nRevision: %s", sim->model, sim->revision);
+  else
+    snprintf(lines, sizeof(lines), "Manufacturer: SIMCOM INCORPORATED\r\nModel: %s\r\nRevision: %s\r\nIMEI: %s",
+             sim->model, sim->revision, sim->imei);
+  queue_line(sim, lines, sim->latency_us, now_us);
+}
+
+// handles one command line from the terminal equipment
+static void command_line(modem_sim_t* sim, char* line, uint64_t now_us) {
+  char* p = line;
+  char* next;
+  int result = COMMAND_OK;
+
+// as in V.250, anything before the "AT" prefix is ignored (e.g. SMS text sent while there was no prompt)
+  while (*p && (((p[0] != 'A') && (p[0] != 'a')) || ((p[1] != 'T') && (p[1] != 't'))))
+    p++;
+  if (!*p)
+    return;
+  sim->commands++;
+  sim->final_result_us = 0;
+// a modem that is restarting (or hanging) does not respond at all
+  if (sim->booting || sim->hung)
+    return;
+  if ((int)(modem_sim_random(sim) % 100) < sim->error_percent) {
+    sim->errors_injected++;
+    queue_line(sim, "ERROR", sim->latency_us, now_us);
+    return;
+  }
+  p += 2;
+
+// basic commands come first, e.g. ATE0&D0V1
+  while (*p && (*p != '+') && (*p != ';')) {
+    if (*p == 'E') {
+      sim->echo = p[1] == '1';
+      p += 2;
+    }
+    else if ((*p == 'V') || (*p == 'Z'))
+      p += (p[1] >= '0') && (p[1] <= '9') ? 2 : 1;
+    else if ((*p == '&') && p[1])
+      p += (p[2] >= '0') && (p[2] <= '9') ? 3 : 2;
+    else if (*p == 'H') {
+      sim->call_active = false;
+      p++;
+    }
+    else if (*p == 'I') {
+      identification(sim, now_us);
+      p += (p[1] >= '0') && (p[1] <= '9') ? 2 : 1;
+    }
+    else {
+      result = COMMAND_ERROR;
+      break;
+    }
+  }
+
+// AT+CRESET (AT+CFUN=1,1 on Quectel modules) answers OK, then the modem is gone for a while and reports with its
+// start-up messages
+  if ((result == COMMAND_OK) && !strcmp(p, sim->quectel ? "+CFUN=1,1" : "+CRESET")) {
+    queue_line(sim, "OK", sim->latency_us, now_us);
+    sim->resets++;
+    restart(sim, now_us);
+    return;
+  }
+
+// AT+CMGS="number" opens the prompt for the SMS text
+  if ((result == COMMAND_OK) && !strncmp(p, "+CMGS=", 6)) {
+    snprintf(sim->prompt_number, sizeof(sim->prompt_number), "%s", &p[6]);
+    next = sim->prompt_number;
+    if (*next == '"')
+      memmove(next, next + 1, strlen(next));
+    if ((next = strchr(sim->prompt_number, '"')))
+      *next = 0;
+    sim->in_prompt = true;
+    sim->text_length = 0;
+    queue_output(sim, "\r\n> ", sim->prompt_latency_us, now_us);
+    return;
+  }
+
+// extended commands, separated by ";"
+  while ((result == COMMAND_OK) && *p) {
+    if (*p == ';')
+      p++;
+    if (!*p)
+      break;
+    next = strchr(p, ';');
+    if (next)
+      *next = 0;
+    result = extended_command(sim, p, now_us);
+    p = next ? next + 1 : p + strlen(p);
+  }
+
+  if ((result == COMMAND_OK) && (sim->final_result_us > now_us + sim->latency_us))
+    queue_line(sim, "OK", (uint32_t)(sim->final_result_us - now_us), now_us);
+  else if (result == COMMAND_OK)
+    queue_line(sim, "OK", sim->latency_us, now_us);
+  else if (result == COMMAND_ERROR)
+    queue_line(sim, "ERROR", sim->latency_us, now_us);
+}
+
+// the SMS text is complete (CTRL-Z), the modem sends it and reports the message reference
+static void sms_complete(modem_sim_t* sim, uint64_t now_us) {
+  char response[MODEM_SIM_LINE_LENGTH];
+
+  sim->text[sim->text_length] = 0;
+  sim->in_prompt = false;
+  if (!registered(sim, now_us)) {
+    queue_line(sim, "+CMS ERROR: 331", sim->latency_us, now_us);
+    return;
+  }
+  sim->sms_sent_count++;
+  if (sim->sms_sent)
+    sim->sms_sent(sim->sms_sent_context, sim->prompt_number, sim->text, now_us + sim->latency_us);
+  snprintf(response, sizeof(response), "+CMGS: %d", sim->message_reference++ & 0xff);
+  queue_line(sim, response, sim->latency_us, now_us);
+  queue_line(sim, "OK", 0, now_us);
+}
+
+// data from the terminal equipment (the Pico) to the modem
+// echo (while enabled) is collected and queued before any response to the command it belongs to
+// a command line is echoed after the processing latency, back to back with its result: AlarmDial ends a response when
+// no character arrives within CHAR_INTERVAL_US, so a gap between echo and result would split them
+void modem_sim_receive(modem_sim_t* sim, const char* data, size_t length, uint64_t now_us) {
+  char echo[MODEM_SIM_LINE_LENGTH];
+  int echo_length = 0;
+  size_t i;
+  char chr;
+
+  check_ready(sim, now_us);
+// the characters are lost if the UART is off, the latency of a wake-up by DTR is measured up to the start of the first
+// one after it
+  update_sleep(sim, now_us);
+  if (sim->asleep || (now_us < sim->uart_ready_us + MODEM_SIM_CHAR_TIME_US)) {
+    sim->sleep_lost_chars += length;
+    return;
+  }
+  if (sim->waking) {
+    sim->waking = false;
+    sim->wake_latency_sum_us += now_us - MODEM_SIM_CHAR_TIME_US - sim->wake_request_us;
+    if (now_us - MODEM_SIM_CHAR_TIME_US - sim->wake_request_us > sim->wake_latency_max_us)
+      sim->wake_latency_max_us = now_us - MODEM_SIM_CHAR_TIME_US - sim->wake_request_us;
+  }
+  sim->activity_us = now_us;
+  for (i = 0; i < length; i++) {
+    chr = data[i];
+    if (sim->echo && !sim->booting && (echo_length < MODEM_SIM_LINE_LENGTH - 1))
+      echo[echo_length++] = chr;
+    if ((echo_length && ((chr == CR) || (chr == CTRL_Z))) || (echo_length == MODEM_SIM_LINE_LENGTH - 1)) {
+      echo[echo_length] = 0;
+      queue_output(sim, echo, chr == CR ? sim->latency_us : 0, now_us);
+      echo_length = 0;
+    }
+    if (sim->in_prompt) {
+      if (chr == CTRL_Z)
+        sms_complete(sim, now_us);
+      else if (chr == ESC) {
+        sim->in_prompt = false;
+        queue_line(sim, "OK", sim->latency_us, now_us);
+      }
+      else if (sim->text_length < MODEM_SIM_TEXT_LENGTH - 1)
+        sim->text[sim->text_length++] = chr;
+    }
+    else if (chr == CR) {
+      sim->line[sim->line_length] = 0;
+      command_line(sim, sim->line, now_us);
+      sim->line_length = 0;
+    }
+    else if (sim->line_length < MODEM_SIM_LINE_LENGTH - 1)
+      sim->line[sim->line_length++] = chr;
+  }
+  if (echo_length) {
+    echo[echo_length] = 0;
+    queue_output(sim, echo, 0, now_us);
+  }
+}
+
+// an SMS reaches the modem, it is stored and signalled with CMTI
+// returns the storage index, or -1 if the storage is full (the SMS is lost)
+static int deliver_sms(modem_sim_t* sim, const char* sender, const char* text, uint64_t now_us) {
+  char urc[MODEM_SIM_LINE_LENGTH];
+  int i;
+
+// delivered directly, the text follows on the next line, the SMS is not stored
+  if (sim->direct_sms && !sim->booting) {
+    snprintf(urc, sizeof(urc), "+CMT: \"%s\",\"\",\"26/10/18,12:00:00+04\"", sender);
+    queue_urc(sim, urc, now_us);
+    snprintf(urc, sizeof(urc), "%s\r\n", text);
+    queue_output(sim, urc, 0, now_us);
+    sim->sms_direct++;
+    return MODEM_SIM_DIRECT;
+  }
+  for (i = 0; i < MODEM_SIM_STORAGE_SLOTS; i++)
+    if (!sim->storage[i].used)
+      break;
+  if (i == MODEM_SIM_STORAGE_SLOTS)
+    return -1;
+  sim->storage[i].used = true;
+  sim->storage[i].read = false;
+  snprintf(sim->storage[i].sender, sizeof(sim->storage[i].sender), "%s", sender);
+  snprintf(sim->storage[i].text, sizeof(sim->storage[i].text), "%s", text);
+  if (!sim->booting) {
+    snprintf(urc, sizeof(urc), "+CMTI: \"%s\",%d", sim->memory, i);
+    queue_urc(sim, urc, now_us);
+  }
+
+  return i;
+}
+
+// a voice call reaches the modem, signalled with CLCC (enabled by AT+CLCC=1), or on Quectel modules with RING followed
+// by CLIP (enabled by AT+CLIP=1)
+static void deliver_call(modem_sim_t* sim, const char* number, uint64_t now_us) {
+  char urc[MODEM_SIM_LINE_LENGTH];
+
+  sim->call_active = true;
+  if (sim->booting)
+    return;
+  if (sim->quectel) {
+    queue_urc(sim, "RING", now_us);
+    snprintf(urc, sizeof(urc), "+CLIP: \"%s\",145,,,,0", number);
+  }
+  else
+    snprintf(urc, sizeof(urc), "+CLCC: 1,1,4,0,0,\"%s\",145", number);
+  queue_urc(sim, urc, now_us);
+}
+
+// delivers what the network has held back and is due by now, in the order of arrival
+static void check_deferred(modem_sim_t* sim, uint64_t now_us) {
+  modem_sim_deferred_t entry;
+  int i, next;
+
+  while (sim->deferred_entries) {
+    next = 0;
+    for (i = 1; i < sim->deferred_entries; i++)
+      if (sim->deferred[i].due_us < sim->deferred[next].due_us)
+        next = i;
+    if (sim->deferred[next].due_us > now_us)
+      return;
+    entry = sim->deferred[next];
+    sim->deferred_entries--;
+    memmove(&sim->deferred[next], &sim->deferred[next + 1], (sim->deferred_entries - next) * sizeof(entry));
+    if (entry.call)
+      deliver_call(sim, entry.sender, entry.due_us);
+    else {
+      sim->deferred_delay_sum_us += entry.due_us - entry.arrival_us;
+      if (entry.due_us - entry.arrival_us > sim->deferred_delay_max_us)
+        sim->deferred_delay_max_us = entry.due_us - entry.arrival_us;
+      if (deliver_sms(sim, entry.sender, entry.text, entry.due_us) < 0)
+        sim->sms_deferred_lost++;
+    }
+  }
+}
+
+// data from the modem to the terminal equipment that is due by now
+// characters are released one by one at the UART speed, as a real modem sends them
+// returns the number of bytes written to data
+size_t modem_sim_transmit(modem_sim_t* sim, char* data, size_t length, uint64_t now_us) {
+  modem_sim_chunk_t* chunk;
+  uint64_t start;
+  size_t l = 0;
+  int due;
+
+  check_ready(sim, now_us);
+  check_deferred(sim, now_us);
+  while (sim->queue_entries && (l < length)) {
+    chunk = &sim->queue[sim->queue_read];
+    start = chunk->due_us - (uint64_t)chunk->length * MODEM_SIM_CHAR_TIME_US;
+    if (now_us >= chunk->due_us)
+      due = chunk->length;
+    else if (now_us > start)
+      due = (int)((now_us - start) / MODEM_SIM_CHAR_TIME_US);
+    else
+      due = 0;
+    due -= chunk->sent;
+    if ((size_t)due > length - l)
+      due = (int)(length - l);
+    memcpy(&data[l], &chunk->data[chunk->sent], due);
+    l += due;
+    chunk->sent += due;
+    if (chunk->sent < chunk->length)
+      break;
+    sim->queue_read = (sim->queue_read + 1) % MODEM_SIM_QUEUE_LENGTH;
+    sim->queue_entries--;
+  }
+
+  return l;
+}
+
+// time at which the next output character becomes due, UINT64_MAX if there is none
+uint64_t modem_sim_next_event_us(const modem_sim_t* sim) {
+  const modem_sim_chunk_t* chunk;
+  uint64_t next = UINT64_MAX;
+  int i;
+
+  if (sim->queue_entries) {
+    chunk = &sim->queue[sim->queue_read];
+    next = chunk->due_us - (uint64_t)(chunk->length - chunk->sent - 1) * MODEM_SIM_CHAR_TIME_US;
+  }
+  else if (sim->booting)
+    next = sim->ready_time_us;
+  for (i = 0; i < sim->deferred_entries; i++)
+    if (sim->deferred[i].due_us < next)
+      next = sim->deferred[i].due_us;
+
+  return next;
+}
+
+// an SMS arrives from the network, it is stored and signalled with CMTI (or delivered with CMT), or held back while the
+// modem is not reachable
+// returns the storage index, MODEM_SIM_DIRECT if delivered directly, MODEM_SIM_DEFERRED if held back, or -1 if the storage (or the list of the SMS held back)
+// is full, the SMS is then lost
+int modem_sim_inbound_sms(modem_sim_t* sim, const char* sender, const char* text, uint64_t now_us) {
+  uint64_t due_us;
+
+  sim->sms_received++;
+  check_deferred(sim, now_us);
+  due_us = reachable_us(sim, now_us);
+  if (due_us == now_us)
+    return deliver_sms(sim, sender, text, now_us);
+  if (!defer(sim, false, sender, text, due_us, now_us))
+    return -1;
+  sim->sms_deferred++;
+
+  return MODEM_SIM_DEFERRED;
+}
+
+// a voice call arrives, it is signalled once it reaches the modem, and missed if that takes longer than the caller
+// waits
+void modem_sim_incoming_call(modem_sim_t* sim, const char* number, uint64_t now_us) {
+  uint64_t due_us;
+
+  sim->calls++;
+  check_deferred(sim, now_us);
+  due_us = reachable_us(sim, now_us);
+  if (due_us == now_us)
+    deliver_call(sim, number, now_us);
+  else if ((due_us - now_us > MODEM_SIM_CALL_RING_US) || !defer(sim, true, number, "", due_us, now_us))
+    sim->calls_missed++;
+}
+
+// any other unsolicited result code, e.g. +CGEV
+void modem_sim_urc(modem_sim_t* sim, const char* line, uint64_t now_us) {
+  if (!sim->booting)
+    queue_urc(sim, line, now_us);
+}
+
+// the network sends its time (NITZ), as when the modem registers: with automatic time zone update the modem sets its
+// clock from it, and reports the time zone with +CTZV if enabled
+void modem_sim_network_time(modem_sim_t* sim, uint64_t now_us) {
+  char urc[MODEM_SIM_LINE_LENGTH];
+
+  if (sim->time_zone_update)
+    sim->clock_set = true;
+  if (sim->time_zone_report && !sim->booting) {
+    snprintf(urc, sizeof(urc), "+CTZV: %+03d", MODEM_SIM_TIME_ZONE);
+    queue_urc(sim, urc, now_us);
+  }
+}
+
+// the modem restarts by itself (brown-out, firmware crash): a line being sent stops half way, the output not yet sent
+// is lost, and after reset_time_us the modem reports with its start-up messages
+void modem_sim_reset(modem_sim_t* sim, uint64_t now_us) {
+  modem_sim_chunk_t* chunk;
+  uint64_t start;
+  int due = 0;
+
+  check_ready(sim, now_us);
+  if (sim->queue_entries) {
+    chunk = &sim->queue[sim->queue_read];
+    start = chunk->due_us - (uint64_t)chunk->length * MODEM_SIM_CHAR_TIME_US;
+    if (now_us > start)
+      due = (int)((now_us - start) / MODEM_SIM_CHAR_TIME_US);
+    if (due > chunk->length)
+      due = chunk->length;
+    if (due > chunk->sent) {
+      chunk->length = due;
+      chunk->due_us = start + (uint64_t)due * MODEM_SIM_CHAR_TIME_US;
+      sim->queue_entries = 1;
+    }
+    else
+      sim->queue_entries = 0;
+  }
+  sim->last_due_us = now_us;
+  sim->faults[MODEM_SIM_FAULT_RESET]++;
+  if (sim->fault)
+    sim->fault(sim->fault_context, MODEM_SIM_FAULT_RESET, now_us);
+  restart(sim, now_us);
+}
+
+// the terminal equipment sets DTR, in sleep mode low wakes the modem up and keeps it awake
+void modem_sim_set_dtr(modem_sim_t* sim, bool high, uint64_t now_us) {
+  if (high == sim->dtr)
+    return;
+  update_sleep(sim, now_us);
+  if (!high && sim->asleep) {
+    sim->wakeups++;
+    sim->waking = true;
+    sim->wake_request_us = now_us;
+  }
+  wake(sim, now_us);
+  sim->dtr = high;
+}
+
+// total time the modem has been asleep by now
+uint64_t modem_sim_sleep_time_us(modem_sim_t* sim, uint64_t now_us) {
+  update_sleep(sim, now_us);
+
+  return sim->sleep_time_us + (sim->asleep ? now_us - sim->sleep_start_us : 0);
+}
+
+// charge the modem has drawn by now, in microampere seconds, at the currents of the states it has been in
+double modem_sim_charge_uas(modem_sim_t* sim, uint64_t now_us) {
+  uint64_t sleep_us, edrx_us, psm_us;
+
+  sleep_us = modem_sim_sleep_time_us(sim, now_us);
+  edrx_us = sim->edrx_time_us;
+  psm_us = sim->psm_time_us;
+  if (sim->asleep) {
+    sleep_split(sim, sim->sleep_start_us, now_us, &edrx_us, &psm_us);
+    edrx_us += sim->edrx_time_us;
+    psm_us += sim->psm_time_us;
+  }
+
+  return ((double)(now_us - sleep_us) * MODEM_SIM_IDLE_CURRENT_UA + (double)(sleep_us - edrx_us - psm_us) *
+          MODEM_SIM_SLEEP_CURRENT_UA + (double)edrx_us * MODEM_SIM_EDRX_CURRENT_UA +
+          (double)psm_us * MODEM_SIM_PSM_CURRENT_UA) / 1000000;
+}
@@ -0,0 +1,199 @@
+#ifndef MODEM_SIM_H
+#define MODEM_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// simulated modem, speaking the subset of AT commands that AlarmDial uses, as a SIMCom module (A7670E, SIM7600) or,
+// with quectel set, as a Quectel module (BG95, EG91): network status with +QNWINFO instead of +CPSI, restart with
+// AT+CFUN=1,1 instead of AT+CRESET, sleep mode with AT+QSCLK, calls reported with RING and +CLIP instead of +CLCC, and
+// the start-up messages of Quectel modules
+// the model is driven by explicit timestamps, so it runs in real time behind a pseudo-terminal (modem_sim_main.c) as
+// well as in virtual time inside a simulation
+
+#define MODEM_SIM_LINE_LENGTH 256
+#define MODEM_SIM_QUEUE_LENGTH 128
+#define MODEM_SIM_STORAGE_SLOTS 30
+#define MODEM_SIM_NUMBER_LENGTH 32
+#define MODEM_SIM_TEXT_LENGTH 200
+
+// time for one character at 9600 baud with 8N1 framing
+#define MODEM_SIM_CHAR_TIME_US 1042
+
+// typical supply current of the modem in sleep mode (AT+CSCLK=1, registered, DTR high), asleep with eDRX (AT+CEDRXS)
+// or in PSM (AT+CPSMS), and awake but idle, in microamperes, from which the simulations estimate the consumption
+#define MODEM_SIM_SLEEP_CURRENT_UA 3000
+#define MODEM_SIM_EDRX_CURRENT_UA 1000
+#define MODEM_SIM_PSM_CURRENT_UA 20
+#define MODEM_SIM_IDLE_CURRENT_UA 22000
+
+// network time at simulation time 0 (UTC in seconds since 1970), and the time zone it reports, in quarter hours
+#define MODEM_SIM_NETWORK_TIME_S 1792321200
+#define MODEM_SIM_TIME_ZONE 4
+
+// the network the modem registers with (MCC and MNC, LTE), which it finds in cached_search_time_us when pointed to it
+// with AT+COPS=4
+#define MODEM_SIM_PLMN "23410"
+#define MODEM_SIM_RAT 7
+
+// SMS and calls the network holds back while the modem is not reachable (eDRX, PSM)
+#define MODEM_SIM_DEFERRED_LENGTH 16
+
+// a caller gives up after this long, a call that cannot reach the modem by then is missed
+#define MODEM_SIM_CALL_RING_US 30000000
+
+// modem_sim_inbound_sms: the SMS is held by the network until the modem is reachable, or it has been delivered
+// directly (CMT) rather than stored
+#define MODEM_SIM_DEFERRED MODEM_SIM_STORAGE_SLOTS
+#define MODEM_SIM_DIRECT (MODEM_SIM_STORAGE_SLOTS + 1)
+
+// protocol faults, reported through the fault callback
+#define MODEM_SIM_FAULT_GARBAGE     0   // random bytes before a line
+#define MODEM_SIM_FAULT_TRUNCATED   1   // a line cut short, without its CR LF
+#define MODEM_SIM_FAULT_DUPLICATE   2   // an unsolicited result code sent twice
+#define MODEM_SIM_FAULT_MISSING_OK  3   // a final OK not sent
+#define MODEM_SIM_FAULT_RESET       4   // the modem restarts by itself (modem_sim_reset)
+#define MODEM_SIM_FAULT_MAX         5
+
+// output to the terminal equipment (the Pico), due_us is the time its last character has been sent
+typedef struct {
+  uint64_t due_us;
+  int length;
+  int sent;
+  char data[MODEM_SIM_LINE_LENGTH];
+} modem_sim_chunk_t;
+
+typedef struct {
+  bool used;
+  bool read;
+  char sender[MODEM_SIM_NUMBER_LENGTH];
+  char text[MODEM_SIM_TEXT_LENGTH];
+} modem_sim_sms_t;
+
+// an SMS (or a call, without text) held back by the network until due_us
+typedef struct {
+  uint64_t arrival_us;
+  uint64_t due_us;
+  bool call;
+  char sender[MODEM_SIM_NUMBER_LENGTH];
+  char text[MODEM_SIM_TEXT_LENGTH];
+} modem_sim_deferred_t;
+
+typedef struct modem_sim modem_sim_t;
+
+// called when the modem has accepted an SMS for sending
+typedef void (*modem_sim_sms_sent_t)(void* context, const char* number, const char* text, uint64_t now_us);
+
+// called when a protocol fault is injected
+typedef void (*modem_sim_fault_t)(void* context, int fault, uint64_t now_us);
+
+struct modem_sim {
+// behaviour, may be changed at any time (quectel before the first command)
+  bool quectel;                 // Quectel module rather than SIMCom
+  const char* model;            // reported by ATI
+  char imei[16];                // reported by AT+CGSN
+  char revision[32];            // firmware revision reported by ATI and AT+CGMR, a change is a firmware update
+  uint32_t latency_us;          // delay before a final result code (OK, ERROR, +CMGS)
+  uint32_t prompt_latency_us;   // delay before the SMS prompt
+  uint32_t reset_time_us;       // time from the restart command to the modem being ready again
+  uint32_t search_time_us;      // time from the modem being ready to its registration, with a full network search
+  uint32_t cached_search_time_us;  // the same when pointed to the network (AT+COPS=4) right after the restart
+  uint32_t wake_time_us;        // time from DTR low (or an unsolicited result code) to the UART working, in sleep mode
+  uint32_t sleep_delay_us;      // quiet time with DTR high before the modem falls asleep, in sleep mode
+  uint32_t psm_wake_time_us;    // the same as wake_time_us, from PSM
+  int error_percent;            // probability of answering a command with ERROR
+  bool online;                  // network service (CPSI or QNWINFO, CREG) once the modem has registered
+  int csq;                      // signal quality reported by CSQ
+  int clock_ppm;                // the network time runs this much faster than the simulation time (the Pico's clock)
+  bool hung;                    // the modem firmware hangs and ignores all commands
+  int fault_permille[MODEM_SIM_FAULT_RESET];  // probability of each protocol fault per line concerned, in 1/1000
+  modem_sim_sms_sent_t sms_sent;
+  void* sms_sent_context;
+  modem_sim_fault_t fault;
+  void* fault_context;
+
+// state
+  bool echo;
+  bool text_mode;
+  char memory[3];               // SMS storage selected with CPMS, which appears in CMTI
+  bool direct_sms;              // SMS are sent to the terminal equipment with CMT rather than stored (AT+CNMI=2,2)
+  bool booting;
+  uint64_t ready_time_us;
+  uint64_t registered_us;       // the modem registers with the network at this time after a restart
+  uint64_t final_result_us;     // the final result code of the current command line is not due before this time
+  bool in_prompt;
+  bool call_active;
+  char prompt_number[MODEM_SIM_NUMBER_LENGTH];
+  char line[MODEM_SIM_LINE_LENGTH];
+  int line_length;
+  char text[MODEM_SIM_TEXT_LENGTH];
+  int text_length;
+  modem_sim_sms_t storage[MODEM_SIM_STORAGE_SLOTS];
+  modem_sim_chunk_t queue[MODEM_SIM_QUEUE_LENGTH];
+  int queue_read;
+  int queue_entries;
+  uint64_t last_due_us;
+  uint32_t random_state;
+  int message_reference;
+  bool sleep_clock;             // sleep mode enabled with AT+CSCLK=1 (AT+QSCLK=1)
+  bool dtr;                     // level of DTR, high lets the modem sleep
+  bool asleep;
+  uint64_t sleep_start_us;
+  uint64_t activity_us;         // last character received or DTR change
+  uint64_t uart_ready_us;       // end of the wake-up, characters arriving earlier are lost
+  bool waking;                  // woken by DTR, the latency to the first character is still to be measured
+  uint64_t wake_request_us;
+  bool psm;                     // power saving mode enabled with AT+CPSMS=1, entered asleep after psm_active_us
+  uint64_t psm_active_us;       // requested active time (T3324)
+  uint64_t psm_tau_us;          // requested periodic tracking area update (T3412), the modem is reachable then
+  bool edrx;                    // extended discontinuous reception enabled with AT+CEDRXS=1
+  uint64_t edrx_cycle_us;       // the modem is paged at multiples of this since falling asleep
+  modem_sim_deferred_t deferred[MODEM_SIM_DEFERRED_LENGTH];
+  int deferred_entries;
+  bool time_zone_update;        // automatic time zone update (AT+CTZU=1), kept across restarts as by the modem
+  bool time_zone_report;        // time zone reporting with +CTZV (AT+CTZR=1)
+  bool clock_set;               // the modem clock has been set from the network time
+
+// statistics
+  uint32_t commands;
+  uint32_t test_commands;       // e.g. AT+CNMI=?, with which the logic probes the capabilities
+  uint32_t errors_injected;
+  uint32_t sms_received;
+  uint32_t sms_direct;          // delivered with CMT
+  uint32_t sms_sent_count;
+  uint32_t calls;
+  uint32_t resets;
+  uint32_t queue_overflows;
+  uint32_t faults[MODEM_SIM_FAULT_MAX];
+  uint32_t rings;               // pulses of RI, one per unsolicited result code
+  uint32_t wakeups;             // by DTR
+  uint64_t sleep_time_us;       // up to the last wake-up, modem_sim_sleep_time_us adds the current sleep
+  uint64_t edrx_time_us;        // parts of sleep_time_us in eDRX and in PSM
+  uint64_t psm_time_us;
+  uint64_t wake_latency_sum_us; // from DTR low to the first character of the command that follows
+  uint64_t wake_latency_max_us;
+  uint32_t sleep_lost_chars;    // characters sent to the modem while it was asleep or waking up
+  uint32_t sms_deferred;        // held back by the network while the modem was not reachable
+  uint64_t deferred_delay_sum_us;
+  uint64_t deferred_delay_max_us;
+  uint32_t sms_deferred_lost;   // deferred SMS that found the storage (or the deferred list) full
+  uint32_t calls_missed;        // calls that could not reach the modem, or did not fit into the deferred list
+};
+
+void modem_sim_init(modem_sim_t* sim, uint32_t seed);
+void modem_sim_receive(modem_sim_t* sim, const char* data, size_t length, uint64_t now_us);
+size_t modem_sim_transmit(modem_sim_t* sim, char* data, size_t length, uint64_t now_us);
+uint64_t modem_sim_next_event_us(const modem_sim_t* sim);
+int modem_sim_inbound_sms(modem_sim_t* sim, const char* sender, const char* text, uint64_t now_us);
+void modem_sim_incoming_call(modem_sim_t* sim, const char* number, uint64_t now_us);
+void modem_sim_urc(modem_sim_t* sim, const char* line, uint64_t now_us);
+void modem_sim_reset(modem_sim_t* sim, uint64_t now_us);
+void modem_sim_set_dtr(modem_sim_t* sim, bool high, uint64_t now_us);
+uint64_t modem_sim_sleep_time_us(modem_sim_t* sim, uint64_t now_us);
+double modem_sim_charge_uas(modem_sim_t* sim, uint64_t now_us);
+uint32_t modem_sim_random(modem_sim_t* sim);
+uint64_t modem_sim_network_time_ms(const modem_sim_t* sim, uint64_t now_us);
+void modem_sim_network_time(modem_sim_t* sim, uint64_t now_us);
+
+#endif
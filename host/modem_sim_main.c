@@ -0,0 +1,270 @@
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "alarmdial_tables.h"
+#include "modem_sim.h"
+#include "trace.h"
+
+// alarmdial_modem_sim: the simulated modem behind a pseudo-terminal, for alarmdial_host (or anything else talking AT)
+//
+// usage: alarmdial_modem_sim [-l link] [-s script] [-x program] [-d latency_ms] [-e error_percent] [-r seed] [-t]
+//   -l  creates a symbolic link to the pseudo-terminal, e.g. for ALARMDIAL_UART
+//   -s  runs the control commands in the script file
+//   -x  starts the program with ALARMDIAL_UART set to the pseudo-terminal, and ends when the program ends
+//   -d  delay of final result codes in milliseconds
+//   -e  probability of answering a command with ERROR in percent
+//   -r  seed of the random number generator
+//   -t  traces the traffic in both directions on stderr, in the format of trace.h (for alarmdial_replay)
+//
+// control commands (from the script or stdin)
+//   sms <sender> <text>   an SMS arrives
+//   call <number>         a voice call arrives
+//   urc <line>            the modem sends an unsolicited result code, e.g. urc +CGEV: ME PDN DEACT 1
+//   latency <ms>          delay of final result codes
+//   errors <percent>      probability of answering a command with ERROR
+//   online, offline       network service, on registering the modem receives the network time
+//   csq <value>           signal quality
+//   wait <ms>             pause the script
+//   quit                  end the simulation
+//
+// on exit, the statistics include the latency from each arriving SMS to the next SMS sent by the device
+
+#define MAX_PENDING 64
+
+static modem_sim_t sim;
+static struct timespec start_time;
+static bool trace = false;
+static bool quit = false;
+
+// arrival times of SMS not yet answered, and reply latency statistics
+static uint64_t pending_sms_us[MAX_PENDING];
+static int pending_sms = 0;
+static uint64_t latency_min_us = UINT64_MAX, latency_max_us = 0, latency_sum_us = 0;
+static uint32_t latency_count = 0;
+
+static uint64_t now_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - start_time.tv_sec) * 1000000 + (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+static void trace_data(int type, const char* data, size_t length) {
+  if (trace)
+    trace_write_data(stderr, now_us(), type, data, length);
+}
+
+static void sms_sent(void* context, const char* number, const char* text, uint64_t time_us) {
+  uint64_t latency;
+
+  (void)context;
+  printf("%10.3f SMS to %s: %s\n", time_us / 1e6, number, text);
+  if (pending_sms) {
+    latency = time_us - pending_sms_us[0];
+    memmove(pending_sms_us, pending_sms_us + 1, --pending_sms * sizeof(pending_sms_us[0]));
+    if (latency < latency_min_us) latency_min_us = latency;
+    if (latency > latency_max_us) latency_max_us = latency;
+    latency_sum_us += latency;
+    latency_count++;
+  }
+}
+
+// executes one control command, returns the time to wait in milliseconds (wait command), 0 otherwise
+static int control(char* line) {
+  char* argument;
+  char* text;
+  uint64_t now = now_us();
+
+  line[strcspn(line, "\r\n")] = 0;
+  argument = strchr(line, ' ');
+  if (argument)
+    *argument++ = 0;
+  else
+    argument = line + strlen(line);
+  if (!strcmp(line, "sms")) {
+    text = strchr(argument, ' ');
+    if (text)
+      *text++ = 0;
+    if (modem_sim_inbound_sms(&sim, argument, text ? text : "", now) < 0)
+      printf("SMS storage full, SMS lost\n");
+    else if (pending_sms < MAX_PENDING)
+      pending_sms_us[pending_sms++] = now;
+  }
+  else if (!strcmp(line, "call"))
+    modem_sim_incoming_call(&sim, argument, now);
+  else if (!strcmp(line, "urc"))
+    modem_sim_urc(&sim, argument, now);
+  else if (!strcmp(line, "latency"))
+    sim.latency_us = (uint32_t)atoi(argument) * 1000;
+  else if (!strcmp(line, "errors"))
+    sim.error_percent = atoi(argument);
+  else if (!strcmp(line, "online")) {
+    sim.online = true;
+    modem_sim_network_time(&sim, now);
+  }
+  else if (!strcmp(line, "offline"))
+    sim.online = false;
+  else if (!strcmp(line, "csq"))
+    sim.csq = atoi(argument);
+  else if (!strcmp(line, "wait"))
+    return atoi(argument);
+  else if (!strcmp(line, "quit"))
+    quit = true;
+  else if (line[0] && (line[0] != '#'))
+    fprintf(stderr, "alarmdial_modem_sim: unknown command %s\n", line);
+
+  return 0;
+}
+
+static void print_statistics(void) {
+  printf("commands %u, errors injected %u, SMS received %u, SMS sent %u, calls %u, resets %u, queue overflows %u\n",
+         sim.commands, sim.errors_injected, sim.sms_received, sim.sms_sent_count, sim.calls, sim.resets, sim.queue_overflows);
+  if (latency_count)
+    printf("SMS reply latency: min %.3f s, mean %.3f s, max %.3f s (%u replies, %d unanswered)\n", latency_min_us / 1e6,
+           latency_sum_us / 1e6 / latency_count, latency_max_us / 1e6, latency_count, pending_sms);
+}
+
+int main(int argc, char* argv[]) {
+  const char* link_path = NULL;
+  const char* program = NULL;
+  FILE* script = NULL;
+  uint64_t script_resume_us = 0;
+  uint64_t next;
+  char line[512];
+  char data[4096];
+  struct termios tio;
+  struct pollfd pfd[2];
+  pid_t child = 0;
+  bool stdin_open = true;
+  int master, slave, status, timeout, opt;
+  ssize_t n;
+  size_t l;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  modem_sim_init(&sim, 0);
+  sim.quectel = MODEM_QUECTEL;
+  sim.model = MODEM_NAME;
+  sim.sms_sent = sms_sent;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  while ((opt = getopt(argc, argv, "l:s:x:d:e:r:t")) != -1) {
+    switch (opt) {
+      case 'l': link_path = optarg; break;
+      case 's':
+        script = fopen(optarg, "r");
+        if (!script) {
+          fprintf(stderr, "alarmdial_modem_sim: cannot open %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'x': program = optarg; break;
+      case 'd': sim.latency_us = (uint32_t)atoi(optarg) * 1000; break;
+      case 'e': sim.error_percent = atoi(optarg); break;
+      case 'r': sim.random_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+      case 't': trace = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-l link] [-s script] [-x program] [-d latency_ms] [-e error_percent] [-r seed] [-t]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+// the pseudo-terminal, the slave side is kept open so the master does not see a hangup between clients
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master < 0) || grantpt(master) || unlockpt(master)) {
+    perror("alarmdial_modem_sim: pseudo-terminal");
+    return EXIT_FAILURE;
+  }
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (!tcgetattr(slave, &tio)) {
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+  }
+  printf("Modem on %s\n", ptsname(master));
+  if (link_path) {
+    unlink(link_path);
+    if (symlink(ptsname(master), link_path))
+      perror("alarmdial_modem_sim: symlink");
+  }
+  if (program) {
+    setenv("ALARMDIAL_UART", ptsname(master), 1);
+    child = fork();
+    if (child == 0) {
+      execl(program, program, (char*)NULL);
+      perror("alarmdial_modem_sim: exec");
+      _exit(EXIT_FAILURE);
+    }
+  }
+
+  while (!quit) {
+// control commands from the script, paced by its wait commands
+    while (script && !quit && (now_us() >= script_resume_us)) {
+      if (!fgets(line, sizeof(line), script)) {
+        fclose(script);
+        script = NULL;
+        break;
+      }
+      script_resume_us = now_us() + (uint64_t)control(line) * 1000;
+    }
+
+// output of the modem that is due
+    l = modem_sim_transmit(&sim, data, sizeof(data), now_us());
+    if (l) {
+      trace_data(TRACE_RX, data, l);
+      if (write(master, data, l) < 0)
+        perror("alarmdial_modem_sim: write");
+    }
+
+// wait for input, the next due output or the next script step
+    timeout = 100;
+    next = modem_sim_next_event_us(&sim);
+    if (script && (script_resume_us < next))
+      next = script_resume_us;
+    if (next != UINT64_MAX)
+      timeout = next > now_us() ? (int)((next - now_us() + 999) / 1000) : 0;
+    if (timeout > 100)
+      timeout = 100;
+    pfd[0].fd = master;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stdin_open ? STDIN_FILENO : -1;
+    pfd[1].events = POLLIN;
+    if (poll(pfd, 2, timeout) > 0) {
+      if (pfd[0].revents & POLLIN) {
+        n = read(master, data, sizeof(data));
+        if (n > 0) {
+          trace_data(TRACE_TX, data, n);
+          modem_sim_receive(&sim, data, n, now_us());
+        }
+      }
+      if (pfd[1].revents & POLLIN) {
+        if (fgets(line, sizeof(line), stdin))
+          control(line);
+        else
+          stdin_open = false;
+      }
+    }
+
+    if (child && (waitpid(child, &status, WNOHANG) == child)) {
+      printf("%s ended with status %d\n", program, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+      child = 0;
+      quit = true;
+    }
+  }
+
+  if (child)
+    kill(child, SIGTERM);
+  if (link_path)
+    unlink(link_path);
+  print_statistics();
+
+  return EXIT_SUCCESS;
+}
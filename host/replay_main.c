@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dialler.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "hal_sim.h"
+#include "trace.h"
+
+// alarmdial_replay: feeds a recorded trace (trace.h) back into the AlarmDial logic in virtual time, and checks that
+// the logic sends the same commands and SMS as in the recording
+//
+// usage: alarmdial_replay [-f] [-c flash_file] [-n repeat] [-v] trace
+//   -f  fast: each recorded response is injected as soon as the logic has sent everything that preceded it in the
+//       recording, without the recorded delays (otherwise at the recorded times), numbers in the commands are then
+//       not compared
+//   -c  configuration storage area to start from (as ALARMDIAL_FLASH), otherwise it starts erased
+//   -n  replays the trace repeatedly, as a throughput benchmark of the framing, dispatch and main loop path
+//   -v  prints the commands of the replay
+//
+// the exit status is EXIT_FAILURE if the commands or SMS differ from the recording
+
+#define SECOND_US 1000000ULL
+
+// size of the configuration storage area file, as with alarmdial_host
+#define REPLAY_FLASH_BYTES 4096
+
+// the replay ends this long after the last recorded event has been injected
+#define REPLAY_TAIL_US (60 * SECOND_US)
+
+// the replay gives up this long after the time of the last recorded event
+#define REPLAY_LIMIT_US (3600 * SECOND_US)
+
+typedef struct {
+  uint64_t time_us;
+  int type;
+  size_t tx_before;     // characters sent by the Pico before this event in the recording
+  size_t offset;        // TRACE_RX: data in rx_data
+  int length;
+  unsigned int pin;     // TRACE_GPIO
+  bool value;
+} replay_event_t;
+
+// a growing buffer of characters
+typedef struct {
+  char* data;
+  size_t length;
+  size_t size;
+} buffer_t;
+
+static replay_event_t* events = NULL;
+static int number_events = 0;
+static buffer_t rx_data, recorded_tx, replayed_tx;
+static uint64_t recorded_end_us = 0;
+static size_t rx_bytes = 0;
+static int rx_lines = 0, gpio_changes = 0;
+
+// replay state
+static bool fast = false;
+static bool verbose = false;
+static int next_rx = 0, next_gpio = 0;
+static int rx_sent = 0;
+static bool finished = false;
+static uint64_t finished_us = 0;
+
+static void buffer_append(buffer_t* buffer, const char* data, size_t length) {
+  if (buffer->length + length > buffer->size) {
+    buffer->size = (buffer->length + length) * 2 + 1024;
+    buffer->data = realloc(buffer->data, buffer->size);
+    if (!buffer->data) {
+      fprintf(stderr, "alarmdial_replay: out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+static bool load_trace(const char* file_name) {
+  static trace_event_t event;
+  replay_event_t* e;
+  FILE* f;
+  int i;
+
+  f = fopen(file_name, "r");
+  if (!f)
+    return false;
+  while (trace_read(f, &event)) {
+    if (event.type == TRACE_TX) {
+      buffer_append(&recorded_tx, event.data, event.length);
+      continue;
+    }
+    events = realloc(events, (number_events + 1) * sizeof(events[0]));
+    if (!events) {
+      fprintf(stderr, "alarmdial_replay: out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    e = &events[number_events++];
+    e->time_us = event.time_us;
+    e->type = event.type;
+    e->tx_before = recorded_tx.length;
+    e->offset = rx_data.length;
+    e->length = event.length;
+    e->pin = event.pin;
+    e->value = event.value;
+    if (event.type == TRACE_RX) {
+      buffer_append(&rx_data, event.data, event.length);
+      rx_bytes += event.length;
+      for (i = 0; i < event.length; i++)
+        rx_lines += event.data[i] == '\n';
+    }
+    else
+      gpio_changes++;
+    if (event.time_us > recorded_end_us)
+      recorded_end_us = event.time_us;
+  }
+  fclose(f);
+
+  return true;
+}
+
+// an event is due at its recorded time, or in fast mode once the logic has sent what preceded it
+static bool event_due(const replay_event_t* e, uint64_t now_us) {
+  return fast ? replayed_tx.length >= e->tx_before : e->time_us <= now_us;
+}
+
+static int next_event_of_type(int i, int type) {
+  while ((i < number_events) && (events[i].type != type))
+    i++;
+  return i;
+}
+
+static void check_finished(uint64_t now_us) {
+  if (!finished && (next_rx >= number_events) && (next_gpio >= number_events)) {
+    finished = true;
+    finished_us = now_us;
+  }
+}
+
+// input changes, in fast mode they follow the characters sent by the logic
+static void apply_gpio(uint64_t now_us) {
+  while ((next_gpio < number_events) && event_due(&events[next_gpio], now_us)) {
+    hal_host_set_gpio(events[next_gpio].pin, events[next_gpio].value);
+    next_gpio = next_event_of_type(next_gpio + 1, TRACE_GPIO);
+  }
+  check_finished(now_us);
+}
+
+static uint64_t run_events(uint64_t now_us) {
+  apply_gpio(now_us);
+
+  return (!fast && (next_gpio < number_events)) ? events[next_gpio].time_us : UINT64_MAX;
+}
+
+// the UART peer: collects what the logic sends, and injects the recorded responses
+static void replay_receive(void* context, const char* data, size_t length, uint64_t now_us) {
+  (void)context;
+  buffer_append(&replayed_tx, data, length);
+  if (fast)
+    apply_gpio(now_us);
+}
+
+static size_t replay_transmit(void* context, char* data, size_t length, uint64_t now_us) {
+  replay_event_t* e;
+  size_t l = 0;
+  int n;
+
+  (void)context;
+  while ((next_rx < number_events) && (l < length) && event_due(&events[next_rx], now_us)) {
+    e = &events[next_rx];
+    n = e->length - rx_sent;
+    if ((size_t)n > length - l)
+      n = (int)(length - l);
+    memcpy(&data[l], &rx_data.data[e->offset + rx_sent], n);
+    l += n;
+    rx_sent += n;
+    if (rx_sent < e->length)
+      break;
+    rx_sent = 0;
+    next_rx = next_event_of_type(next_rx + 1, TRACE_RX);
+  }
+  check_finished(now_us);
+
+  return l;
+}
+
+static uint64_t replay_next_event_us(void* context) {
+  (void)context;
+
+  return (!fast && (next_rx < number_events)) ? events[next_rx].time_us : UINT64_MAX;
+}
+
+// splits what the Pico sent into commands, each ending with CR or CTRL-Z (SMS text)
+static int split_commands(const buffer_t* tx, size_t** start) {
+  size_t i, begin = 0;
+  int n = 0;
+
+  *start = malloc((tx->length + 2) * sizeof(size_t));
+  for (i = 0; i < tx->length; i++)
+    if ((tx->data[i] == '\r') || (tx->data[i] == '\x1a') || (i == tx->length - 1)) {
+      (*start)[n++] = begin;
+      begin = i + 1;
+    }
+  (*start)[n] = tx->length;
+
+  return n;
+}
+
+static void print_command(const char* label, const buffer_t* tx, const size_t* start, int i, int n) {
+  printf("  %s: ", label);
+  if (i < n)
+    trace_write_escaped(stdout, tx->data + start[i], start[i + 1] - start[i]);
+  else
+    printf("(none)");
+  printf("\n");
+}
+
+// in fast mode the timing differs from the recording, so numbers (e.g. the uptime in a status reply) are not compared
+static bool commands_equal(const char* a, size_t a_length, const char* b, size_t b_length) {
+  size_t i = 0, j = 0;
+
+  while ((i < a_length) && (j < b_length)) {
+    if (fast && (a[i] >= '0') && (a[i] <= '9') && (b[j] >= '0') && (b[j] <= '9')) {
+      while ((i < a_length) && (a[i] >= '0') && (a[i] <= '9'))
+        i++;
+      while ((j < b_length) && (b[j] >= '0') && (b[j] <= '9'))
+        j++;
+      continue;
+    }
+    if (a[i++] != b[j++])
+      return false;
+  }
+
+  return (i == a_length) && (j == b_length);
+}
+
+// counts the SMS, i.e. AT+CMGS commands followed by text
+static int count_sms(const buffer_t* tx, const size_t* start, int n) {
+  int i, sms = 0;
+
+  for (i = 0; i + 1 < n; i++)
+    if (!strncmp(tx->data + start[i], "AT+CMGS=", 8) && (tx->data[start[i + 2] - 1] == '\x1a'))
+      sms++;
+
+  return sms;
+}
+
+// compares the commands and SMS sent in the replay with the recording, returns true if they match
+static bool compare(void) {
+  size_t *recorded_start, *replayed_start;
+  int recorded, replayed, i, sms_recorded, sms_replayed, sms_matching = 0;
+  bool match;
+
+  recorded = split_commands(&recorded_tx, &recorded_start);
+  replayed = split_commands(&replayed_tx, &replayed_start);
+  if (verbose)
+    for (i = 0; i < replayed; i++)
+      print_command("sent", &replayed_tx, replayed_start, i, replayed);
+  for (i = 0; (i < recorded) && (i < replayed); i++) {
+    if (!commands_equal(recorded_tx.data + recorded_start[i], recorded_start[i + 1] - recorded_start[i],
+                        replayed_tx.data + replayed_start[i], replayed_start[i + 1] - replayed_start[i]))
+      break;
+    if ((i > 0) && !strncmp(recorded_tx.data + recorded_start[i - 1], "AT+CMGS=", 8) &&
+        (recorded_tx.data[recorded_start[i + 1] - 1] == '\x1a'))
+      sms_matching++;
+  }
+  match = (i == recorded) && (i == replayed);
+  sms_recorded = count_sms(&recorded_tx, recorded_start, recorded);
+  sms_replayed = count_sms(&replayed_tx, replayed_start, replayed);
+  printf("commands: %d recorded, %d replayed, %d identical\n", recorded, replayed, i);
+  if (!match) {
+    printf("first difference at command %d\n", i + 1);
+    print_command("recorded", &recorded_tx, recorded_start, i, recorded);
+    print_command("replayed", &replayed_tx, replayed_start, i, replayed);
+  }
+  printf("SMS: %d recorded, %d replayed, %d identical before the first difference\n", sms_recorded, sms_replayed,
+         sms_matching);
+  free(recorded_start);
+  free(replayed_start);
+
+  return match;
+}
+
+int main(int argc, char* argv[]) {
+  static uint8_t flash[REPLAY_FLASH_BYTES];
+  static volatile int run = 0;
+  static volatile uint32_t reboots = 0;
+  static int repeat = 1;
+  hal_sim_uart_peer_t peer = { NULL, replay_receive, replay_transmit, replay_next_event_us };
+  const char* flash_file = NULL;
+  struct timespec start, stop;
+  double wall_s;
+  uint64_t virtual_us = 0;
+  bool match = true;
+  FILE* f;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "fc:n:v")) != -1) {
+    switch (opt) {
+      case 'f': fast = true; break;
+      case 'c': flash_file = optarg; break;
+      case 'n': repeat = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-f] [-c flash_file] [-n repeat] [-v] trace\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((optind >= argc) || !load_trace(argv[optind])) {
+    fprintf(stderr, "alarmdial_replay: cannot read trace %s\n", optind < argc ? argv[optind] : "(none)");
+    return EXIT_FAILURE;
+  }
+  memset(flash, 0xff, sizeof(flash));
+  if (flash_file) {
+    if (!(f = fopen(flash_file, "rb")) || !fread(flash, 1, sizeof(flash), f)) {
+      fprintf(stderr, "alarmdial_replay: cannot read %s\n", flash_file);
+      return EXIT_FAILURE;
+    }
+    fclose(f);
+  }
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  printf("trace: %d events (%d bytes in %d lines from the modem, %d input changes), %zu bytes to the modem, %.1f s\n",
+         number_events, (int)rx_bytes, rx_lines, gpio_changes, recorded_tx.length, recorded_end_us / 1e6);
+
+  hal_init();
+  hal_sim_attach_uart(&peer);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+// each run starts from power on with the same configuration storage area
+  for (run = 0; run < repeat; run++) {
+    hal_sim_power_cycle();
+    hal_sim_load_flash(flash, sizeof(flash));
+    replayed_tx.length = 0;
+    next_rx = next_event_of_type(0, TRACE_RX);
+    next_gpio = next_event_of_type(0, TRACE_GPIO);
+    rx_sent = 0;
+    finished = false;
+    hal_sim_set_event_handler(run_events);
+
+    if (setjmp(hal_sim_reboot))
+      reboots++;
+    dialler_setup();
+    while ((!finished || (hal_sim_now_us() < finished_us + REPLAY_TAIL_US)) &&
+           (hal_sim_now_us() < recorded_end_us + REPLAY_LIMIT_US))
+      dialler_loop();
+    virtual_us += hal_sim_now_us();
+    if (run == 0)
+      match = compare();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  wall_s = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+  if (!finished)
+    printf("replay incomplete, %d of %d events injected\n", next_rx < next_gpio ? next_rx : next_gpio, number_events);
+  printf("replay (%s): %d run%s, %u reboot%s, %.1f s virtual in %.3f s\n", fast ? "fast" : "recorded timing", repeat,
+         repeat > 1 ? "s" : "", reboots, reboots == 1 ? "" : "s", virtual_us / 1e6, wall_s);
+  printf("throughput: %.0f lines/s, %.2f MB/s from the modem, %.2f us per line\n", (double)rx_lines * repeat / wall_s,
+         (double)rx_bytes * repeat / wall_s / 1e6, rx_lines ? wall_s * 1e6 / rx_lines / repeat : 0.0);
+
+  return match && finished ? EXIT_SUCCESS : EXIT_FAILURE;
+}
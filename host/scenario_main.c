@@ -0,0 +1,672 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "diagnostics.h"
+#include "dialler.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "hal_sim.h"
+#include "modem.h"
+#include "modem_sim.h"
+
+// alarmdial_scenarios: runs the AlarmDial logic in virtual time through scripted stress scenarios against the
+// simulated modem, and reports per scenario the latency from an alarm input edge to the +CMGS of its SMS and the number
+// of lost events (alarm input edges without SMS, SMS commands without reply)
+//
+// usage: alarmdial_scenarios [-r seed] [-t trace_prefix] [-v] [-z] [scenario ...]
+//   -r  seed of the random number generator (random input toggles, modem), the same seed gives the same results
+//   -t  records each scenario in the trace file trace_prefix-<scenario>.trace, for alarmdial_replay
+//   -v  prints the scenario events and the SMS sent
+//   -z  modem sleep mode (AT+CSCLK=1 with DTR and RI)
+// without scenario names all scenarios run
+//
+// every scenario starts from a power cycle with the default configuration (upgrade: with the settings as the first
+// version of the software stored them), the script starts once the logic has settled and the run continues until every
+// event has had its deadline
+// the exit status is EXIT_FAILURE if the logic hung (watchdog timeout) in any scenario, or sent characters to the
+// modem while it slept, or if the upgrade scenario did not read the settings as immediate alarms or lost an alarm, or
+// if the SMS burst, missed call or full digest scenario lost any event (a reply to another number than expected counts
+// as lost, as does a change of an input with digest delivery that no digest has reported)
+
+#define SECOND_US 1000000ULL
+#define MINUTE_US (60 * SECOND_US)
+
+// an alarm SMS (or command reply) is counted as lost if it has not been sent within this time of the event
+#define ALARM_DEADLINE_US (10 * MINUTE_US)
+// the script starts this long after power-up, and the run ends this long after its last step
+#define SCENARIO_START_US (2 * MINUTE_US)
+#define SCENARIO_DRAIN_US (ALARM_DEADLINE_US + MINUTE_US)
+// while the script runs, the scenario looks at the modem this often (for the network loss triggered by a send)
+#define SCENARIO_TICK_US 100000
+
+#define MAX_PENDING 1024
+#define MAX_SAMPLES 4096
+
+// script actions, pin -1 toggles a random input
+#define ACTION_INPUT_LOW     0
+#define ACTION_INPUT_HIGH    1
+#define ACTION_TOGGLE        2
+#define ACTION_RELEASE_ALL   3
+#define ACTION_SMS           4
+#define ACTION_URC           5
+#define ACTION_LATENCY       6
+#define ACTION_LOSS_ON_SEND  7
+#define ACTION_CALL          8
+#define ACTION_DIGEST        9
+
+// one step of a script, run count times every interval_ms from start_ms (relative to the start of the script)
+// value is the input for the input actions, the latency in ms for ACTION_LATENCY, the outage in ms for
+// ACTION_LOSS_ON_SEND (the network drops when the logic submits its next SMS), for ACTION_CALL (text is the caller)
+// 1 if the missed call is to be answered, and for ACTION_DIGEST the input that goes into the digest from then on (with
+// the command Digest!)
+typedef struct {
+  uint32_t start_ms;
+  uint32_t count;
+  uint32_t interval_ms;
+  int action;
+  int value;
+  const char* text;
+} script_step_t;
+
+typedef struct {
+  const char* name;
+  const char* description;
+  const script_step_t* steps;
+  int number_steps;
+  bool baseline_flash;
+  bool lossless;
+} scenario_t;
+
+#define STEPS(s) s, (int)(sizeof(s) / sizeof(s[0]))
+
+// a burst of 16 SMS commands within three seconds while an alarm comes and goes, the modem delivers them directly if it
+// can and does not keep them, so none of them may be lost
+static const script_step_t sms_burst[] = {
+  {      0,  16,   200, ACTION_SMS,          0, "674358 Status?" },
+  {   1000,   1,     0, ACTION_INPUT_LOW,    0, NULL },
+  {  15000,   1,     0, ACTION_INPUT_HIGH,   0, NULL }
+};
+
+// all inputs toggle at random, 400 edges in two minutes
+static const script_step_t alarm_storm[] = {
+  {      0, 400,   300, ACTION_TOGGLE,      -1, NULL },
+  { 120000,   1,     0, ACTION_RELEASE_ALL,  0, NULL }
+};
+
+// an alarm, with 40 SMS commands arriving every half second while the inputs change
+static const script_step_t sms_flood[] = {
+  {      0,  40,   500, ACTION_SMS,          0, "674358 Status?" },
+  {   5000,   1,     0, ACTION_INPUT_LOW,    0, NULL },
+  {  10000,   1,     0, ACTION_INPUT_LOW,    1, NULL },
+  {  20000,   1,     0, ACTION_INPUT_HIGH,   0, NULL },
+  {  25000,   1,     0, ACTION_INPUT_LOW,    2, NULL },
+  {  40000,   1,     0, ACTION_RELEASE_ALL,  0, NULL }
+};
+
+// 20 unsolicited messages per second that the logic does not know, for two minutes, while two inputs change
+static const script_step_t urc_spam[] = {
+  {      0, 2400,   50, ACTION_URC,          0, "+QIND: \"csq\",20,99" },
+  {   1000,  12, 10000, ACTION_TOGGLE,       0, NULL },
+  {   6000,  12, 10000, ACTION_TOGGLE,       1, NULL }
+};
+
+// every final result code takes 5 s, with input changes every 5 s and a few signal requests
+static const script_step_t slow_modem[] = {
+  {      0,   1,     0, ACTION_LATENCY,   5000, NULL },
+  {   1000,  10, 15000, ACTION_TOGGLE,       0, NULL },
+  {   6000,  10, 15000, ACTION_TOGGLE,       1, NULL },
+  {  11000,  10, 15000, ACTION_TOGGLE,       2, NULL },
+  {   3000,   5, 30000, ACTION_SMS,          0, "674358 Signal?" },
+  { 150000,   1,     0, ACTION_LATENCY,     20, NULL }
+};
+
+// the network drops for a minute while the SMS of the first alarm is submitted, more alarms follow
+static const script_step_t network_loss[] = {
+  {      0,   1,     0, ACTION_LOSS_ON_SEND, 60000, NULL },
+  {      0,   1,     0, ACTION_INPUT_LOW,    0, NULL },
+  {  10000,   8, 10000, ACTION_TOGGLE,       1, NULL },
+  {  90000,   1,     0, ACTION_INPUT_HIGH,   0, NULL }
+};
+
+// configuration changes (stored in flash once replied to) during a burst of input changes
+static const script_step_t flash_commit[] = {
+  {      0,   6,  5000, ACTION_SMS,          0, "674358 Defaults!" },
+  {    200,  60,   500, ACTION_TOGGLE,      -1, NULL },
+  {  30000,   1,     0, ACTION_RELEASE_ALL,  0, NULL }
+};
+
+// missed calls after the allow-list has taken a caller, the reply goes to the caller, a call from another number is
+// rejected without reply
+static const script_step_t missed_call[] = {
+  {      0,   1,     0, ACTION_SMS,          0, "674358 Caller!+447700900003" },
+  {  10000,   1,     0, ACTION_CALL,         0, "+447700900004" },
+  {  20000,   1,     0, ACTION_CALL,         1, "+447700900003" },
+  {  25000,   1,     0, ACTION_INPUT_LOW,    0, NULL },
+  {  40000,   1,     0, ACTION_INPUT_HIGH,   0, NULL }
+};
+
+// inputs 1 and 3 join input 2 in the digest, all with long messages, so that 16 changes fill the digest twice but do
+// not fit into its SMS, every change has to be reported in one of the digests
+static const script_step_t digest_full[] = {
+  {      0,   1,     0, ACTION_DIGEST,       0, NULL },
+  {   1000,   1,     0, ACTION_DIGEST,       2, NULL },
+  {   2000,   1,     0, ACTION_SMS,          0, "674358 MessageText!1!On!Intruder alarm triggered in the east wing office" },
+  {   3000,   1,     0, ACTION_SMS,          0, "674358 MessageText!1!Off!Intruder alarm cleared in the east wing office" },
+  {   4000,   1,     0, ACTION_SMS,          0, "674358 MessageText!2!On!Alarm system armed by the night shift keyholder" },
+  {   5000,   1,     0, ACTION_SMS,          0, "674358 MessageText!2!Off!Alarm system disarmed by the day shift keyholder" },
+  {   6000,   1,     0, ACTION_SMS,          0, "674358 MessageText!3!On!Panic button pressed at the reception desk" },
+  {   7000,   1,     0, ACTION_SMS,          0, "674358 MessageText!3!Off!Panic button released at the reception desk" },
+  {  20000,   6,  6000, ACTION_TOGGLE,       0, NULL },
+  {  22000,   6,  6000, ACTION_TOGGLE,       1, NULL },
+  {  24000,   4,  9000, ACTION_TOGGLE,       2, NULL }
+};
+
+// alarms right after an upgrade from the first version, whose settings end after the SMS actions of the inputs
+static const script_step_t upgrade[] = {
+  {      0,   1,     0, ACTION_INPUT_LOW,    0, NULL },
+  {  10000,   1,     0, ACTION_INPUT_LOW,    2, NULL },
+  {  20000,   4, 10000, ACTION_TOGGLE,       1, NULL },
+  {  60000,   1,     0, ACTION_RELEASE_ALL,  0, NULL }
+};
+
+static const scenario_t scenarios[] = {
+  { "alarm_storm",  "all inputs toggling",              STEPS(alarm_storm) },
+  { "sms_flood",    "inbound SMS flood during alarm",   STEPS(sms_flood) },
+  { "sms_burst",    "burst of SMS commands, no loss",   STEPS(sms_burst), false, true },
+  { "urc_spam",     "unknown URC storm",                STEPS(urc_spam) },
+  { "slow_modem",   "5 s result code latency",          STEPS(slow_modem) },
+  { "network_loss", "network loss in the middle of a send", STEPS(network_loss) },
+  { "flash_commit", "flash commit during a burst",      STEPS(flash_commit) },
+  { "missed_call",  "missed calls from the allow-list", STEPS(missed_call), false, true },
+  { "digest_full",  "digest longer than its SMS",       STEPS(digest_full), false, true },
+  { "upgrade",      "settings of the first version",    STEPS(upgrade), true }
+};
+#define NUMBER_SCENARIOS (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+static modem_sim_t modem;
+static config_t defaults;
+static uint32_t seed = 0x9e3779b9;
+static uint32_t random_state;
+static bool verbose = false;
+
+// the scenario being run, the next run of each of its steps, and the outage armed by ACTION_LOSS_ON_SEND
+static const scenario_t* scenario;
+static uint32_t step_runs[16];
+static uint64_t script_end_us;
+static uint32_t loss_on_send_ms;
+static uint64_t network_restore_us;
+
+// alarm input edges and SMS commands waiting for their SMS
+typedef struct {
+  uint64_t time_us;
+  int pin;
+  const char* text;
+} pending_t;
+
+static pending_t pending_alarm[MAX_PENDING];
+static int pending_alarms;
+static uint64_t pending_reply_us[MAX_PENDING];
+static const char* pending_reply_to[MAX_PENDING];
+static int pending_replies;
+
+static bool input_low[GPIO_NUMBER_PINS];
+
+// inputs with digest delivery, their changes, and the changes the digest SMS have reported
+static bool digest_input[GPIO_NUMBER_PINS];
+static uint32_t digest_changes, digest_reported;
+
+// results of the scenario
+static uint64_t alarm_latency_us[MAX_SAMPLES];
+static uint32_t alarm_latencies;
+static uint32_t edges, commands, alarms_lost, replies_lost, sms_rejected;
+static uint32_t sms_alarm, sms_reply, sms_other;
+
+static uint32_t scenario_random(void) {
+  uint32_t x = random_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+
+  return x;
+}
+
+static void print_event(uint64_t time_us, const char* what, const char* detail) {
+  if (verbose)
+    printf("  %8.3f s %s%s%s\n", ((int64_t)time_us - (int64_t)SCENARIO_START_US) / 1e6, what, detail[0] ? " " : "", detail);
+}
+
+// alarm edges and commands without SMS by their deadline are lost
+static void expire_alarms(uint64_t now_us) {
+  while (pending_replies && (now_us - pending_reply_us[0] > ALARM_DEADLINE_US)) {
+    replies_lost++;
+    memmove(pending_reply_to, pending_reply_to + 1, (pending_replies - 1) * sizeof(pending_reply_to[0]));
+    memmove(pending_reply_us, pending_reply_us + 1, --pending_replies * sizeof(pending_reply_us[0]));
+  }
+  while (pending_alarms && (now_us - pending_alarm[0].time_us > ALARM_DEADLINE_US)) {
+    alarms_lost++;
+    print_event(now_us, "lost:", pending_alarm[0].text);
+    memmove(pending_alarm, pending_alarm + 1, --pending_alarms * sizeof(pending_alarm[0]));
+  }
+}
+
+// an alarm SMS is the text for the input change, followed by the time of the change once the logic has the network time
+static bool alarm_text(const char* sms, const char* text) {
+  size_t l = strlen(text);
+
+  return !strncmp(sms, text, l) && (!sms[l] || !strncmp(&sms[l], " at ", 4));
+}
+
+// the number of input changes in a digest: each time ("19:02") is one, each count ("2x") as many as it says
+static uint32_t digest_count(const char* text) {
+  uint32_t n = 0, count;
+  const char* p;
+  char* end;
+
+  for (p = text; *p; p++) {
+    if ((p != text) && (p[-1] != ' '))
+      continue;
+    if (isdigit((unsigned char)p[0]) && isdigit((unsigned char)p[1]) && (p[2] == ':') &&
+        isdigit((unsigned char)p[3]) && isdigit((unsigned char)p[4]) && (!p[5] || (p[5] == ' ') || (p[5] == ',')))
+      n++;
+    else if (isdigit((unsigned char)p[0])) {
+      count = (uint32_t)strtoul(p, &end, 10);
+      if ((end[0] == 'x') && (!end[1] || (end[1] == ',')))
+        n += count;
+    }
+  }
+
+  return n;
+}
+
+// the modem reports the SMS at the time of its +CMGS, an alarm SMS reports the state of its input when the logic
+// looked, so it belongs to the newest edge of that text submitted before it, and earlier edges of the same input still
+// waiting have been missed by the logic (lost); a digest is not matched with edges, any other SMS is taken as the reply
+// to the oldest command or call if it goes to the number the reply is expected at
+static void sms_sent(void* context, const char* number, const char* text, uint64_t time_us) {
+  uint64_t submit_us = time_us - modem.latency_us;
+  int i, j, pin;
+
+  (void)context;
+  print_event(time_us, "SMS:", text);
+  expire_alarms(time_us);
+  if (!strncmp(text, "Digest:", 7))
+    digest_reported += digest_count(text);
+  for (i = pending_alarms - 1; i >= 0; i--)
+    if ((pending_alarm[i].time_us < submit_us) && alarm_text(text, pending_alarm[i].text))
+      break;
+  if (i >= 0) {
+    sms_alarm++;
+    if (alarm_latencies < MAX_SAMPLES)
+      alarm_latency_us[alarm_latencies++] = time_us - pending_alarm[i].time_us;
+    pin = pending_alarm[i].pin;
+    for (j = i; j >= 0; j--)
+      if (pending_alarm[j].pin == pin) {
+        if (j < i) {
+          alarms_lost++;
+          print_event(time_us, "lost:", pending_alarm[j].text);
+        }
+        memmove(pending_alarm + j, pending_alarm + j + 1, (--pending_alarms - j) * sizeof(pending_alarm[0]));
+      }
+  }
+  else if (pending_replies && strncmp(text, "Digest:", 7) && !strcmp(number, pending_reply_to[0])) {
+    sms_reply++;
+    memmove(pending_reply_to, pending_reply_to + 1, (pending_replies - 1) * sizeof(pending_reply_to[0]));
+    memmove(pending_reply_us, pending_reply_us + 1, --pending_replies * sizeof(pending_reply_us[0]));
+  }
+  else
+    sms_other++;
+}
+
+static void set_input(int pin, bool low, uint64_t now_us) {
+  char text[32];
+
+  if (input_low[pin] == low)
+    return;
+  input_low[pin] = low;
+  hal_host_set_gpio(GPIO_PIN_FIRST + pin, !low);
+  edges++;
+// edges of inputs with digest delivery go into the digest, without latency
+  if (digest_input[pin])
+    digest_changes++;
+  else if (pending_alarms < MAX_PENDING) {
+    pending_alarm[pending_alarms].time_us = now_us;
+    pending_alarm[pending_alarms].pin = pin;
+    pending_alarm[pending_alarms++].text = low ? defaults.sms_on_fall[pin] : defaults.sms_on_rise[pin];
+  }
+  snprintf(text, sizeof(text), "%d %s", pin + 1, low ? "low" : "high");
+  print_event(now_us, "input", text);
+}
+
+static void run_step(const script_step_t* step, uint64_t now_us) {
+  char text[32];
+  int pin;
+
+  switch (step->action) {
+    case ACTION_INPUT_LOW:
+    case ACTION_INPUT_HIGH:
+      set_input(step->value, step->action == ACTION_INPUT_LOW, now_us);
+      break;
+    case ACTION_TOGGLE:
+      pin = (step->value < 0) ? (int)(scenario_random() % GPIO_NUMBER_PINS) : step->value;
+      set_input(pin, !input_low[pin], now_us);
+      break;
+    case ACTION_RELEASE_ALL:
+      for (pin = 0; pin < GPIO_NUMBER_PINS; pin++)
+        set_input(pin, false, now_us);
+      break;
+    case ACTION_SMS:
+      commands++;
+      if (modem_sim_inbound_sms(&modem, "+447700900001", step->text, now_us) < 0) {
+        sms_rejected++;
+        print_event(now_us, "SMS rejected (storage full):", step->text);
+      }
+      else {
+        if (pending_replies < MAX_PENDING) {
+          pending_reply_to[pending_replies] = defaults.tel_no;
+          pending_reply_us[pending_replies++] = now_us;
+        }
+        print_event(now_us, "SMS command", step->text);
+      }
+      break;
+    case ACTION_CALL:
+      modem_sim_incoming_call(&modem, step->text, now_us);
+      if (step->value && (pending_replies < MAX_PENDING)) {
+        pending_reply_to[pending_replies] = step->text;
+        pending_reply_us[pending_replies++] = now_us;
+      }
+      print_event(now_us, "call from", step->text);
+      break;
+    case ACTION_DIGEST:
+      snprintf(text, sizeof(text), "674358 Digest!%d", step->value + 1);
+      digest_input[step->value] = true;
+      commands++;
+      if (modem_sim_inbound_sms(&modem, "+447700900001", text, now_us) >= 0) {
+        if (pending_replies < MAX_PENDING) {
+          pending_reply_to[pending_replies] = defaults.tel_no;
+          pending_reply_us[pending_replies++] = now_us;
+        }
+        print_event(now_us, "SMS command", text);
+      }
+      break;
+    case ACTION_URC:
+      modem_sim_urc(&modem, step->text, now_us);
+      break;
+    case ACTION_LATENCY:
+      modem.latency_us = step->value * 1000;
+      snprintf(text, sizeof(text), "%d ms", step->value);
+      print_event(now_us, "modem latency", text);
+      break;
+    case ACTION_LOSS_ON_SEND:
+      loss_on_send_ms = step->value;
+      break;
+  }
+}
+
+// runs the script steps due by now, returns the time of the next one
+static uint64_t run_events(uint64_t now_us) {
+  const script_step_t* step;
+  uint64_t next = UINT64_MAX, due;
+  int i;
+
+  expire_alarms(now_us);
+  if (network_restore_us && (network_restore_us <= now_us)) {
+    modem.online = true;
+    modem_sim_network_time(&modem, now_us);
+    network_restore_us = 0;
+    print_event(now_us, "network restored", "");
+  }
+  for (i = 0; i < scenario->number_steps; i++) {
+    step = &scenario->steps[i];
+    while (step_runs[i] < step->count) {
+      due = SCENARIO_START_US + (uint64_t)(step->start_ms + step_runs[i] * step->interval_ms) * 1000;
+      if (due > now_us) {
+        if (due < next)
+          next = due;
+        break;
+      }
+      run_step(step, now_us);
+      step_runs[i]++;
+    }
+  }
+  if (network_restore_us && (network_restore_us < next))
+    next = network_restore_us;
+  if ((now_us < script_end_us) && (now_us + SCENARIO_TICK_US < next))
+    next = now_us + SCENARIO_TICK_US;
+  if (pending_alarms && (pending_alarm[0].time_us + ALARM_DEADLINE_US + 1 < next))
+    next = pending_alarm[0].time_us + ALARM_DEADLINE_US + 1;
+  if (pending_replies && (pending_reply_us[0] + ALARM_DEADLINE_US + 1 < next))
+    next = pending_reply_us[0] + ALARM_DEADLINE_US + 1;
+
+  return next;
+}
+
+// the modem sits behind this peer, so that the network can be taken away the moment an SMS is submitted (CTRL-Z)
+static void peer_receive(void* context, const char* data, size_t length, uint64_t now_us) {
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    if ((data[i] == '\x1a') && loss_on_send_ms) {
+      modem.online = false;
+      network_restore_us = now_us + (uint64_t)loss_on_send_ms * 1000;
+      loss_on_send_ms = 0;
+      print_event(now_us, "network lost while sending", "");
+    }
+  modem_sim_receive((modem_sim_t*)context, data, length, now_us);
+}
+
+static size_t peer_transmit(void* context, char* data, size_t length, uint64_t now_us) {
+  return modem_sim_transmit((modem_sim_t*)context, data, length, now_us);
+}
+
+static uint64_t peer_next_event_us(void* context) {
+  return modem_sim_next_event_us((modem_sim_t*)context);
+}
+
+// the default settings as the first version of the software stored them: the strings and the SMS actions of the
+// inputs, with the rest of the sector left erased, under the same checksum
+static void baseline_flash(uint8_t* flash_settings) {
+  int i, l = 1;
+
+  memset(flash_settings, 0xff, FLASH_SETTINGS_BYTES);
+  memcpy(&flash_settings[l], defaults.passw, strlen(defaults.passw) + 1);
+  l += strlen(defaults.passw) + 1;
+  memcpy(&flash_settings[l], defaults.tel_no, strlen(defaults.tel_no) + 1);
+  l += strlen(defaults.tel_no) + 1;
+  for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+    memcpy(&flash_settings[l], defaults.sms_on_fall[i], strlen(defaults.sms_on_fall[i]) + 1);
+    l += strlen(defaults.sms_on_fall[i]) + 1;
+  }
+  for (i = 0; i < GPIO_NUMBER_PINS; i++) {
+    memcpy(&flash_settings[l], defaults.sms_on_rise[i], strlen(defaults.sms_on_rise[i]) + 1);
+    l += strlen(defaults.sms_on_rise[i]) + 1;
+  }
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    flash_settings[l++] = defaults.send_sms_on_change[i];
+  flash_settings[0] = config_checksum(flash_settings);
+}
+
+// the settings of the first version are taken, with every input immediate and none of the later settings
+static bool baseline_parsed(const uint8_t* flash_settings) {
+  config_t config;
+  bool ok;
+  int i;
+
+  ok = config_parse(&config, flash_settings) && !strcmp(config.passw, defaults.passw) &&
+       !strcmp(config.tel_no, defaults.tel_no) && !config.modem_id[0] && !config.modem_capabilities &&
+       !config.network_plmn[0] && (config.missed_call_command == MISSED_CALL_NONE);
+  for (i = 0; i < GPIO_NUMBER_PINS; i++)
+    ok = ok && !config.digest[i] && !strcmp(config.sms_on_fall[i], defaults.sms_on_fall[i]) &&
+         (config.send_sms_on_change[i] == defaults.send_sms_on_change[i]);
+  for (i = 0; i < CONFIG_NUMBER_CALLERS; i++)
+    ok = ok && !config.callers[i][0];
+  if (!ok)
+    fprintf(stderr, "alarmdial_scenarios: settings of the first version not read as such\n");
+
+  return ok;
+}
+
+static int compare_samples(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+static bool run_scenario(const scenario_t* s, const char* trace_prefix) {
+  static const hal_sim_uart_peer_t peer = { &modem, peer_receive, peer_transmit, peer_next_event_us };
+  static volatile uint32_t reboots;
+  static uint64_t end_us;
+  static uint32_t watchdog_timeouts, rx_overruns;
+  static FILE* trace;
+  const script_step_t* step;
+  uint8_t flash_settings[FLASH_SETTINGS_BYTES];
+  char file_name[4096];
+  bool settings_ok = true;
+  uint64_t last;
+  uint32_t n;
+  int i;
+
+  scenario = s;
+  memset(step_runs, 0, sizeof(step_runs));
+  script_end_us = SCENARIO_START_US;
+  for (i = 0; i < s->number_steps; i++) {
+    step = &s->steps[i];
+    last = SCENARIO_START_US + (uint64_t)(step->start_ms + (step->count - 1) * step->interval_ms) * 1000;
+    if (last > script_end_us)
+      script_end_us = last;
+  }
+  end_us = script_end_us + SCENARIO_DRAIN_US;
+  loss_on_send_ms = 0;
+  network_restore_us = 0;
+  pending_alarms = pending_replies = 0;
+  memset(input_low, 0, sizeof(input_low));
+  memcpy(digest_input, defaults.digest, sizeof(digest_input));
+  digest_changes = digest_reported = 0;
+  alarm_latencies = edges = commands = alarms_lost = replies_lost = sms_rejected = 0;
+  sms_alarm = sms_reply = sms_other = 0;
+  reboots = 0;
+  random_state = seed;
+  watchdog_timeouts = hal_sim_watchdog_timeouts();
+  rx_overruns = hal_sim_rx_overruns();
+
+  trace = NULL;
+  if (trace_prefix) {
+    snprintf(file_name, sizeof(file_name), "%s-%s.trace", trace_prefix, s->name);
+    trace = fopen(file_name, "w");
+    if (!trace) {
+      fprintf(stderr, "alarmdial_scenarios: cannot open %s\n", file_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (verbose)
+    printf("%s: %s\n", s->name, s->description);
+
+// a fresh device: blank flash (or the settings of the first version), power-up of logic and modem at time 0
+  hal_sim_power_cycle();
+  hal_init();
+  modem_sim_init(&modem, seed);
+  modem.quectel = MODEM_QUECTEL;
+  modem.model = MODEM_NAME;
+  modem.sms_sent = sms_sent;
+  if (s->baseline_flash) {
+    baseline_flash(flash_settings);
+    settings_ok = baseline_parsed(flash_settings);
+    hal_sim_load_flash(flash_settings, FLASH_SETTINGS_BYTES);
+  }
+  hal_sim_attach_uart(&peer);
+  hal_sim_attach_modem_pins(&modem);
+  hal_sim_set_event_handler(run_events);
+  hal_sim_set_trace(trace);
+
+  if (setjmp(hal_sim_reboot)) {
+    reboots++;
+    print_event(hal_sim_now_us(), "reboot", reboot_reason_text[reboot_record.reason < REBOOT_REASON_MAX ? reboot_record.reason : 0]);
+  }
+  if (hal_sim_now_us() < end_us) {
+    dialler_setup();
+    while (hal_sim_now_us() < end_us)
+      dialler_loop();
+  }
+  hal_sim_set_trace(NULL);
+  if (trace)
+    fclose(trace);
+
+// the run has lasted past every deadline, so whatever is still waiting is lost
+  expire_alarms(hal_sim_now_us());
+  alarms_lost += pending_alarms;
+  replies_lost += pending_replies;
+// the other scenarios end long before the digest hour, so only those without loss wait for every change in a digest
+  if (s->lossless && (digest_reported < digest_changes))
+    alarms_lost += digest_changes - digest_reported;
+  watchdog_timeouts = hal_sim_watchdog_timeouts() - watchdog_timeouts;
+  rx_overruns = hal_sim_rx_overruns() - rx_overruns;
+
+  printf("%-13s %5u %5u ", s->name, edges, commands);
+  n = alarm_latencies;
+  if (n) {
+    qsort(alarm_latency_us, n, sizeof(alarm_latency_us[0]), compare_samples);
+    printf("%8.3f %8.3f %8.3f ", alarm_latency_us[n / 2] / 1e6, alarm_latency_us[n * 99 / 100] / 1e6,
+           alarm_latency_us[n - 1] / 1e6);
+  }
+  else
+    printf("%8s %8s %8s ", "-", "-", "-");
+  printf("%5u %6u %6u %7u %7u %8u\n", alarms_lost + replies_lost + sms_rejected, alarms_lost,
+         replies_lost + sms_rejected, reboots, watchdog_timeouts, rx_overruns);
+
+  return !watchdog_timeouts && !modem.sleep_lost_chars && settings_ok && !(s->baseline_flash && alarms_lost) &&
+         !(s->lossless && (alarms_lost + replies_lost + sms_rejected));
+}
+
+int main(int argc, char* argv[]) {
+  bool ok = true, found;
+  const char* trace_prefix = NULL;
+  int opt, i, j;
+
+  while ((opt = getopt(argc, argv, "r:t:vz")) != -1) {
+    switch (opt) {
+      case 'r': seed = ((uint32_t)strtoul(optarg, NULL, 0) * 2654435761u) ^ 0x2545f491; break;
+      case 't': trace_prefix = optarg; break;
+      case 'v': verbose = true; break;
+      case 'z': modem_sleep = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-r seed] [-t trace_prefix] [-v] [-z] [scenario ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (!seed)
+    seed = 1;
+  for (i = optind; i < argc; i++) {
+    found = false;
+    for (j = 0; j < NUMBER_SCENARIOS; j++)
+      found = found || !strcmp(argv[i], scenarios[j].name);
+    if (!found) {
+      fprintf(stderr, "alarmdial_scenarios: unknown scenario %s, available:", argv[i]);
+      for (j = 0; j < NUMBER_SCENARIOS; j++)
+        fprintf(stderr, " %s", scenarios[j].name);
+      fprintf(stderr, "\n");
+      return EXIT_FAILURE;
+    }
+  }
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  config_set_defaults(&defaults);
+  hal_stack_paint();
+
+// latencies in seconds from the input edge to the +CMGS of its SMS, lost events are input edges without SMS and SMS
+// commands without reply (including those the modem could not store), watchdog counts hangs, overrun the characters
+// from the modem lost while the flash was written
+  printf("%-13s %5s %5s %8s %8s %8s %5s %6s %6s %7s %7s %8s\n", "scenario", "edges", "cmds", "p50", "p99", "max",
+         "lost", "alarms", "cmds", "reboots", "wdog", "overrun");
+  for (i = 0; i < NUMBER_SCENARIOS; i++) {
+    found = optind == argc;
+    for (j = optind; j < argc; j++)
+      found = found || !strcmp(argv[j], scenarios[i].name);
+    if (found)
+      ok = run_scenario(&scenarios[i], trace_prefix) && ok;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
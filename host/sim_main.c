@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "diagnostics.h"
+#include "digest.h"
+#include "dialler.h"
+#include "energy.h"
+#include "format.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "hal_sim.h"
+#include "modem.h"
+#include "modem_sim.h"
+#include "power.h"
+#include "wallclock.h"
+
+// alarmdial_sim: runs the AlarmDial logic against the simulated modem in virtual time, through a randomised scenario of
+// alarm inputs (with the alarm system armed and disarmed twice a day), SMS commands, calls, stray URCs and modem faults,
+// and reports metrics at the end
+//
+// usage: alarmdial_sim [-b] [-d days] [-r seed] [-s] [-t trace] [-v] [-z]
+//   -b  battery backup: supply sensing on, with power cuts during which the logic runs in battery mode, reports the
+//       charge used on battery as estimated by the logic and as simulated (use with -z for PSM and eDRX)
+//   -d  simulated time in days (default 183, about six months)
+//   -r  seed of the random number generator, the same seed gives the same run
+//   -s  soak mode: the modem also injects protocol faults (random bytes, truncated lines, duplicate URCs, missing OKs,
+//       spontaneous resets), and the time the logic takes to return to its clean idle state after each is measured
+//   -t  records the UART traffic and input changes in a trace file, for alarmdial_replay
+//   -v  prints the scenario events and the SMS sent
+//   -z  modem sleep mode (AT+CSCLK=1 with DTR and RI), reports the wake-ups and the average current of the modem
+//
+// the exit status is EXIT_FAILURE if the logic hung (watchdog timeout), if an alarm input change was lost while no
+// modem fault was active (except in soak mode, where protocol faults may hit any SMS), in soak mode if the logic did
+// not recover from a protocol fault within RECOVERY_LIMIT_US, or if a character was sent to the modem while it slept
+
+#define SECOND_US 1000000ULL
+#define MINUTE_US (60 * SECOND_US)
+#define HOUR_US (60 * MINUTE_US)
+#define DAY_US (24 * HOUR_US)
+
+// an alarm SMS (or command reply) is counted as lost if it has not been sent within this time of the input change
+#define ALARM_DEADLINE_US (10 * MINUTE_US)
+
+// an input change with digest delivery is counted as overdue if no digest has been sent within this time (a digest
+// that does not get through during a modem fault is sent again once an hour)
+#define DIGEST_DEADLINE_US (DIGEST_MAX_AGE_US + ALARM_DEADLINE_US)
+
+// the input the alarm system reports its arming on (digest delivery by default)
+#define ARM_INPUT 1
+
+// the network time runs faster than the Pico's clock by this much, within the tolerance of its crystal
+#define NETWORK_CLOCK_PPM 30
+
+#define MAX_PENDING 256
+#define MAX_SAMPLES 65536
+
+// in soak mode, the probability of each protocol fault per line concerned (in 1/1000), and the time after which a
+// fault the logic has not recovered from counts as a permanent hang
+static const int soak_fault_permille[MODEM_SIM_FAULT_RESET] = { 20, 20, 50, 20 };
+#define RECOVERY_LIMIT_US HOUR_US
+#define MAX_OPEN_FAULTS 64
+#define MAX_RECOVERIES 16384
+
+// scenario events, each with its own (mean) interval, the faults end after a random duration
+#define EVENT_INPUT          0
+#define EVENT_SMS            1
+#define EVENT_CALL           2
+#define EVENT_URC            3
+#define EVENT_NETWORK_LOSS   4
+#define EVENT_ERROR_BURST    5
+#define EVENT_SLOW_MODEM     6
+#define EVENT_MODEM_HANG     7
+#define EVENT_MODEM_RESET    8   // soak mode only
+#define EVENT_POWER_CUT      9   // battery backup only
+#define EVENT_ARM            10
+#define EVENT_MAX            11
+
+static const uint64_t event_mean_interval_us[EVENT_MAX] = {
+  12 * HOUR_US, 2 * DAY_US, 5 * DAY_US, 7 * DAY_US, 20 * DAY_US, 10 * DAY_US, 10 * DAY_US, 30 * DAY_US, 3 * DAY_US,
+  15 * DAY_US, 12 * HOUR_US
+};
+static const uint64_t fault_max_duration_us[EVENT_MAX] = {
+  0, 0, 0, 0, 48 * HOUR_US, 12 * HOUR_US, 12 * HOUR_US, 5 * MINUTE_US, 0, 48 * HOUR_US, 0
+};
+static const char* const event_name[EVENT_MAX] = {
+  "input change", "SMS command", "call", "stray URC", "network loss", "error burst", "slow modem", "modem hang",
+  "modem reset", "power cut", "arm/disarm"
+};
+static const char* const fault_name[MODEM_SIM_FAULT_MAX] = {
+  "random bytes", "truncated line", "duplicate URC", "missing OK", "modem reset"
+};
+
+static modem_sim_t modem;
+// the logic starts from the default configuration, and the scenario does not change it
+static config_t defaults;
+static uint32_t random_state;
+static bool verbose = false;
+static bool soak = false;
+static bool battery = false;
+
+// on battery, a command may be held back by the network until the modem leaves PSM, at the latest at the next periodic
+// tracking area update (T3412)
+#define BATTERY_REPLY_DEADLINE_US (ALARM_DEADLINE_US + HOUR_US)
+static uint64_t reply_deadline_us = ALARM_DEADLINE_US;
+
+static uint64_t next_event_us[EVENT_MAX];
+static uint64_t fault_end_us[EVENT_MAX];
+static uint32_t event_count[EVENT_MAX];
+
+// alarm input changes and SMS commands waiting for their SMS
+typedef struct {
+  uint64_t time_us;
+  const char* text;
+  bool fault_free;
+} pending_t;
+
+static pending_t pending_alarm[MAX_PENDING];
+static int pending_alarms = 0;
+static uint64_t pending_reply_us[MAX_PENDING];
+static int pending_replies = 0;
+static uint64_t pending_digest_us[MAX_PENDING];
+static int pending_digests = 0;
+
+static bool input_low[GPIO_NUMBER_PINS];
+
+// latency samples and counters
+static uint64_t alarm_latency_us[MAX_SAMPLES];
+static uint32_t alarm_latencies = 0;
+static uint64_t reply_latency_us[MAX_SAMPLES];
+static uint32_t reply_latencies = 0;
+static uint64_t digest_latency_us[MAX_SAMPLES];
+static uint32_t digest_latencies = 0;
+static uint32_t alarms_lost = 0, alarms_lost_fault_free = 0, replies_lost = 0, digests_overdue = 0;
+static uint32_t sms_alarm = 0, sms_reply = 0, sms_digest = 0, sms_other = 0;
+static uint32_t wallclock_checks = 0;
+// time from the reset of the modem to its registration at each boot, with the full search and when pointed to the
+// network it was last registered with
+static uint32_t registrations[2] = { 0, 0 }, boots_unregistered = 0;
+static uint64_t registration_sum_ms[2] = { 0, 0 };
+static uint32_t registration_max_ms[2] = { 0, 0 };
+static int64_t wallclock_error_max_ms = 0;
+
+// the logic may still be in battery mode when a cut follows straight on another, so its estimate is taken as difference
+static double estimate_mah(void) {
+  return power_mode == POWER_BATTERY ? power_battery_used_nas(hal_time_us()) / 3.6e9 : 0;
+}
+
+// charge of the Pico since its last boot, at the figures of the logic for the time in each clock state
+static double pico_charge_uas(void) {
+  static const uint32_t current_ua[POWER_CPU_STATES] = {
+    POWER_CURRENT_PICO_FAST_UA, POWER_CURRENT_PICO_SLOW_UA, POWER_CURRENT_PICO_SLEEP_UA
+  };
+  double charge = 0;
+  int i;
+
+  for (i = 0; i < POWER_CPU_STATES; i++)
+    charge += power_cpu_residency(i, hal_time_us()) / 1e6 * current_ua[i];
+
+  return charge;
+}
+
+// charge used during the power cuts, as estimated by the logic and as simulated: the modem at the currents of its states
+// (modem_sim_charge_uas), the Pico and the SMS sent at the figures of the logic, as the simulation has no model of them
+static uint64_t cut_start_us;
+static double cut_start_modem_uas, cut_start_pico_uas, cut_start_estimate_mah;
+static uint32_t cut_sms;
+static uint64_t battery_time_us = 0;
+static double battery_estimate_mah = 0, battery_simulated_mah = 0;
+static uint64_t battery_edrx_us = 0, battery_psm_us = 0, cut_start_edrx_us, cut_start_psm_us;
+
+// protocol faults waiting for the logic to return to its clean idle state, and the recovery times
+typedef struct {
+  uint64_t time_us;
+  int fault;
+  bool hang;
+} open_fault_t;
+
+static open_fault_t open_fault[MAX_OPEN_FAULTS];
+static int open_faults = 0;
+static uint64_t recovery_us[MODEM_SIM_FAULT_MAX][MAX_RECOVERIES];
+static uint32_t recoveries[MODEM_SIM_FAULT_MAX];
+static uint32_t hangs[MODEM_SIM_FAULT_MAX];
+
+static uint32_t scenario_random(void) {
+  uint32_t x = random_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+
+  return x;
+}
+
+// uniformly distributed in [0, 2 * mean), so the mean is as specified
+static uint64_t random_interval(uint64_t mean_us) {
+  return ((uint64_t)scenario_random() * 2 * (mean_us / 1000) >> 32) * 1000;
+}
+
+static void print_time(uint64_t time_us) {
+  printf("%3llud %02llu:%02llu:%02llu.%03llu ", (unsigned long long)(time_us / DAY_US),
+         (unsigned long long)(time_us % DAY_US / HOUR_US), (unsigned long long)(time_us % HOUR_US / MINUTE_US),
+         (unsigned long long)(time_us % MINUTE_US / SECOND_US), (unsigned long long)(time_us % SECOND_US / 1000));
+}
+
+// alarm changes and commands without SMS by their deadline are lost, changes for the digest are overdue
+static void expire_alarms(uint64_t now_us) {
+  while (pending_digests && (now_us - pending_digest_us[0] > DIGEST_DEADLINE_US)) {
+    digests_overdue++;
+    memmove(pending_digest_us, pending_digest_us + 1, --pending_digests * sizeof(pending_digest_us[0]));
+  }
+  while (pending_replies && (now_us - pending_reply_us[0] > reply_deadline_us)) {
+    replies_lost++;
+    memmove(pending_reply_us, pending_reply_us + 1, --pending_replies * sizeof(pending_reply_us[0]));
+  }
+  while (pending_alarms && (now_us - pending_alarm[0].time_us > ALARM_DEADLINE_US)) {
+    alarms_lost++;
+    if (pending_alarm[0].fault_free)
+      alarms_lost_fault_free++;
+    if (verbose) {
+      print_time(now_us);
+      printf("lost: %s\n", pending_alarm[0].text);
+    }
+    memmove(pending_alarm, pending_alarm + 1, --pending_alarms * sizeof(pending_alarm[0]));
+  }
+}
+
+// an alarm SMS is the text for the input change, followed by the time of the change once the logic has the network time
+static bool alarm_text(const char* sms, const char* text) {
+  size_t l = strlen(text);
+
+  return !strncmp(sms, text, l) && (!sms[l] || !strncmp(&sms[l], " at ", 4));
+}
+
+// the modem has sent an SMS, it is matched with the oldest alarm change or command waiting for it
+// the wall clock of the logic is compared with the network time at each SMS
+static void sms_sent(void* context, const char* number, const char* text, uint64_t time_us) {
+  int64_t error_ms;
+  int i;
+
+  (void)context;
+  (void)number;
+  if (verbose) {
+    print_time(time_us);
+    printf("SMS: %s\n", text);
+  }
+  if (fault_end_us[EVENT_POWER_CUT])
+    cut_sms++;
+  if (wallclock_valid()) {
+    error_ms = (int64_t)(wallclock_ms(hal_time_us()) - modem_sim_network_time_ms(&modem, hal_sim_now_us()));
+    if (llabs(error_ms) > wallclock_error_max_ms)
+      wallclock_error_max_ms = llabs(error_ms);
+    wallclock_checks++;
+  }
+  expire_alarms(time_us);
+  for (i = 0; i < pending_alarms; i++)
+    if (alarm_text(text, pending_alarm[i].text))
+      break;
+  if (!strncmp(text, "Digest:", 7)) {
+    sms_digest++;
+    while (pending_digests && (pending_digest_us[0] < time_us)) {
+      if (digest_latencies < MAX_SAMPLES)
+        digest_latency_us[digest_latencies++] = time_us - pending_digest_us[0];
+      memmove(pending_digest_us, pending_digest_us + 1, --pending_digests * sizeof(pending_digest_us[0]));
+    }
+  }
+  else if (i < pending_alarms) {
+    sms_alarm++;
+    if (alarm_latencies < MAX_SAMPLES)
+      alarm_latency_us[alarm_latencies++] = time_us - pending_alarm[i].time_us;
+    memmove(pending_alarm + i, pending_alarm + i + 1, (--pending_alarms - i) * sizeof(pending_alarm[0]));
+  }
+  else if (pending_replies && (!strncmp(text, "Signal quality", 14) || !strncmp(text, "Uptime", 6) ||
+                               !strncmp(text, "mAh/day", 7) || !strcmp(text, "Invalid instruction"))) {
+    sms_reply++;
+    if (reply_latencies < MAX_SAMPLES)
+      reply_latency_us[reply_latencies++] = time_us - pending_reply_us[0];
+    memmove(pending_reply_us, pending_reply_us + 1, --pending_replies * sizeof(pending_reply_us[0]));
+  }
+  else
+    sms_other++;
+}
+
+// toggles an input, its change waits for an alarm SMS or for the digest
+static void toggle_input(int pin, uint64_t now_us, char* text, size_t size) {
+  input_low[pin] = !input_low[pin];
+  hal_host_set_gpio(GPIO_PIN_FIRST + pin, !input_low[pin]);
+  if (defaults.digest[pin]) {
+    if (pending_digests < MAX_PENDING)
+      pending_digest_us[pending_digests++] = now_us;
+  }
+  else if (pending_alarms < MAX_PENDING) {
+    pending_alarm[pending_alarms].time_us = now_us;
+    pending_alarm[pending_alarms].text = input_low[pin] ? defaults.sms_on_fall[pin] : defaults.sms_on_rise[pin];
+    pending_alarm[pending_alarms++].fault_free = !fault_end_us[EVENT_NETWORK_LOSS] && !fault_end_us[EVENT_ERROR_BURST] &&
+                                                  !fault_end_us[EVENT_SLOW_MODEM] && !fault_end_us[EVENT_MODEM_HANG];
+  }
+  snprintf(text, size, "input %d %s", pin + 1, input_low[pin] ? "low" : "high");
+}
+
+// starts one scenario event, returns the time at which a fault ends (0 for events that are not faults)
+static uint64_t start_event(int event, uint64_t now_us) {
+  static const char* const commands[] = { "Signal?", "Status?", "Energy?", "Status?", "Weather?" };
+  char text[MODEM_SIM_TEXT_LENGTH];
+  uint32_t r = scenario_random();
+  int pin;
+
+  text[0] = 0;
+  switch (event) {
+    case EVENT_INPUT:
+      pin = r % GPIO_NUMBER_PINS;
+      toggle_input(pin, now_us, text, sizeof(text));
+      break;
+    case EVENT_ARM:
+      toggle_input(ARM_INPUT, now_us, text, sizeof(text));
+      break;
+    case EVENT_SMS:
+// mostly valid commands, some unknown to the logic (answered with Invalid instruction) and some with a wrong password
+      if (r % 10 == 0)
+        snprintf(text, sizeof(text), "123456 Signal?");
+      else {
+        snprintf(text, sizeof(text), "%s %s", defaults.passw, commands[r % 5]);
+        if (pending_replies < MAX_PENDING)
+          pending_reply_us[pending_replies++] = now_us;
+      }
+      if (modem_sim_inbound_sms(&modem, "+447700900001", text, now_us) < 0)
+        snprintf(text, sizeof(text), "SMS storage full");
+      break;
+    case EVENT_CALL:
+// half of the calls come from the configured number, whose missed calls are answered with the status
+      snprintf(text, sizeof(text), "from %s", r & 1 ? defaults.tel_no : "+447700900002");
+      modem_sim_incoming_call(&modem, &text[5], now_us);
+      if ((r & 1) && (pending_replies < MAX_PENDING))
+        pending_reply_us[pending_replies++] = now_us;
+      break;
+    case EVENT_URC:
+      snprintf(text, sizeof(text), "%s", r & 1 ? "+CGEV: ME PDN DEACT 1" : "+CPIN: NOT READY");
+      modem_sim_urc(&modem, text, now_us);
+      break;
+    case EVENT_NETWORK_LOSS:
+      modem.online = false;
+      break;
+    case EVENT_ERROR_BURST:
+      modem.error_percent = 30;
+      break;
+    case EVENT_SLOW_MODEM:
+      modem.latency_us = 5000000;
+      break;
+    case EVENT_MODEM_HANG:
+      modem.hung = true;
+      break;
+    case EVENT_MODEM_RESET:
+      modem_sim_reset(&modem, now_us);
+      break;
+    case EVENT_POWER_CUT:
+      hal_host_set_gpio(GPIO_PIN_SUPPLY_SENSE, true);
+      cut_start_us = now_us;
+      cut_start_modem_uas = modem_sim_charge_uas(&modem, now_us);
+      cut_start_pico_uas = pico_charge_uas();
+      cut_start_estimate_mah = estimate_mah();
+      modem_sim_sleep_time_us(&modem, now_us);
+      cut_start_edrx_us = modem.edrx_time_us;
+      cut_start_psm_us = modem.psm_time_us;
+      cut_sms = 0;
+      break;
+  }
+  event_count[event]++;
+  if (verbose) {
+    print_time(now_us);
+    printf("%s %s\n", event_name[event], text);
+  }
+
+  return fault_max_duration_us[event] ? now_us + 1 + random_interval(fault_max_duration_us[event] / 2) : 0;
+}
+
+// accounts the power cut up to now, the estimate of the logic only covers the time it has been in battery mode
+static void account_power_cut(uint64_t now_us) {
+  double cut_estimate_mah = estimate_mah() - cut_start_estimate_mah;
+  double simulated_mah = (pico_charge_uas() - cut_start_pico_uas + (double)cut_sms * POWER_SMS_CHARGE_UAS +
+                          modem_sim_charge_uas(&modem, now_us) - cut_start_modem_uas) / 3.6e6;
+
+  battery_time_us += now_us - cut_start_us;
+  battery_estimate_mah += cut_estimate_mah;
+  battery_simulated_mah += simulated_mah;
+  modem_sim_sleep_time_us(&modem, now_us);
+  battery_edrx_us += modem.edrx_time_us - cut_start_edrx_us;
+  battery_psm_us += modem.psm_time_us - cut_start_psm_us;
+  if (verbose) {
+    print_time(now_us);
+    printf("power cut of %.1f h: %.1f mAh estimated by the logic, %.1f mAh simulated\n",
+           (now_us - cut_start_us) / (double)HOUR_US, cut_estimate_mah, simulated_mah);
+  }
+}
+
+// ends a fault
+static void end_fault(int event, uint64_t now_us) {
+  switch (event) {
+    case EVENT_NETWORK_LOSS:
+      modem.online = true;
+      modem_sim_network_time(&modem, now_us);
+      break;
+    case EVENT_ERROR_BURST: modem.error_percent = 0; break;
+    case EVENT_SLOW_MODEM: modem.latency_us = 20000; break;
+    case EVENT_MODEM_HANG: modem.hung = false; break;
+    case EVENT_POWER_CUT:
+      account_power_cut(now_us);
+      hal_host_set_gpio(GPIO_PIN_SUPPLY_SENSE, false);
+      break;
+  }
+  if (verbose) {
+    print_time(now_us);
+    printf("%s ends\n", event_name[event]);
+  }
+}
+
+// runs the scenario events due by now, returns the time of the next one
+static uint64_t run_events(uint64_t now_us) {
+  uint64_t next = UINT64_MAX;
+  int i;
+
+  expire_alarms(now_us);
+  for (i = 0; i < EVENT_MAX; i++) {
+    if (fault_end_us[i] && (fault_end_us[i] <= now_us)) {
+      end_fault(i, now_us);
+      fault_end_us[i] = 0;
+    }
+// a fault does not start again while it lasts, it is postponed to its end
+    if ((next_event_us[i] <= now_us) && fault_end_us[i])
+      next_event_us[i] = fault_end_us[i];
+    else if (next_event_us[i] <= now_us) {
+      fault_end_us[i] = start_event(i, now_us);
+      next_event_us[i] = now_us + 1 + random_interval(event_mean_interval_us[i]);
+    }
+    if (next_event_us[i] < next)
+      next = next_event_us[i];
+    if (fault_end_us[i] && (fault_end_us[i] < next))
+      next = fault_end_us[i];
+  }
+  if (pending_alarms && (pending_alarm[0].time_us + ALARM_DEADLINE_US + 1 < next))
+    next = pending_alarm[0].time_us + ALARM_DEADLINE_US + 1;
+  if (pending_replies && (pending_reply_us[0] + reply_deadline_us + 1 < next))
+    next = pending_reply_us[0] + reply_deadline_us + 1;
+  if (pending_digests && (pending_digest_us[0] + DIGEST_DEADLINE_US + 1 < next))
+    next = pending_digest_us[0] + DIGEST_DEADLINE_US + 1;
+
+  return next;
+}
+
+// the modem has injected a protocol fault, it is open until the logic is back in its clean idle state
+static void modem_fault(void* context, int fault, uint64_t now_us) {
+  (void)context;
+  if (verbose) {
+    print_time(now_us);
+    printf("fault: %s\n", fault_name[fault]);
+  }
+  if (open_faults < MAX_OPEN_FAULTS) {
+    open_fault[open_faults].time_us = now_us;
+    open_fault[open_faults].fault = fault;
+    open_fault[open_faults++].hang = false;
+  }
+}
+
+// clean idle: the logic has nothing in progress, the modem has sent everything and is configured as the logic set it
+// up (a spontaneous reset loses the configuration)
+static void check_recovery(uint64_t now_us) {
+  int i, fault;
+
+  if (dialler_idle() && !modem.queue_entries && !modem.booting && !modem.echo && modem.text_mode && \
+      (modem.sleep_clock == modem_sleep)) {
+    for (i = 0; i < open_faults; i++) {
+      fault = open_fault[i].fault;
+      if (recoveries[fault] < MAX_RECOVERIES)
+        recovery_us[fault][recoveries[fault]++] = now_us - open_fault[i].time_us;
+    }
+    open_faults = 0;
+    return;
+  }
+  for (i = 0; i < open_faults; i++)
+    if (!open_fault[i].hang && (now_us - open_fault[i].time_us > RECOVERY_LIMIT_US)) {
+      open_fault[i].hang = true;
+      hangs[open_fault[i].fault]++;
+      if (verbose) {
+        print_time(now_us);
+        printf("no recovery from %s within %llu s\n", fault_name[open_fault[i].fault],
+               (unsigned long long)(RECOVERY_LIMIT_US / SECOND_US));
+      }
+    }
+}
+
+static int compare_samples(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+static void print_latencies(const char* name, uint64_t* samples, uint32_t n) {
+  if (!n) {
+    printf("%-24s none\n", name);
+    return;
+  }
+  qsort(samples, n, sizeof(samples[0]), compare_samples);
+  printf("%-24s p50 %.3f s, p99 %.3f s, max %.3f s (%u)\n", name, samples[n / 2] / 1e6, samples[n * 99 / 100] / 1e6,
+         samples[n - 1] / 1e6, n);
+}
+
+int main(int argc, char* argv[]) {
+  static volatile uint64_t loops = 0;
+  static volatile uint32_t reboots = 0;
+  uint64_t end_us = 183 * DAY_US, uptime_us;
+  struct timespec start, stop;
+  FILE* trace = NULL;
+  uint32_t total_faults = 0, total_hangs = 0;
+  double wall_s, sleep_share;
+  format_t format;
+  char energy[max_str_l];
+  int opt, i;
+
+  random_state = 0x9e3779b9;
+  while ((opt = getopt(argc, argv, "bd:r:st:vz")) != -1) {
+    switch (opt) {
+      case 'b': battery = true; break;
+      case 'd': end_us = (uint64_t)(atof(optarg) * DAY_US); break;
+      case 'r': random_state = ((uint32_t)strtoul(optarg, NULL, 0) * 2654435761u) ^ 0x2545f491; break;
+      case 't':
+        trace = fopen(optarg, "w");
+        if (!trace) {
+          fprintf(stderr, "alarmdial_sim: cannot open %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's': soak = true; break;
+      case 'v': verbose = true; break;
+      case 'z': modem_sleep = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-b] [-d days] [-r seed] [-s] [-t trace] [-v] [-z]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (!random_state)
+    random_state = 1;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+// the logic starts after the modem has been powered up, the first events follow at random
+  config_set_defaults(&defaults);
+  modem_sim_init(&modem, random_state);
+  modem.quectel = MODEM_QUECTEL;
+  modem.model = MODEM_NAME;
+  modem.sms_sent = sms_sent;
+  modem.clock_ppm = NETWORK_CLOCK_PPM;
+  for (i = 0; i < EVENT_MAX; i++)
+    next_event_us[i] = (((i == EVENT_MODEM_RESET) && !soak) || ((i == EVENT_POWER_CUT) && !battery)) ? UINT64_MAX :
+                       5 * MINUTE_US + random_interval(event_mean_interval_us[i]);
+  if (soak) {
+    memcpy(modem.fault_permille, soak_fault_permille, sizeof(modem.fault_permille));
+    modem.fault = modem_fault;
+  }
+  hal_sim_attach_modem(&modem);
+  hal_sim_set_event_handler(run_events);
+  hal_sim_set_trace(trace);
+  hal_stack_paint();
+  hal_init();
+// the supply sense pin is low while the external supply is present
+  if (battery) {
+    power_supply_sense = true;
+    reply_deadline_us = BATTERY_REPLY_DEADLINE_US;
+    hal_host_set_gpio(GPIO_PIN_SUPPLY_SENSE, false);
+  }
+
+  if (setjmp(hal_sim_reboot)) {
+    reboots++;
+    if (verbose) {
+      print_time(hal_sim_now_us());
+      printf("reboot (%s)\n", reboot_reason_text[reboot_record.reason < REBOOT_REASON_MAX ? reboot_record.reason : 0]);
+    }
+  }
+  if (hal_sim_now_us() < end_us) {
+    dialler_setup();
+    if (!modem_registration_ms)
+      boots_unregistered++;
+    else {
+      registrations[modem_registration_cached]++;
+      registration_sum_ms[modem_registration_cached] += modem_registration_ms;
+      if (modem_registration_ms > registration_max_ms[modem_registration_cached])
+        registration_max_ms[modem_registration_cached] = modem_registration_ms;
+    }
+    while (hal_sim_now_us() < end_us) {
+      dialler_loop();
+      loops++;
+      if (open_faults)
+        check_recovery(hal_sim_now_us());
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  wall_s = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+// alarm changes still waiting at the end are not counted as lost unless their deadline has passed, a power cut still
+// going on is accounted up to the end
+  expire_alarms(hal_sim_now_us());
+  if (fault_end_us[EVENT_POWER_CUT])
+    account_power_cut(hal_sim_now_us());
+
+  printf("simulated %.1f days in %.2f s (speed-up %.0f), %llu loop traversals\n", hal_sim_now_us() / (double)DAY_US,
+         wall_s, hal_sim_now_us() / 1e6 / wall_s, (unsigned long long)loops);
+  printf("events:");
+  for (i = 0; i < EVENT_MAX; i++)
+    printf(" %s %u%s", event_name[i], event_count[i], i < EVENT_MAX - 1 ? "," : "\n");
+  printf("reboots %u: %u watchdog (%u hangs), %u modem offline, %u hardfault\n", reboots,
+         reboot_record.count[REBOOT_REASON_WATCHDOG], hal_sim_watchdog_timeouts(),
+         reboot_record.count[REBOOT_REASON_MODEM_OFFLINE], reboot_record.count[REBOOT_REASON_HARDFAULT]);
+  printf("registration after the modem reset: %u boots with the full search (mean %.1f s, max %.1f s), %u with the "
+         "last network (mean %.1f s, max %.1f s), %u unregistered\n", registrations[0],
+         registration_sum_ms[0] / 1e3 / (registrations[0] ? registrations[0] : 1), registration_max_ms[0] / 1e3,
+         registrations[1], registration_sum_ms[1] / 1e3 / (registrations[1] ? registrations[1] : 1),
+         registration_max_ms[1] / 1e3, boots_unregistered);
+  uptime_us = hal_time_us();
+  printf("MCU since the last boot: fast clock %.1f s, slow clock %.1f s, asleep %.1f h\n",
+         power_cpu_residency(POWER_CPU_FAST, uptime_us) / 1e6, power_cpu_residency(POWER_CPU_SLOW, uptime_us) / 1e6,
+         power_cpu_residency(POWER_CPU_SLEEP, uptime_us) / (double)HOUR_US);
+  format_init(&format, energy, sizeof(energy));
+  energy_report(&format, uptime_us);
+  printf("energy since the last boot: %s\n", energy);
+  printf("modem: commands %u, errors injected %u, SMS received %u (%u delivered directly), SMS sent %u, calls %u, resets %u, "
+         "characters from Pico %llu\n", modem.commands, modem.errors_injected, modem.sms_received, modem.sms_direct,
+         modem.sms_sent_count, modem.calls, modem.resets, (unsigned long long)hal_sim_tx_chars());
+  printf("modem capabilities 0x%02x, probed with %u test commands over all boots\n", modem_capabilities,
+         modem.test_commands);
+  sleep_share = modem_sim_sleep_time_us(&modem, hal_sim_now_us()) / (double)hal_sim_now_us();
+  printf("modem asleep %.2f%%, average current %.1f mA (%.1f mA awake), %u wake-ups by DTR, wake-to-command latency "
+         "mean %.1f ms max %.1f ms, %u RI pulses, characters lost to sleep %u\n", sleep_share * 100,
+         modem_sim_charge_uas(&modem, hal_sim_now_us()) / (hal_sim_now_us() / 1e6) / 1000,
+         MODEM_SIM_IDLE_CURRENT_UA / 1000.0, modem.wakeups,
+         modem.wakeups ? modem.wake_latency_sum_us / 1000.0 / modem.wakeups : 0.0, modem.wake_latency_max_us / 1000.0,
+         modem.rings, modem.sleep_lost_chars);
+  if (battery) {
+    printf("battery: %u power cuts, %.1f h on battery, modem in eDRX %.1f%% and in PSM %.1f%% of it, charge used "
+           "%.1f mAh estimated by the logic, %.1f mAh simulated\n", event_count[EVENT_POWER_CUT],
+           battery_time_us / (double)HOUR_US, battery_time_us ? battery_edrx_us * 100.0 / battery_time_us : 0.0,
+           battery_time_us ? battery_psm_us * 100.0 / battery_time_us : 0.0, battery_estimate_mah, battery_simulated_mah);
+    printf("network: %u SMS held back (delay mean %.1f s, max %.1f s), %u lost, %u calls missed\n", modem.sms_deferred,
+           modem.sms_deferred ? modem.deferred_delay_sum_us / 1e6 / modem.sms_deferred : 0.0,
+           modem.deferred_delay_max_us / 1e6, modem.sms_deferred_lost, modem.calls_missed);
+  }
+  printf("wall clock: %u syncs since the last boot, drift %.2f ppm (network time %d ppm faster), error at %u SMS max "
+         "%lld ms\n", wallclock_syncs, wallclock_drift_ppb / 1000.0, NETWORK_CLOCK_PPM, wallclock_checks,
+         (long long)wallclock_error_max_ms);
+  printf("SMS sent: %u alarm, %u replies, %u digest, %u other\n", sms_alarm, sms_reply, sms_digest, sms_other);
+  printf("digest: %u input changes in %u SMS (%u SMS saved), %u overdue, %u still pending\n", digest_latencies,
+         sms_digest, digest_latencies > sms_digest ? digest_latencies - sms_digest : 0, digests_overdue, pending_digests);
+  print_latencies("alarm SMS latency", alarm_latency_us, alarm_latencies);
+  print_latencies("command reply latency", reply_latency_us, reply_latencies);
+  print_latencies("digest latency", digest_latency_us, digest_latencies);
+  if (trace)
+    fclose(trace);
+  printf("alarm changes lost %u (%u without modem fault), %u still pending, commands unanswered %u\n", alarms_lost,
+         alarms_lost_fault_free, pending_alarms, replies_lost);
+  if (soak) {
+    for (i = 0; i < MODEM_SIM_FAULT_MAX; i++) {
+      total_faults += modem.faults[i];
+      total_hangs += hangs[i];
+    }
+    printf("protocol faults %u, permanent hangs %u (no clean idle within %llu s), recovery time to clean idle:\n",
+           total_faults, total_hangs, (unsigned long long)(RECOVERY_LIMIT_US / SECOND_US));
+    for (i = 0; i < MODEM_SIM_FAULT_MAX; i++) {
+      printf("  ");
+      print_latencies(fault_name[i], recovery_us[i], recoveries[i]);
+    }
+  }
+
+  return (hal_sim_watchdog_timeouts() || (alarms_lost_fault_free && !soak) || total_hangs || modem.sleep_lost_chars) ?
+         EXIT_FAILURE : EXIT_SUCCESS;
+}
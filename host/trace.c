@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static void write_time(FILE* f, uint64_t time_us) {
+  fprintf(f, "%llu.%06llu ", (unsigned long long)(time_us / 1000000), (unsigned long long)(time_us % 1000000));
+}
+
+void trace_write_escaped(FILE* f, const char* data, size_t length) {
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    if (data[i] == '\r')
+      fputs("\\r", f);
+    else if (data[i] == '\n')
+      fputs("\\n", f);
+    else if (data[i] == '\\')
+      fputs("\\\\", f);
+    else if ((data[i] < ' ') || (data[i] > '~'))
+      fprintf(f, "\\x%02x", (unsigned char)data[i]);
+    else
+      fputc(data[i], f);
+  }
+}
+
+void trace_write_data(FILE* f, uint64_t time_us, int type, const char* data, size_t length) {
+  write_time(f, time_us);
+  fputs(type == TRACE_TX ? "-> " : "<- ", f);
+  trace_write_escaped(f, data, length);
+  fputc('\n', f);
+}
+
+void trace_write_gpio(FILE* f, uint64_t time_us, unsigned int pin, bool value) {
+  write_time(f, time_us);
+  fprintf(f, "gpio %u %d\n", pin, value ? 1 : 0);
+}
+
+static int hex_digit(char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F'))
+    return c - 'A' + 10;
+  return -1;
+}
+
+// reads the next event, skipping comments and lines that cannot be parsed
+// returns false at the end of the trace
+bool trace_read(FILE* f, trace_event_t* event) {
+  char line[4 * TRACE_DATA_LENGTH + 64];
+  char* p;
+  unsigned long seconds, micro;
+  unsigned int pin;
+  int value, h, l;
+
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\n")] = 0;
+    if ((line[0] == '#') || (sscanf(line, "%lu.%lu", &seconds, &micro) != 2))
+      continue;
+    event->time_us = (uint64_t)seconds * 1000000 + micro;
+    p = strchr(line, ' ');
+    if (!p)
+      continue;
+    p++;
+    if (sscanf(p, "gpio %u %d", &pin, &value) == 2) {
+      event->type = TRACE_GPIO;
+      event->pin = pin;
+      event->value = value != 0;
+      event->length = 0;
+      return true;
+    }
+    if (!strncmp(p, "-> ", 3))
+      event->type = TRACE_TX;
+    else if (!strncmp(p, "<- ", 3))
+      event->type = TRACE_RX;
+    else
+      continue;
+    p += 3;
+    l = 0;
+    while (*p && (l < TRACE_DATA_LENGTH)) {
+      if ((p[0] == '\\') && (p[1] == 'r')) {
+        event->data[l++] = '\r';
+        p += 2;
+      }
+      else if ((p[0] == '\\') && (p[1] == 'n')) {
+        event->data[l++] = '\n';
+        p += 2;
+      }
+      else if ((p[0] == '\\') && (p[1] == '\\')) {
+        event->data[l++] = '\\';
+        p += 2;
+      }
+      else if ((p[0] == '\\') && (p[1] == 'x') && ((h = hex_digit(p[2])) >= 0) && (hex_digit(p[3]) >= 0)) {
+        event->data[l++] = (char)(h * 16 + hex_digit(p[3]));
+        p += 4;
+      }
+      else
+        event->data[l++] = *p++;
+    }
+    event->length = l;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// timestamped trace of the UART traffic between the Pico and the modem, and of the alarm inputs
+// written by alarmdial_host (ALARMDIAL_TRACE), alarmdial_sim (-t) and alarmdial_modem_sim (-t), read by alarmdial_replay
+//
+// one event per line, the time is in seconds since boot with microsecond resolution
+//   12.345678 -> AT+CSQ\r              characters sent by the Pico to the modem
+//   12.367012 <- \r\n+CSQ: 20,99\r\n   characters received by the Pico from the modem
+//   15.000000 gpio 3 0                 an input pin changes its level
+// control characters and backslashes are escaped (\r, \n, \\, \xNN), lines starting with # are comments
+
+#define TRACE_DATA_LENGTH 1024
+
+#define TRACE_TX   0
+#define TRACE_RX   1
+#define TRACE_GPIO 2
+
+typedef struct {
+  uint64_t time_us;
+  int type;
+  int length;
+  char data[TRACE_DATA_LENGTH];   // TRACE_TX and TRACE_RX
+  unsigned int pin;               // TRACE_GPIO
+  bool value;
+} trace_event_t;
+
+void trace_write_escaped(FILE* f, const char* data, size_t length);
+void trace_write_data(FILE* f, uint64_t time_us, int type, const char* data, size_t length);
+void trace_write_gpio(FILE* f, uint64_t time_us, unsigned int pin, bool value);
+bool trace_read(FILE* f, trace_event_t* event);
+
+#endif
@@ -0,0 +1,90 @@
+# Memory report and budget check for the AlarmDial image, run as a post-build step
+#
+# Invoked with cmake -P and the following variables
+#   ELF           the linked image
+#   OBJDUMP, NM   the binutils matching the toolchain
+#   RAM_BUDGET    maximum static RAM (initialised data, bss and no-init sections) in bytes, 0 disables the check
+#   FLASH_BUDGET  maximum flash (code, read-only data and initialisers of data) in bytes, 0 disables the check
+#   TOP_SYMBOLS   number of largest RAM and flash symbols to list
+#
+# The section classification follows the section flags, as with the Berkeley format of the size tool:
+# read-only loaded sections count as flash, writable loaded sections count as RAM and flash, allocated but not loaded
+# sections (bss, no-init RAM, stack and heap reservations) count as RAM.
+
+if (NOT TOP_SYMBOLS)
+  set(TOP_SYMBOLS 10)
+endif()
+
+execute_process(COMMAND ${OBJDUMP} -h ${ELF} OUTPUT_VARIABLE sections RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "Memory report: ${OBJDUMP} -h ${ELF} failed")
+endif()
+
+# objdump prints each section on one line followed by a line of flags
+string(REPLACE ";" "," sections "${sections}")
+string(REPLACE "\n" ";" lines "${sections}")
+set(text_bytes 0)
+set(data_bytes 0)
+set(bss_bytes 0)
+set(section_table "")
+set(name "")
+foreach (line IN LISTS lines)
+  if (line MATCHES "^ *[0-9]+ +([^ ]+) +([0-9a-fA-F]+) ")
+    set(name ${CMAKE_MATCH_1})
+    math(EXPR size "0x${CMAKE_MATCH_2}" OUTPUT_FORMAT DECIMAL)
+  elseif (name AND line MATCHES "ALLOC")
+    if (line MATCHES "LOAD" AND line MATCHES "READONLY")
+      math(EXPR text_bytes "${text_bytes} + ${size}")
+      set(kind "flash")
+    elseif (line MATCHES "LOAD")
+      math(EXPR data_bytes "${data_bytes} + ${size}")
+      set(kind "ram+flash")
+    else()
+      math(EXPR bss_bytes "${bss_bytes} + ${size}")
+      set(kind "ram")
+    endif()
+    if (size GREATER 0)
+      string(APPEND section_table "  ${name} ${size} (${kind})\n")
+    endif()
+    set(name "")
+  else()
+    set(name "")
+  endif()
+endforeach()
+
+math(EXPR ram_bytes "${data_bytes} + ${bss_bytes}")
+math(EXPR flash_bytes "${text_bytes} + ${data_bytes}")
+
+# lists the largest symbols of the given nm types
+function(top_symbols types out)
+  execute_process(COMMAND ${NM} --size-sort --reverse-sort -S ${ELF} OUTPUT_VARIABLE symbols)
+  string(REPLACE ";" "," symbols "${symbols}")
+  string(REPLACE "\n" ";" symbols "${symbols}")
+  set(table "")
+  set(count 0)
+  foreach (symbol IN LISTS symbols)
+    if (count LESS TOP_SYMBOLS AND symbol MATCHES "^[0-9a-fA-F]+ ([0-9a-fA-F]+) ([${types}]) (.+)$")
+      math(EXPR size "0x${CMAKE_MATCH_1}" OUTPUT_FORMAT DECIMAL)
+      string(APPEND table "  ${CMAKE_MATCH_3} ${size}\n")
+      math(EXPR count "${count} + 1")
+    endif()
+  endforeach()
+  set(${out} "${table}" PARENT_SCOPE)
+endfunction()
+
+top_symbols("bBdDsS" ram_symbols)
+top_symbols("tTrR" flash_symbols)
+
+message("Memory report for ${ELF}\n"
+        "Sections (bytes):\n${section_table}"
+        "RAM: ${ram_bytes} bytes (data ${data_bytes}, bss ${bss_bytes}), budget ${RAM_BUDGET}\n"
+        "Flash: ${flash_bytes} bytes (text ${text_bytes}, data ${data_bytes}), budget ${FLASH_BUDGET}\n"
+        "Largest RAM symbols (bytes):\n${ram_symbols}"
+        "Largest flash symbols (bytes):\n${flash_symbols}")
+
+if (RAM_BUDGET AND ram_bytes GREATER RAM_BUDGET)
+  message(FATAL_ERROR "RAM budget exceeded: ${ram_bytes} bytes used, budget ${RAM_BUDGET} bytes")
+endif()
+if (FLASH_BUDGET AND flash_bytes GREATER FLASH_BUDGET)
+  message(FATAL_ERROR "Flash budget exceeded: ${flash_bytes} bytes used, budget ${FLASH_BUDGET} bytes")
+endif()
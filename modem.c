@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <string.h>
+#include "diagnostics.h"
+#include "energy.h"
+#include "format.h"
+#include "hal.h"
+#include "modem.h"
+#include "power.h"
+#include "wallclock.h"
+
+#ifdef DEBUG
+const char* const command_code_map[MAX_MSG] = MESSAGE_NAMES;
+#endif
+
+// prefixes of the modem messages, indexed by message value
+static const char* const message_prefix[MAX_MSG] = MESSAGE_PREFIXES;
+static const uint8_t message_prefix_length[MAX_MSG] = MESSAGE_PREFIX_LENGTHS;
+
+// modem sleep mode, DTR is low (modem_awake) while the logic has anything in progress
+bool modem_sleep = MODEM_SLEEP;
+bool modem_awake = true;
+bool modem_direct_sms = false;
+
+uint8_t modem_capabilities = 0;
+
+uint32_t modem_registration_ms = 0;
+bool modem_registration_cached = false;
+
+// time since boot of the last reset of the modem
+static uint64_t modem_reset_us = 0;
+
+// the power saving settings of the battery mode have been sent to the modem, so it may be in PSM while asleep
+static bool modem_power_saving = false;
+
+// ring buffer for interrupt handler
+char rx_buffer[RX_BUFFER_SIZE];
+int rx_buffer_read_position = 0;
+int rx_buffer_entries = 0;
+int rx_buffer_write_position = 0;
+int rx_buffer_number_lf = 0;
+
+// puts one character into the ring buffer, flags arrival of LF to main loop (complete message has arrived for processing)
+// no overflow checking - buffer size is gargantuan for the data flow
+void rx_buffer_push(char chr) {
+  rx_buffer_entries++;
+  rx_buffer[rx_buffer_write_position++] = chr;
+  if (chr == LF) rx_buffer_number_lf++;
+  if (rx_buffer_write_position == RX_BUFFER_SIZE) rx_buffer_write_position = 0;
+}
+
+// interrupt handler with simple ring buffer for incoming characters from modem
+void uart_rx_interrupt_handler(void) {
+  while (hal_uart_is_readable())
+    rx_buffer_push(hal_uart_getc());
+}
+
+// reads a complete (i.e., LF-terminated) message from modem, or returns with 1 if no complete message arrives within specified timeout
+// this function is only called when interrupt handler is not installed
+// used for modem initialisation only
+int read_message(char* message, uint32_t wait_us) {
+  char chr;
+  int success = 1;
+  int l = 0;
+
+  message[0] = 0;
+  while (hal_uart_is_readable_within_us(l ? (uint32_t)CHAR_INTERVAL_US : wait_us)) {
+    chr = hal_uart_getc();
+    if ((chr != LF) && (chr != CR) && (l < max_str_l-1))
+      message[l++] = chr;
+    if (chr == LF) {
+      message[l] = 0;
+      success = 0;
+      break;
+    }
+  }
+
+  return success;
+}
+
+// reads one message from the ring buffer if a LF has arrived, CR and LF are stripped
+// a message longer than max_str_l-1 characters is truncated, the rest of it up to the LF is dropped rather than read as
+// a message of its own
+// returns the length of the message (0 for an empty line), or -1 if there is no complete message in the buffer
+int read_line(char* str) {
+  char chr;
+  int l = 0;
+
+  if (rx_buffer_number_lf <= 0)
+    return -1;
+  str[0] = 0;
+  do {
+    chr = rx_buffer[rx_buffer_read_position++];
+    rx_buffer_entries--;
+    if (rx_buffer_read_position == RX_BUFFER_SIZE)
+      rx_buffer_read_position = 0;
+    if ((chr != LF) && (chr != CR) && (l < max_str_l-1))
+      str[l++] = chr;
+    if (chr == LF) rx_buffer_number_lf--;
+  } while ((chr != LF) && (rx_buffer_entries > 0));
+// make message into a string
+  str[l] = '\0';
+
+  return l;
+}
+
+// determines the type of a nonempty message from the modem
+// returns one of the message values, MSG_IGNORE for the SMS prompt, or MSG_TEXT for non-command data such as SMS text
+int classify_message(const char* str) {
+  int type;
+
+// the last prefix, "+", is the catchall for modem messages relating to commands
+// the first character rules out most prefixes before strncmp is called
+  for (type = 0; type < MAX_MSG; type++)
+    if ((str[0] == message_prefix[type][0]) && !strncmp(str, message_prefix[type], message_prefix_length[type]))
+      return type;
+  if (str[0] == '>')
+    return MSG_IGNORE;
+  else if (str[0] == '\0')
+    return MSG_IGNORE;
+// at this point we only have non-command related data from the modem, such as incoming SMS text
+  return MSG_TEXT;
+}
+
+// returns the parameters of a message from the modem, i.e. the text after the colon of e.g. "+CSQ: 20,99"
+// returns an empty string if the message has no colon
+const char* message_parameters(const char* str) {
+  const char* p = strchr(str, ':');
+
+  if (!p)
+    return &str[strlen(str)];
+  p++;
+  while (*p == ' ')
+    p++;
+
+  return p;
+}
+
+// copies parameter number index (counting from 0) of a message from the modem into field, truncated to size-1 characters
+// parameters are separated by commas, except within quotes, and quotes are kept (e.g. "SM" of +CMTI: "SM",3)
+// returns the untruncated length of the parameter, or -1 if the message has fewer parameters
+int message_field(const char* str, int index, char* field, int size) {
+  const char* p = message_parameters(str);
+  bool quoted = false;
+  int l = 0;
+
+  field[0] = 0;
+  if (!*p || (index < 0))
+    return -1;
+  for (; *p; p++) {
+    if ((*p == ',') && !quoted) {
+      if (index-- == 0)
+        break;
+      l = 0;
+      continue;
+    }
+    if (*p == '"')
+      quoted = !quoted;
+    if (index == 0) {
+      if (l < size - 1) {
+        field[l] = *p;
+        field[l + 1] = 0;
+      }
+      l++;
+    }
+  }
+
+  return index > 0 ? -1 : l;
+}
+
+// writes a command (or data such as SMS text) to the modem
+void write_command(const char* command) {
+  int l = 0;
+
+  modem_wake();
+  record_command(command);
+  while ((l < max_str_l) && command[l])
+    hal_uart_putc(command[l++]);
+}
+
+// writes a command to the modem and checks for a pre-deterimed response
+// returns 0 upon success, or 1 if the required response has not arrived within specified timeout upon specified repeats
+// all data other than the required response arriving from the modem in the meantime is discarded
+// this function is only called when interrupt handler is not installed
+// used for modem initialisation only
+int write_command_with_response_check(const char* command, const char* target_response, char* response, uint32_t wait_us, int repeat) {
+  int success = 1;
+  int i = 0;
+  int result;
+
+  while ((i++ < repeat) && success) {
+    while (hal_uart_is_readable_within_us(0))
+      hal_uart_getc();
+    write_command(command);
+    do {
+      result = read_message(response, wait_us);
+      if (!strncmp(response, target_response, strlen(target_response)))
+        success = 0;
+    } while (!result && success); 
+  }
+
+  return success;
+}
+
+// instructs the modem to send message as SMS
+void send_sms(const char* tel_no, const char* message) {
+  format_t format;
+  char msg[max_str_l];
+
+  format_init(&format, msg, sizeof(msg));
+  format_str(&format, "AT+CMGS=\"");
+  format_str(&format, tel_no);
+  format_str(&format, "\"\r");
+  write_command(msg);
+  hal_sleep_ms(500);
+// the text is truncated if necessary, the CTRL-Z that ends it must not be
+  format_init(&format, msg, sizeof(msg));
+  format_str_n(&format, message, max_str_l - 2);
+  format_char(&format, '\x1A');
+  write_command(msg);
+  energy_sms();
+}
+
+// restarts the modem, the time to its registration is measured from here
+void modem_reset(void) {
+  write_command(MODEM_RESET_COMMAND);
+  modem_reset_us = hal_time_us();
+}
+
+// sends a command during initialisation and reads its response up to the final result code, the first line of it
+// that contains match ("" for any) is copied to response (empty if none)
+// anything still on its way from an earlier command is dropped first, e.g. the second OK when ATE0 has been repeated
+// because the echo of the first one ended the wait
+// returns 0 for OK, 1 for ERROR (also +CME ERROR), or 2 if no final result code arrives within wait_us
+static int query(const char* command, const char* match, char* response, uint32_t wait_us) {
+  char line[max_str_l];
+
+  response[0] = 0;
+  while (hal_uart_is_readable_within_us(MODEM_QUIET_US))
+    hal_uart_getc();
+  write_command(command);
+  while (!read_message(line, wait_us)) {
+    if (!strcmp(line, "OK"))
+      return 0;
+    if (!strcmp(line, "ERROR") || !strncmp(line, "+CME ERROR", 10))
+      return 1;
+    if (line[0] && !response[0] && strstr(line, match))
+      strcpy(response, line);
+  }
+
+  return 2;
+}
+
+// reads the IMEI and the firmware revision of the modem into id as "imei/revision", SIMCom modules prefix the revision
+// with "+CGMR: ", Quectel modules do not
+// returns false if either is missing
+static bool read_modem_id(char* id, int size) {
+  char response[max_str_l];
+  format_t format;
+
+  format_init(&format, id, size);
+  if (query("AT+CGSN\r", "", response, (uint32_t)9000000) || !response[0])
+    return false;
+  format_str(&format, strchr(response, ':') ? message_parameters(response) : response);
+  format_char(&format, '/');
+  if (query("AT+CGMR\r", "", response, (uint32_t)9000000) || !response[0])
+    return false;
+  format_str(&format, strchr(response, ':') ? message_parameters(response) : response);
+
+  return true;
+}
+
+// whether the list of parameter field of a test command response includes value, the list holds values and ranges
+// in parentheses, e.g. "+CNMI: (0-2),(0-3),(0,2),(0-2),(0,1)" or "+IPR: (300,600,...,115200)"
+static bool list_includes(const char* str, int field, uint32_t value) {
+  const char* p = message_parameters(str);
+  uint32_t low, high;
+  int depth = 0;
+
+  while (*p && field) {
+    if (*p == '(')
+      depth++;
+    else if (*p == ')')
+      depth--;
+    else if ((*p == ',') && !depth)
+      field--;
+    p++;
+  }
+  if (*p++ != '(')
+    return false;
+  while (*p && (*p != ')')) {
+    low = 0;
+    while ((*p >= '0') && (*p <= '9'))
+      low = low * 10 + (uint32_t)(*p++ - '0');
+    high = low;
+    if (*p == '-') {
+      high = 0;
+      p++;
+      while ((*p >= '0') && (*p <= '9'))
+        high = high * 10 + (uint32_t)(*p++ - '0');
+    }
+    if ((value >= low) && (value <= high))
+      return true;
+    while (*p && (*p != ',') && (*p != ')'))
+      p++;
+    if (*p == ',')
+      p++;
+  }
+
+  return false;
+}
+
+// probes the capabilities of the modem with the test commands of MODEM_CAPABILITY_PROBES, a command the modem answers
+// with ERROR is tried once more, as the ERROR may have been a glitch
+// returns false if the probe is incomplete, as the modem has not answered a test command at all
+static bool probe_capabilities(uint8_t* capabilities) {
+  static const modem_probe_t probes[MODEM_NUMBER_CAPABILITIES] = MODEM_CAPABILITY_PROBES;
+  char response[max_str_l];
+  int i, result, attempt;
+
+  result = query("ATI\r", MODEM_NAME, response, (uint32_t)9000000);
+#ifdef DEBUG
+  if (result || !response[0])
+    printf("Modem does not identify as %s, check the modem profile (ALARMDIAL_MODEM)\n", MODEM_NAME);
+#endif
+  *capabilities = 0;
+  for (i = 0; i < MODEM_NUMBER_CAPABILITIES; i++) {
+    attempt = 0;
+    do
+      result = query(probes[i].command, probes[i].prefix, response, (uint32_t)9000000);
+    while ((result == 1) && (++attempt < 2));
+    if (result == 2)
+      return false;
+    if (!result && response[0] && ((probes[i].field < 0) || list_includes(response, probes[i].field, probes[i].value)))
+      *capabilities |= (uint8_t)(1 << i);
+  }
+
+  return true;
+}
+
+// polls the registration of the modem (AT+CREG?) until it is registered, at home or roaming, or until
+// MODEM_REGISTRATION_WAIT_US after the reset
+// returns the time from the reset to the registration in milliseconds, or 0 if the modem has not registered
+static uint32_t wait_for_registration(void) {
+  char response[max_str_l], field[4];
+
+  while (hal_time_us() - modem_reset_us < MODEM_REGISTRATION_WAIT_US) {
+    if (!query("AT+CREG?\r", "+CREG", response, (uint32_t)9000000) &&
+        (message_field(response, 1, field, sizeof(field)) == 1) && ((field[0] == '1') || (field[0] == '5')))
+      return (uint32_t)((hal_time_us() - modem_reset_us) / 1000);
+    hal_sleep_ms(MODEM_REGISTRATION_POLL_MS);
+  }
+
+  return 0;
+}
+
+// registers the modem with the network, pointed to the network of the configuration first if there is one: manual
+// selection with automatic fallback (AT+COPS=4), so the modem searches that network and access technology before all
+// others, or the full search (AT+COPS=0) if the modem refuses the network or has not registered in time
+// the network the modem has registered with is kept in the configuration
+// returns true if the configuration has changed
+static bool register_network(config_t* config) {
+  char command[max_str_l], response[max_str_l], plmn[CONFIG_PLMN_SIZE];
+  format_t format;
+  uint8_t rat, band;
+  int result;
+
+  modem_registration_cached = false;
+  if (config->network_plmn[0]) {
+    format_init(&format, command, sizeof(command));
+    format_str(&format, "AT+COPS=4,2,\"");
+    format_str(&format, config->network_plmn);
+    format_str(&format, "\",");
+    format_uint(&format, config->network_rat);
+    format_char(&format, CR);
+// the full search only follows an ERROR, or no final result code within MODEM_COPS_WAIT_US, while the selection goes
+// on the modem takes no other command
+    modem_registration_cached = !query(command, "", response, (uint32_t)MODEM_COPS_WAIT_US);
+    if (!modem_registration_cached)
+      query("AT+COPS=0\r", "", response, (uint32_t)MODEM_COPS_WAIT_US);
+  }
+  modem_registration_ms = wait_for_registration();
+  if (!modem_registration_ms && modem_registration_cached)
+    query("AT+COPS=0\r", "", response, (uint32_t)MODEM_COPS_WAIT_US);
+#ifdef DEBUG
+  printf("Registration after %lu ms%s\n", (unsigned long)modem_registration_ms,
+         modem_registration_cached ? " with the last network" : "");
+#endif
+  if (!modem_registration_ms)
+    return false;
+  result = query(MODEM_STATUS_COMMAND, "", response, (uint32_t)9000000);
+  if (result || !modem_status_network(response, plmn, &rat, &band) ||
+      (!strcmp(plmn, config->network_plmn) && (rat == config->network_rat) && (band == config->network_band)))
+    return false;
+#ifdef DEBUG
+  printf("Network %s, access technology %u, band %u\n", plmn, rat, band);
+#endif
+  strcpy(config->network_plmn, plmn);
+  config->network_rat = rat;
+  config->network_band = band;
+
+  return true;
+}
+
+// initialises the modem, and sets modem_capabilities from the configuration if it holds those of this modem and
+// firmware, or else from a probe, which is then stored in the configuration
+// interrupt handler should not be installed when invoking this function
+// no error checking implemented - unclear what we could sensibly do in an embedded system if an error occurred
+// returns true if the configuration has changed and needs saving to flash
+bool initialise_modem(config_t* config) {
+  static const char* const init_commands[MODEM_NUMBER_INIT_COMMANDS] = MODEM_INIT_COMMANDS;
+#ifdef DEBUG
+  static const char* const capability_names[MODEM_NUMBER_CAPABILITIES] = MODEM_CAPABILITY_NAMES;
+#endif
+  int result, i;
+  char response[max_str_l];
+  char id[CONFIG_MODEM_ID_SIZE];
+  uint64_t request_us;
+  bool known, changed = false;
+
+#ifdef DEBUG
+  printf("Entering modem initialisation\n");
+#endif
+// the first command waits for the modem to start up, the initialisation commands come from the modem profile
+  for (i = 0; i < MODEM_NUMBER_INIT_COMMANDS; i++) {
+    result = write_command_with_response_check(init_commands[i], "OK", response, i ? (uint32_t)36000000 : (uint32_t)120000000, 3);
+#ifdef DEBUG
+    printf("%.*s returned: %i %s\n", (int)strlen(init_commands[i]) - 1, init_commands[i], result, response);
+#endif
+  }
+// the probe only runs for a modem or firmware not seen before, or if the modem could not be identified
+  known = read_modem_id(id, sizeof(id));
+  if (known && config->modem_id[0] && !strcmp(id, config->modem_id))
+    modem_capabilities = config->modem_capabilities;
+  else if (probe_capabilities(&modem_capabilities) && known) {
+    strcpy(config->modem_id, id);
+    config->modem_capabilities = modem_capabilities;
+    changed = true;
+  }
+#ifdef DEBUG
+  printf("Modem %s%s, capabilities:", known ? id : "not identified", changed ? " (probed)" : "");
+  for (i = 0; i < MODEM_NUMBER_CAPABILITIES; i++)
+    if (modem_capabilities & (1 << i))
+      printf(" %s,", capability_names[i]);
+  printf("\n");
+#endif
+// with direct delivery, the storage only holds SMS that came in before, which the initialisation has cleared
+  modem_direct_sms = MODEM_DIRECT_SMS && (modem_capabilities & MODEM_CAPABILITY_DIRECT_SMS) &&
+                     !write_command_with_response_check(MODEM_DIRECT_SMS_COMMAND, "OK", response, (uint32_t)9000000, 3);
+#ifdef DEBUG
+  printf("SMS delivery %s\n", modem_direct_sms ? "direct" : "from storage");
+#endif
+  if (register_network(config))
+    changed = true;
+// the modem clock only holds the network time once the modem has registered, without registration the wall clock is
+// set later (+CTZV, configuration command), the OK that follows the clock is read as well
+  if (modem_registration_ms) {
+    request_us = hal_time_us();
+    result = write_command_with_response_check(MODEM_CLOCK_COMMAND, "+CCLK", response, (uint32_t)9000000, 3);
+#ifdef DEBUG
+    printf("Clock returned: %i %s\n", result, response);
+#endif
+    if (!result) {
+      wallclock_sync(response, request_us, hal_time_us());
+      read_message(response, (uint32_t)9000000);
+    }
+  }
+  if (modem_sleep) {
+    result = write_command_with_response_check(MODEM_SLEEP_COMMAND, "OK", response, (uint32_t)9000000, 3);
+#ifdef DEBUG
+    printf("Sleep mode returned: %i %s\n", result, response);
+#endif
+  }
+#ifdef DEBUG
+  printf("Exiting modem initialisation\n");
+#endif
+  (void)result;
+
+  return changed;
+}
+
+// whether a network status report of the modem (MODEM_STATUS_COMMAND) means it is online
+bool modem_status_online(const char* str) {
+  return (strstr(str, MODEM_STATUS_MARKER) != NULL) == MODEM_STATUS_MARKER_ONLINE;
+}
+
+// the access technologies of AT+COPS by the names the status reports give them, the more specific ones first (e.g.
+// "CAT-M" before the "LTE" of "LTE CAT-M1")
+#define NUMBER_RAT_NAMES 10
+static const char* const rat_names[NUMBER_RAT_NAMES] = {
+  "CAT-M", "eMTC", "NB", "LTE", "WCDMA", "HSPA", "UMTS", "GSM", "EDGE", "GPRS"
+};
+static const uint8_t rat_values[NUMBER_RAT_NAMES] = { 8, 8, 9, 7, 2, 2, 2, 0, 0, 0 };
+
+// reads the serving network of a network status report of the modem (MODEM_STATUS_COMMAND) into plmn (MCC and MNC,
+// without the separator or quotes, e.g. "23410" of "234-10"), its access technology as for AT+COPS into rat, and the
+// number of its band into band (0 if not known)
+// returns false if the report names no network, e.g. without service
+bool modem_status_network(const char* str, char* plmn, uint8_t* rat, uint8_t* band) {
+  char field[max_str_l];
+  uint32_t number = 0;
+  bool digit = false;
+  int i, l = 0;
+
+  if (message_field(str, MODEM_STATUS_PLMN_FIELD, field, sizeof(field)) < 0)
+    return false;
+  for (i = 0; field[i]; i++)
+    if ((field[i] >= '0') && (field[i] <= '9') && (l < CONFIG_PLMN_SIZE - 1))
+      plmn[l++] = field[i];
+  plmn[l] = 0;
+  if (l < 5)
+    return false;
+  message_field(str, MODEM_STATUS_RAT_FIELD, field, sizeof(field));
+  for (i = 0; i < NUMBER_RAT_NAMES; i++)
+    if (strstr(field, rat_names[i]))
+      break;
+  if (i == NUMBER_RAT_NAMES)
+    return false;
+  *rat = rat_values[i];
+// the band is the number at the end of the band parameter, e.g. 20 of "EUTRAN-BAND20" or "LTE BAND 20"
+  message_field(str, MODEM_STATUS_BAND_FIELD, field, sizeof(field));
+  for (i = 0; field[i]; i++) {
+    if ((field[i] >= '0') && (field[i] <= '9'))
+      number = (digit ? number * 10 : 0) + (uint32_t)(field[i] - '0');
+    digit = (field[i] >= '0') && (field[i] <= '9');
+  }
+  *band = number <= 255 ? (uint8_t)number : 0;
+
+  return true;
+}
+
+// whether a message is one of the start-up messages of a modem that is ready for SMS (e.g. after a restart)
+bool modem_ready_message(const char* str) {
+  static const char* const ready_messages[MODEM_NUMBER_READY_MESSAGES] = MODEM_READY_MESSAGES;
+  int i;
+
+  for (i = 0; i < MODEM_NUMBER_READY_MESSAGES; i++)
+    if (!strcmp(str, ready_messages[i]))
+      return true;
+
+  return false;
+}
+
+// the configuration command for the present modem and power mode, with the SMS indication or the direct SMS delivery,
+// and in sleep mode with the power saving settings (of the battery mode, or their reversal on mains power) the modem has
+// the capabilities for
+// the power saving settings are taken to be in force from now on (the command is sent straight after)
+const char* modem_config_command(void) {
+  static const uint8_t power_saving_capabilities[MODEM_NUMBER_POWER_SAVING] = MODEM_POWER_SAVING_CAPABILITIES;
+  static const char* const battery_settings[MODEM_NUMBER_POWER_SAVING] = MODEM_POWER_SAVING_BATTERY;
+  static const char* const mains_settings[MODEM_NUMBER_POWER_SAVING] = MODEM_POWER_SAVING_MAINS;
+  static char command[max_str_l];
+  format_t format;
+  int i;
+
+  format_init(&format, command, sizeof(command));
+  format_str(&format, modem_sleep ? MODEM_CONFIG_SETTINGS_SLEEP : MODEM_CONFIG_SETTINGS);
+  format_str(&format, modem_direct_sms ? MODEM_DIRECT_SMS_SETTINGS : MODEM_SMS_INDICATION_SETTINGS);
+  if (modem_sleep)
+    for (i = 0; i < MODEM_NUMBER_POWER_SAVING; i++)
+      if (modem_capabilities & power_saving_capabilities[i])
+        format_str(&format, power_mode == POWER_BATTERY ? battery_settings[i] : mains_settings[i]);
+  format_str(&format, MODEM_CLOCK_SETTINGS);
+#ifdef DEBUG
+// gen_tables.py keeps the longest configuration command within max_str_l, a command cut short would lose its CR
+  if (!format.length || (command[format.length - 1] != CR))
+    printf("Configuration command truncated: %s\n", command);
+#endif
+  modem_power_saving = modem_sleep && (power_mode == POWER_BATTERY) && (modem_capabilities & MODEM_CAPABILITY_PSM);
+
+  return command;
+}
+
+// sets up the DTR and RI lines for modem sleep mode, DTR starts low so that the modem stays awake until the logic is
+// idle
+void modem_sleep_init(void) {
+  modem_awake = true;
+  modem_power_saving = false;
+  if (!modem_sleep)
+    return;
+  hal_gpio_init_output(GPIO_PIN_MODEM_DTR);
+  hal_gpio_put(GPIO_PIN_MODEM_DTR, false);
+  hal_gpio_init_input_pullup(GPIO_PIN_MODEM_RI);
+}
+
+// wakes the modem before a command by pulling DTR low and waiting for its UART
+// there is no telling whether the modem has actually fallen asleep since DTR went high, so the wait is always taken,
+// the longer one while the power saving settings of the battery mode are in force (until the mains configuration has
+// been sent, also after a switch back to mains)
+void modem_wake(void) {
+  if (!modem_sleep || modem_awake)
+    return;
+  hal_gpio_put(GPIO_PIN_MODEM_DTR, false);
+  modem_awake = true;
+  hal_sleep_ms(modem_power_saving ? MODEM_PSM_WAKE_MS : MODEM_WAKE_MS);
+}
+
+// lets the modem sleep once the logic is idle, it falls asleep after its UART has been quiet for a while
+void modem_allow_sleep(void) {
+  if (!modem_sleep || !modem_awake)
+    return;
+  hal_gpio_put(GPIO_PIN_MODEM_DTR, true);
+  modem_awake = false;
+}
+
+// interrupt handler for the falling edge of RI: the modem has woken up to report an SMS or call, it is kept awake for
+// the commands that follow, and what it has sent so far is collected as by the UART interrupt handler
+void modem_ring_interrupt_handler(void) {
+  hal_gpio_put(GPIO_PIN_MODEM_DTR, false);
+  modem_awake = true;
+  uart_rx_interrupt_handler();
+}
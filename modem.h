@@ -0,0 +1,112 @@
+#ifndef MODEM_H
+#define MODEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarmdial_tables.h"
+#include "config.h"
+
+// UART parameters for communication with the modem
+// The modem needs to have been set to these values permanently as well (not handled by this program)
+#define BAUD_RATE 9600
+
+// wait time for reading next character in microseconds, choose according to BAUD_RATE: 9/BAUD_RATE*1E6*1.5 (safety margin)
+#define CHAR_INTERVAL_US 1500
+
+// GPIO pins for the DTR input of the modem (low wakes it from sleep mode) and its RI output (pulled low when it has
+// something to report), only used with modem_sleep
+#define GPIO_PIN_MODEM_DTR 6
+#define GPIO_PIN_MODEM_RI 7
+
+// time the modem needs after DTR has gone low before its UART accepts commands
+#define MODEM_WAKE_MS 50
+
+// the same from power saving mode (PSM), which the modem may be in during battery mode
+#define MODEM_PSM_WAKE_MS 1500
+
+// during initialisation, the modem has finished responding once it has been quiet for this long
+#define MODEM_QUIET_US 100000
+
+// during initialisation, the registration is polled at this interval until this long after the reset of the modem
+// (a full network search takes up to about a minute)
+#define MODEM_REGISTRATION_POLL_MS 500
+#define MODEM_REGISTRATION_WAIT_US 90000000
+
+// AT+COPS only answers once the modem has registered or given up, which takes up to 120 s (SIMCom) or 180 s (Quectel)
+#define MODEM_COPS_WAIT_US 180000000
+
+// this sets the maximum allowable message length
+#define max_str_l 200
+#define LF '\x0A'
+#define CR '\x0D'
+
+// the modem profile (MODEM_NAME, selected with the CMake option ALARMDIAL_MODEM) of alarmdial_tables.h provides the
+// commands that differ between modules, modem.c provides what the logic needs to know about their responses
+
+// test command of a capability (e.g. "AT+CNMI=?\r"), the prefix of its response, and the parameter of the response
+// whose list must include value (e.g. 2 in "+CNMI: (0-2),(0-3),..."), -1 if the response itself will do
+typedef struct {
+  const char* command;
+  const char* prefix;
+  int8_t field;
+  uint32_t value;
+} modem_probe_t;
+
+// incoming modem message strings map into the numerical values OK ... UNKNOWN (MAX_MSG in all) of alarmdial_tables.h
+
+// classification results for messages that are not command related
+#define MSG_TEXT   MAX_MSG
+#define MSG_IGNORE (MAX_MSG + 1)
+
+#ifdef DEBUG
+extern const char* const command_code_map[MAX_MSG];
+#endif
+
+// ring buffer for interrupt handler
+#define RX_BUFFER_SIZE 10000
+extern char rx_buffer[RX_BUFFER_SIZE];
+extern int rx_buffer_read_position;
+extern int rx_buffer_entries;
+extern int rx_buffer_write_position;
+extern int rx_buffer_number_lf;
+
+// modem sleep mode (MODEM_SLEEP_COMMAND, e.g. AT+CSCLK=1), defaults to MODEM_SLEEP of alarmdial_tables.h
+extern bool modem_sleep;
+
+// whether DTR is low, the modem is kept awake
+extern bool modem_awake;
+
+// SMS are delivered directly (+CMT, MODEM_DIRECT_SMS_COMMAND), set by initialise_modem for a modem with the capability
+// if MODEM_DIRECT_SMS of alarmdial_tables.h, otherwise they are indicated (+CMTI) and read out of the storage
+extern bool modem_direct_sms;
+
+// capabilities of the modem (MODEM_CAPABILITY_* of alarmdial_tables.h), set by initialise_modem
+extern uint8_t modem_capabilities;
+
+// time from the last reset of the modem to its registration (0 if it has not registered during initialisation), and
+// whether it has been pointed to the network it was last registered with
+extern uint32_t modem_registration_ms;
+extern bool modem_registration_cached;
+
+void rx_buffer_push(char chr);
+void uart_rx_interrupt_handler(void);
+int read_message(char* message, uint32_t wait_us);
+int read_line(char* str);
+int classify_message(const char* str);
+const char* message_parameters(const char* str);
+int message_field(const char* str, int index, char* field, int size);
+void write_command(const char* command);
+int write_command_with_response_check(const char* command, const char* target_response, char* response, uint32_t wait_us, int repeat);
+void send_sms(const char* tel_no, const char* message);
+void modem_reset(void);
+bool initialise_modem(config_t* config);
+bool modem_status_online(const char* str);
+bool modem_status_network(const char* str, char* plmn, uint8_t* rat, uint8_t* band);
+bool modem_ready_message(const char* str);
+const char* modem_config_command(void);
+void modem_sleep_init(void);
+void modem_wake(void);
+void modem_allow_sleep(void);
+void modem_ring_interrupt_handler(void);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include "energy.h"
+#include "hal.h"
+#include "modem.h"
+#include "power.h"
+
+bool power_supply_sense = POWER_SUPPLY_SENSE;
+int power_mode = POWER_MAINS;
+int power_control = POWER_CONTROL_AUTO;
+
+// supply state from the sense pin after debouncing, and the number of readings that differ from it in a row
+static bool supply_lost;
+static int sense_readings;
+
+// the battery mode was entered at battery_since_us, when the energy accounting stood at battery_start_nas, the backup
+// battery is taken to be full whenever that happens
+static uint64_t battery_since_us;
+static uint64_t battery_start_nas;
+
+// time spent in each MCU state since boot, up to the last change of state, and the present state since when
+static uint64_t cpu_residency_us[POWER_CPU_STATES];
+static int cpu_state;
+static uint64_t cpu_since_us;
+
+// starts in mains mode, the supply sensing switches to battery mode within POWER_SENSE_READINGS seconds if need be
+void power_init(uint64_t now_us) {
+  int i;
+
+  power_mode = POWER_MAINS;
+  power_control = POWER_CONTROL_AUTO;
+  supply_lost = false;
+  sense_readings = 0;
+  battery_since_us = now_us;
+  battery_start_nas = 0;
+  for (i = 0; i < POWER_CPU_STATES; i++)
+    cpu_residency_us[i] = 0;
+  cpu_state = POWER_CPU_FAST;
+  cpu_since_us = now_us;
+  if (power_supply_sense)
+    hal_gpio_init_input_pullup(GPIO_PIN_SUPPLY_SENSE);
+}
+
+// reads the supply sense pin (high once the external supply is lost), called once a second
+void power_sense(void) {
+  bool lost;
+
+  if (!power_supply_sense)
+    return;
+  lost = hal_gpio_get(GPIO_PIN_SUPPLY_SENSE);
+  if (lost == supply_lost)
+    sense_readings = 0;
+  else if (++sense_readings >= POWER_SENSE_READINGS) {
+    supply_lost = lost;
+    sense_readings = 0;
+#ifdef DEBUG
+    printf("External supply %s\n", supply_lost ? "lost" : "restored");
+#endif
+  }
+}
+
+// the power mode called for by the manual control, or else by the supply sensing
+int power_wanted_mode(void) {
+  if (power_control == POWER_CONTROL_BATTERY)
+    return POWER_BATTERY;
+  if (power_control == POWER_CONTROL_MAINS)
+    return POWER_MAINS;
+  return supply_lost ? POWER_BATTERY : POWER_MAINS;
+}
+
+// changes the power mode, the battery accounting starts afresh on entering battery mode
+// the energy accounting up to now is at the currents of the mode left
+void power_set_mode(int mode, uint64_t now_us) {
+  if ((mode == POWER_BATTERY) && (power_mode != POWER_BATTERY)) {
+    battery_since_us = now_us;
+    battery_start_nas = energy_total_nas(now_us);
+  }
+  else
+    energy_total_nas(now_us);
+  power_mode = mode;
+}
+
+// charge drawn from the battery by now since the battery mode was entered, in nAs (0 in mains mode)
+uint64_t power_battery_used_nas(uint64_t now_us) {
+  return power_mode == POWER_BATTERY ? energy_total_nas(now_us) - battery_start_nas : 0;
+}
+
+// writes the power mode, on battery with the time since the supply was lost, the charge used, and the remaining runtime
+// at the average current so far (for the first hour, at the current while idle)
+void power_report(format_t* format, uint64_t now_us) {
+  uint64_t used_nas, elapsed_us, average_ua, capacity_nas, remaining_nas;
+
+  used_nas = power_battery_used_nas(now_us);
+  if (power_mode == POWER_MAINS)
+    format_str(format, "Mains power");
+  else {
+    elapsed_us = now_us - battery_since_us;
+    if (elapsed_us >= 3600000000)
+      average_ua = used_nas * 1000 / elapsed_us;
+    else
+      average_ua = POWER_CURRENT_PICO_SLEEP_UA + (modem_sleep ? POWER_CURRENT_MODEM_BATTERY_SLEEP_UA : POWER_CURRENT_MODEM_AWAKE_UA);
+    capacity_nas = (uint64_t)POWER_BATTERY_CAPACITY_MAH * 3600000000;
+    remaining_nas = used_nas < capacity_nas ? capacity_nas - used_nas : 0;
+    format_str(format, "Battery ");
+    format_uint(format, (uint32_t)(elapsed_us / 1000000));
+    format_str(format, "s, ");
+    format_uint(format, (uint32_t)(used_nas / 3600000000));
+    format_char(format, '/');
+    format_uint(format, POWER_BATTERY_CAPACITY_MAH);
+    format_str(format, "mAh used, ");
+    format_uint(format, (uint32_t)(remaining_nas / (average_ua * 3600000)));
+    format_str(format, "h left");
+  }
+  if (power_control != POWER_CONTROL_AUTO)
+    format_str(format, " (manual)");
+}
+
+// moves the MCU into another state, adding the time spent in the previous one to its counter
+static void cpu_enter(int state, uint64_t now_us) {
+  energy_set_cpu(state, now_us);
+  cpu_residency_us[cpu_state] += now_us - cpu_since_us;
+  cpu_state = state;
+  cpu_since_us = now_us;
+}
+
+// raises the system clock for a burst of work (modem messages to parse, SMS to encode, the flash to commit)
+void power_cpu_burst(void) {
+  if (cpu_state == POWER_CPU_FAST)
+    return;
+  hal_clock_fast(true);
+  cpu_enter(POWER_CPU_FAST, hal_time_us());
+}
+
+// lowers the system clock and sleeps until until_us (time since boot) or the next interrupt, see hal_idle, the clock
+// stays slow afterwards until the next burst
+void power_cpu_idle(uint32_t min_ms, uint64_t until_us) {
+  hal_clock_fast(false);
+  cpu_enter(POWER_CPU_SLEEP, hal_time_us());
+  hal_idle(min_ms, until_us);
+  cpu_enter(POWER_CPU_SLOW, hal_time_us());
+}
+
+// time spent in an MCU state since boot, including the present stay
+uint64_t power_cpu_residency(int state, uint64_t now_us) {
+  return cpu_residency_us[state] + (state == cpu_state ? now_us - cpu_since_us : 0);
+}
@@ -0,0 +1,44 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarmdial_tables.h"
+#include "format.h"
+
+// power modes: on mains power, or on the backup battery with the modem in its power saving settings and the
+// housekeeping intervals stretched by POWER_INTERVAL_FACTOR
+#define POWER_MAINS   0
+#define POWER_BATTERY 1
+
+// manual control of the power mode (SMS command Power!), kept until the next reboot
+#define POWER_CONTROL_AUTO    0   // follow the supply sensing
+#define POWER_CONTROL_BATTERY 1
+#define POWER_CONTROL_MAINS   2
+
+// consecutive readings of the supply sense pin (one per second) before a change of the supply counts
+#define POWER_SENSE_READINGS 10
+
+// states of the MCU for the residency counters: running at the fast or the slow system clock, or sleeping (at the slow
+// clock) until the next deadline or interrupt
+#define POWER_CPU_FAST   0
+#define POWER_CPU_SLOW   1
+#define POWER_CPU_SLEEP  2
+#define POWER_CPU_STATES 3
+
+// supply sensing on GPIO_PIN_SUPPLY_SENSE, defaults to POWER_SUPPLY_SENSE of alarmdial_tables.h
+extern bool power_supply_sense;
+extern int power_mode;
+extern int power_control;
+
+void power_init(uint64_t now_us);
+void power_sense(void);
+int power_wanted_mode(void);
+void power_set_mode(int mode, uint64_t now_us);
+uint64_t power_battery_used_nas(uint64_t now_us);
+void power_report(format_t* format, uint64_t now_us);
+void power_cpu_burst(void);
+void power_cpu_idle(uint32_t min_ms, uint64_t until_us);
+uint64_t power_cpu_residency(int state, uint64_t now_us);
+
+#endif
@@ -0,0 +1,108 @@
+# Cycle counts of AlarmDial running in Renode, loaded into the Renode monitor with "include @alarmdial_cycles.py"
+#
+# Adds two monitor commands:
+#   alarmdial_cycles_start <cpu> <rx_isr> <main_loop> <flash_commit>
+#       hooks the entry points (addresses from the ELF image) of the UART interrupt handler, dialler_loop and
+#       hal_flash_write on the CPU named <cpu> (e.g. sysbus.cpu)
+#   alarmdial_cycles_report <file>
+#       writes the statistics as JSON, in the layout of the host microbenchmarks:
+#         {
+#           "platform": "renode",
+#           "unit": "cycles",
+#           "measurements": [
+#             {"name": "rx_isr", "calls": 5310, "min": 38, "p50": 41, "p99": 77, "max": 77, "mean": 42.3},
+#             ...
+#           ]
+#         }
+#
+# Renode counts one cycle per executed instruction, and it models neither the XIP cache nor flash wait states, so the
+# numbers are instruction counts of the real image on the real code paths rather than cycle-exact timing
+# Each call is measured from its first instruction until the CPU is back at the return address. For the interrupt
+# handler that is the PC stacked on exception entry, for the functions it is LR. Interrupts taken during a call of
+# dialler_loop are subtracted from it (hal_flash_write runs with interrupts disabled)
+
+from System import Action, UInt64
+from Antmicro.Renode.Peripherals.CPU import ICpuSupportingGdb
+
+MEASUREMENTS = ["rx_isr", "main_loop", "flash_commit"]
+
+# per measurement: histogram {cycles: calls}, as the counts take few distinct values
+histograms = dict((name, {}) for name in MEASUREMENTS)
+
+# cycles spent in interrupt handlers so far, for taking them out of the main loop
+isr_cycles = [0]
+
+cpu = None
+bus = None
+
+
+def record(name, cycles):
+    histogram = histograms[name]
+    histogram[cycles] = histogram.get(cycles, 0) + 1
+
+
+# hooks the return address once, measures the call when the CPU arrives there and removes the hook again
+def measure_until(name, return_address, start_cycles, start_isr_cycles):
+    def returned(hooked_cpu, address):
+        cycles = hooked_cpu.ExecutedInstructions - start_cycles
+        if name == "rx_isr":
+            isr_cycles[0] += cycles
+        else:
+            cycles -= isr_cycles[0] - start_isr_cycles
+        record(name, int(cycles))
+        hooked_cpu.RemoveHook(return_address, hook)
+
+    hook = Action[ICpuSupportingGdb, UInt64](returned)
+    cpu.AddHook(return_address, hook)
+
+
+# on entry to the handler, SP points to the exception frame (r0-r3, r12, lr, pc, xpsr)
+def rx_isr_entry(hooked_cpu, address):
+    stacked_pc = bus.ReadDoubleWord(hooked_cpu.GetRegisterUnsafe(13).RawValue + 24)
+    measure_until("rx_isr", stacked_pc, hooked_cpu.ExecutedInstructions, 0)
+
+
+def function_entry(name):
+    def entry(hooked_cpu, address):
+        return_address = hooked_cpu.GetRegisterUnsafe(14).RawValue & ~1
+        measure_until(name, return_address, hooked_cpu.ExecutedInstructions, isr_cycles[0])
+    return entry
+
+
+def mc_alarmdial_cycles_start(cpu_name, rx_isr, main_loop, flash_commit):
+    global cpu, bus
+
+    cpu = monitor.Machine[cpu_name]
+    bus = monitor.Machine.SystemBus
+    entries = [(rx_isr, rx_isr_entry), (main_loop, function_entry("main_loop")),
+               (flash_commit, function_entry("flash_commit"))]
+    for address, handler in entries:
+        cpu.AddHook(int(str(address), 0) & ~1, Action[ICpuSupportingGdb, UInt64](handler))
+
+
+def percentile(histogram, calls, fraction):
+    rank = max(1, int(calls * fraction + 0.999999))
+    seen = 0
+    for cycles in sorted(histogram):
+        seen += histogram[cycles]
+        if seen >= rank:
+            return cycles
+    return 0
+
+
+def mc_alarmdial_cycles_report(path):
+    lines = []
+    for name in MEASUREMENTS:
+        histogram = histograms[name]
+        calls = sum(histogram.values())
+        if not calls:
+            lines.append('    {"name": "%s", "calls": 0}' % name)
+            continue
+        total = sum(cycles * count for cycles, count in histogram.items())
+        lines.append('    {"name": "%s", "calls": %d, "min": %d, "p50": %d, "p99": %d, "max": %d, "mean": %.1f}' %
+                     (name, calls, min(histogram), percentile(histogram, calls, 0.5),
+                      percentile(histogram, calls, 0.99), max(histogram), float(total) / calls))
+    report = open(str(path), "w")
+    report.write('{\n  "platform": "renode",\n  "unit": "cycles",\n  "measurements": [\n%s\n  ]\n}\n' %
+                 ",\n".join(lines))
+    report.close()
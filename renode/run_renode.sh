@@ -0,0 +1,120 @@
+#!/bin/sh
+# Runs the unmodified AlarmDial.uf2 in Renode on an emulated RP2040, with its UART connected to the simulated modem
+# (host/alarmdial_modem_sim) and its inputs driven by a scenario of Renode monitor commands, and reports cycle counts
+# of the UART interrupt handler, the main loop and the flash commit (see alarmdial_cycles.py)
+#
+# usage: run_renode.sh -p platform.repl -b bootrom.bin [-m modem_sim] [-s modem_script] [-g scenario.resc]
+#                      [-o report.json] [-P port] AlarmDial.uf2 AlarmDial.elf
+#   -p  RP2040 platform description for Renode (not part of Renode itself)
+#   -b  RP2040 boot ROM image
+#   -m  the simulated modem (default host/alarmdial_modem_sim in the build directory _build)
+#   -s  control commands for the simulated modem (sms, call, urc, ...)
+#   -g  Renode monitor commands driving the run and the inputs (default scenario.resc)
+#   -o  report file (default renode_cycles.json)
+#   -P  TCP port between Renode and the simulated modem (default 3456), the Renode monitor listens on the next one
+#
+# needs renode, socat, python3 and arm-none-eabi-nm in the PATH
+
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+platform=
+bootrom=
+modem_sim=_build/host/alarmdial_modem_sim
+modem_script=
+scenario=$dir/scenario.resc
+report=renode_cycles.json
+port=3456
+
+usage() {
+  echo "usage: $0 -p platform.repl -b bootrom.bin [-m modem_sim] [-s modem_script] [-g scenario.resc]" \
+       "[-o report.json] [-P port] AlarmDial.uf2 AlarmDial.elf" >&2
+  exit 1
+}
+
+while getopts p:b:m:s:g:o:P: opt; do
+  case $opt in
+    p) platform=$OPTARG ;;
+    b) bootrom=$OPTARG ;;
+    m) modem_sim=$OPTARG ;;
+    s) modem_script=$OPTARG ;;
+    g) scenario=$OPTARG ;;
+    o) report=$OPTARG ;;
+    P) port=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 2 ] && [ -n "$platform" ] && [ -n "$bootrom" ] || usage
+uf2=$1
+elf=$2
+
+absolute() {
+  echo "$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# the UF2 file consists of 512 byte blocks, each carrying up to 476 bytes of payload for a target address
+python3 - "$uf2" "$work/flash.bin" <<'EOF'
+import struct, sys
+
+FLASH_BASE = 0x10000000
+image = bytearray()
+data = open(sys.argv[1], "rb").read()
+for offset in range(0, len(data) - 511, 512):
+    magic0, magic1, flags, address, size = struct.unpack_from("<5I", data, offset)
+    if (magic0, magic1) != (0x0A324655, 0x9E5D5157) or (flags & 1):
+        continue
+    start = address - FLASH_BASE
+    if len(image) < start + size:
+        image.extend(b"\xff" * (start + size - len(image)))
+    image[start:start + size] = data[offset + 32:offset + 32 + size]
+open(sys.argv[2], "wb").write(image)
+EOF
+
+symbol() {
+  address=$(arm-none-eabi-nm "$elf" | awk -v name="$1" '$3 == name { print "0x" $1; exit }')
+  if [ -z "$address" ]; then
+    echo "$0: $1 not found in $elf" >&2
+    exit 1
+  fi
+  echo "$address"
+}
+
+rx_isr=$(symbol uart_irq_handler)
+main_loop=$(symbol dialler_loop)
+flash_commit=$(symbol hal_flash_write)
+
+cat > "$work/session.resc" <<EOF
+\$platform=@$(absolute "$platform")
+\$bootrom=@$(absolute "$bootrom")
+\$flash=@$work/flash.bin
+\$elf=@$(absolute "$elf")
+\$port=$port
+\$scenario=@$(absolute "$scenario")
+\$report=@$(absolute "$report")
+\$cycles=@$dir/alarmdial_cycles.py
+\$rx_isr=$rx_isr
+\$main_loop=$main_loop
+\$flash_commit=$flash_commit
+include @$dir/alarmdial.resc
+EOF
+
+# started by the simulated modem with ALARMDIAL_UART set to its pseudo-terminal, which socat connects to the socket of
+# Renode, the modem ends when Renode has finished the scenario
+cat > "$work/session.sh" <<EOF
+#!/bin/sh
+socat FILE:"\$ALARMDIAL_UART",raw,echo=0 TCP:localhost:$port,retry=100,interval=0.1 &
+bridge=\$!
+renode --disable-xwt -P $((port + 1)) "$work/session.resc" < /dev/null
+status=\$?
+kill \$bridge 2>/dev/null
+exit \$status
+EOF
+chmod +x "$work/session.sh"
+
+# control commands for the simulated modem can also be typed on stdin
+"$modem_sim" ${modem_script:+-s "$modem_script"} -x "$work/session.sh"
+cat "$report"
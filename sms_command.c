@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "diagnostics.h"
+#include "dialler.h"
+#include "energy.h"
+#include "format.h"
+#include "hal.h"
+#include "modem.h"
+#include "power.h"
+#include "sms_command.h"
+
+// the SMS commands with their argument grammar and multi-stage action, generated from codegen/tables.json
+static const sms_command_t sms_commands[SMS_NUMBER_COMMANDS] = SMS_COMMANDS;
+
+// the commands a missed call can trigger
+static const int missed_call_commands[MISSED_CALL_NUMBER_COMMANDS] = MISSED_CALL_COMMANDS;
+
+// finds the command following the password at the start of an SMS
+// returns the index of the command in sms_commands, or -1 if there is none, and where its argument starts in *argument
+static int find_command(const char* sms_text, const config_t* config, int* argument) {
+  int p = strlen(config->passw);
+  int c;
+
+  if (strncmp(sms_text, config->passw, p))
+    return -1;
+  for (c = 0; c < SMS_NUMBER_COMMANDS; c++)
+    if (!strncmp(&sms_text[p], sms_commands[c].text, sms_commands[c].length)) {
+      *argument = p + sms_commands[c].length;
+      return c;
+    }
+
+  return -1;
+}
+
+// a command is named by its text without the leading space and the trailing ? or !, e.g. "Status"
+static bool is_command_name(const char* text, int c) {
+  int n = sms_commands[c].length - 2;
+
+  return !strncmp(text, &sms_commands[c].text[1], n) && !text[n];
+}
+
+// writes the name of a command
+static void format_command_name(format_t* format, int c) {
+  int i;
+
+  for (i = 1; i < sms_commands[c].length - 1; i++)
+    format_char(format, sms_commands[c].text[i]);
+}
+
+// carries out a command, the argument starts at sms_text[j]
+// returns the multi-stage action that is to follow once the modem has responded with OK (0 if none), the text of the
+// SMS to send in response is written to format, config_changed is set if the configuration needs saving to flash
+static int run_command(int c, const char* sms_text, int j, config_t* config, format_t* format, bool* config_changed) {
+  char str[max_str_l];
+  int i, k, l = 0;
+
+// the input number of SMS_ARGUMENT_INPUT and SMS_ARGUMENT_INPUT_MESSAGE, l is 1 for the message on activation (!On!),
+// 2 for the one on deactivation (!Off!), and 0 if the argument is invalid
+  k = sms_text[j] - '1';
+  if ((k >= 0) && (k < GPIO_NUMBER_PINS)) {
+    if (sms_commands[c].argument == SMS_ARGUMENT_INPUT)
+      l = sms_text[j+1] == '\0';
+// each character is only looked at once the ones before it are known not to end the text
+    else if ((sms_commands[c].argument == SMS_ARGUMENT_INPUT_MESSAGE) && (sms_text[j+1] == '!')) {
+      if (!strncmp(&sms_text[j+2], "On!", 3))
+        l = 1;
+      else if (!strncmp(&sms_text[j+2], "Off!", 4))
+        l = 2;
+    }
+  }
+
+  switch (c) {
+// did we receive a signal level request?
+    case SMS_COMMAND_SIGNAL:
+#ifdef DEBUG
+      printf("Received signal level request\n");
+#endif
+      break;
+
+// did we receive a status request?
+    case SMS_COMMAND_STATUS:
+#ifdef DEBUG
+      printf("Received status request\n");
+#endif
+      format_str(format, "Uptime ");
+      format_uint(format, reboot_record.uptime_s);
+      format_str(format, "s. Stack peak ");
+      format_uint(format, stack_high_water_bytes);
+      format_str(format, " of ");
+      format_uint(format, stack_size_bytes);
+      format_str(format, " bytes. Reboots: ");
+      format_uint(format, reboot_record.count[REBOOT_REASON_WATCHDOG]);
+      format_str(format, " watchdog, ");
+      format_uint(format, reboot_record.count[REBOOT_REASON_MODEM_OFFLINE]);
+      format_str(format, " modem offline, ");
+      format_uint(format, reboot_record.count[REBOOT_REASON_HARDFAULT]);
+      format_str(format, " hardfault. ");
+      if (modem_registration_ms) {
+        format_str(format, "Registered in ");
+        format_uint(format, modem_registration_ms / 1000);
+        format_char(format, '.');
+        format_uint(format, modem_registration_ms / 100 % 10);
+        format_str(format, modem_registration_cached ? "s (last network). " : "s. ");
+      }
+      power_report(format, hal_time_us());
+      break;
+
+// did we receive a new telephone number?
+    case SMS_COMMAND_TELEPHONE_NUMBER:
+#ifdef DEBUG
+      printf("Received telephone number change request\n");
+#endif
+// extract the new number and apply if valid, signal result to OK processing
+      strcpy(str, &sms_text[j]);
+// the following line performs some rudimentary check for a valid UK number, adapt for your country, uncomment and uncomment the lines below
+//      if (!strncmp(str, "+44", 3) && (strlen(str) > 12)) {
+#ifdef DEBUG
+        printf("Changing telephone number to: %s\n", str);
+#endif
+        strncpy(config->tel_no, str, sizeof(config->tel_no) - 1);
+        config->tel_no[sizeof(config->tel_no) - 1] = 0;
+        *config_changed = true;
+        format_str(format, "Ok. Changed telephone number");
+// uncomment the following seven lines if you have implemented a number format check above
+//      }
+//      else {
+//#ifdef DEBUG
+//        printf("Received invalid telephone number\n");
+//#endif
+//        format_str(format, "Error. Invalid telephone number (needs to start with +44 and contain at least 13 characters)");
+//      }
+      break;
+
+// did we receive a new password?
+    case SMS_COMMAND_PASSWORD:
+#ifdef DEBUG
+      printf("Received password change request\n");
+#endif
+// extract the new password and apply if valid, signal result to OK processing
+      strcpy(str, &sms_text[j]);
+      if (strlen(str) == CONFIG_PASSW_LENGTH) {
+#ifdef DEBUG
+        printf("Changing password to: %s\n", str);
+#endif
+        strcpy(config->passw, str);
+        *config_changed = true;
+        format_str(format, "Ok. Changed password");
+      }
+      else {
+#ifdef DEBUG
+        printf("Received invalid password\n");
+#endif
+        format_str(format, "Error. Invalid password (needs to be ");
+        format_uint(format, CONFIG_PASSW_LENGTH);
+        format_str(format, " characters)");
+      }
+      break;
+
+// did we receive a change to SMS action rules?
+    case SMS_COMMAND_SMS_ON_INPUT:
+#ifdef DEBUG
+      printf("Received request to toggle action on input change\n");
+#endif
+      if (l) {
+#ifdef DEBUG
+        printf("Changing action on input change of pin: %1d\n", k);
+#endif
+// toggle SMS triggering for the pin, signal result to OK processing
+        config->send_sms_on_change[k] = !config->send_sms_on_change[k];
+        *config_changed = true;
+        format_str(format, "Ok. Input ");
+        format_uint(format, k + 1);
+        format_str(format, config->send_sms_on_change[k] ? " will trigger SMS from now on" : " will not trigger SMS from now on");
+      }
+      else {
+#ifdef DEBUG
+        printf("Received invalid input change action request\n");
+#endif
+        format_str(format, "Error. Invalid input number (must be 1-");
+        format_uint(format, GPIO_NUMBER_PINS);
+        format_char(format, ')');
+      }
+      break;
+
+// did we receive a change to the delivery of an input?
+    case SMS_COMMAND_DIGEST:
+#ifdef DEBUG
+      printf("Received request to toggle delivery of input change\n");
+#endif
+      if (l) {
+#ifdef DEBUG
+        printf("Changing delivery of input change of pin: %1d\n", k);
+#endif
+// toggle between immediate SMS and the daily digest for the pin, signal result to OK processing
+        config->digest[k] = !config->digest[k];
+        *config_changed = true;
+        format_str(format, "Ok. Input ");
+        format_uint(format, k + 1);
+        format_str(format, config->digest[k] ? " will be reported in the daily digest from now on" : " will be reported immediately from now on");
+      }
+      else {
+#ifdef DEBUG
+        printf("Received invalid delivery change request\n");
+#endif
+        format_str(format, "Error. Invalid input number (must be 1-");
+        format_uint(format, GPIO_NUMBER_PINS);
+        format_char(format, ')');
+      }
+      break;
+
+// did we receive a request to change a message text?
+    case SMS_COMMAND_MESSAGE_TEXT:
+#ifdef DEBUG
+      printf("Received request to change a message text\n");
+#endif
+      if (l == 1) {
+        strncpy(config->sms_on_fall[k], &sms_text[j+5], sizeof(config->sms_on_fall[k])-1);
+        config->sms_on_fall[k][sizeof(config->sms_on_fall[k])-1] = 0;
+#ifdef DEBUG
+        printf("Changing message for pin %1d on fall to: \"%s\"\n", k, config->sms_on_fall[k]);
+#endif
+        format_str(format, "Ok. New message for input ");
+        format_uint(format, k + 1);
+        format_str(format, " activating: \"");
+        format_str(format, config->sms_on_fall[k]);
+        format_char(format, '"');
+        *config_changed = true;
+      }
+      else if (l == 2) {
+        strncpy(config->sms_on_rise[k], &sms_text[j+6], sizeof(config->sms_on_rise[k])-1);
+        config->sms_on_rise[k][sizeof(config->sms_on_rise[k])-1] = 0;
+#ifdef DEBUG
+        printf("Changing message for pin %1d on rise to: \"%s\"\n", k, config->sms_on_rise[k]);
+#endif
+        format_str(format, "Ok. New message for input ");
+        format_uint(format, k + 1);
+        format_str(format, " deactivating: \"");
+        format_str(format, config->sms_on_rise[k]);
+        format_char(format, '"');
+        *config_changed = true;
+      }
+      else {
+#ifdef DEBUG
+        printf("Received invalid request to change a message\n");
+#endif
+        format_str(format, "Error. Invalid message change request");
+      }
+      break;
+
+// did we receive a request to reset settings to defaults?
+    case SMS_COMMAND_DEFAULTS:
+#ifdef DEBUG
+      printf("Received request to reset settings to defaults\n");
+      printf("Resetting settings to defaults\n");
+#endif
+      format_str(format, "Ok. Resetting settings to defaults");
+      config_set_defaults(config);
+      *config_changed = true;
+      break;
+
+// did we receive a manual control of the power mode? the main loop switches once the reply has been sent
+    case SMS_COMMAND_POWER:
+#ifdef DEBUG
+      printf("Received power control: %s\n", &sms_text[j]);
+#endif
+      if (!strcmp(&sms_text[j], "Battery"))
+        power_control = POWER_CONTROL_BATTERY;
+      else if (!strcmp(&sms_text[j], "Mains"))
+        power_control = POWER_CONTROL_MAINS;
+      else if (!strcmp(&sms_text[j], "Auto"))
+        power_control = POWER_CONTROL_AUTO;
+      else {
+        format_str(format, "Error. Invalid power control (must be Battery, Mains or Auto)");
+        break;
+      }
+      format_str(format, "Ok. Power control ");
+      format_str(format, &sms_text[j]);
+      break;
+
+// did we receive an energy report request?
+    case SMS_COMMAND_ENERGY:
+#ifdef DEBUG
+      printf("Received energy report request\n");
+#endif
+      energy_report(format, hal_time_us());
+      break;
+
+// did we receive a caller for missed calls? the configured telephone number is always allowed
+    case SMS_COMMAND_CALLER:
+#ifdef DEBUG
+      printf("Received allow-list change request: %s\n", &sms_text[j]);
+#endif
+      if (!sms_text[j] || (strlen(&sms_text[j]) >= sizeof(config->callers[0]))) {
+        format_str(format, "Error. Invalid caller number");
+        break;
+      }
+// toggle the caller in the allow-list, signal result to OK processing
+      for (i = 0; (i < CONFIG_NUMBER_CALLERS) && strcmp(config->callers[i], &sms_text[j]); i++);
+      if (i < CONFIG_NUMBER_CALLERS) {
+        config->callers[i][0] = 0;
+        format_str(format, "Ok. Missed calls from ");
+        format_str(format, &sms_text[j]);
+        format_str(format, " will be ignored from now on");
+      }
+      else {
+        for (i = 0; (i < CONFIG_NUMBER_CALLERS) && config->callers[i][0]; i++);
+        if (i == CONFIG_NUMBER_CALLERS) {
+          format_str(format, "Error. No room for another caller (at most ");
+          format_uint(format, CONFIG_NUMBER_CALLERS);
+          format_char(format, ')');
+          break;
+        }
+        strcpy(config->callers[i], &sms_text[j]);
+        format_str(format, "Ok. Missed calls from ");
+        format_str(format, &sms_text[j]);
+        format_str(format, " will be answered from now on");
+      }
+      *config_changed = true;
+      break;
+
+// did we receive a change to the command a missed call triggers?
+    case SMS_COMMAND_MISSED_CALL:
+#ifdef DEBUG
+      printf("Received missed call action: %s\n", &sms_text[j]);
+#endif
+      for (i = 0; (i < MISSED_CALL_NUMBER_COMMANDS) && !is_command_name(&sms_text[j], missed_call_commands[i]); i++);
+      if (i < MISSED_CALL_NUMBER_COMMANDS)
+        config->missed_call_command = missed_call_commands[i];
+      else if (!strcmp(&sms_text[j], "Off"))
+        config->missed_call_command = MISSED_CALL_NONE;
+      else {
+        format_str(format, "Error. Invalid missed call action (must be ");
+        for (i = 0; i < MISSED_CALL_NUMBER_COMMANDS; i++) {
+          if (i)
+            format_str(format, ", ");
+          format_command_name(format, missed_call_commands[i]);
+        }
+        format_str(format, " or Off)");
+        break;
+      }
+      *config_changed = true;
+      format_str(format, "Ok. Missed call action ");
+      format_str(format, &sms_text[j]);
+      break;
+  }
+
+  return sms_commands[c].action;
+}
+
+// figures out what an SMS is instructing us to do, if any, and applies configuration changes
+// returns the multi-stage action that is to follow once the modem has responded with OK (0 if none), the text of the
+// SMS to send in response is written to reply (room for max_str_l characters including the terminating 0)
+// config_changed is set if the configuration needs saving to flash
+int handle_sms_command(const char* sms_text, config_t* config, char* reply, bool* config_changed) {
+  int multi_stage_handling_type = 0;
+  bool recognised_instruction;
+  format_t format;
+  int c, j;
+
+  format_init(&format, reply, max_str_l);
+  recognised_instruction = !strncmp(sms_text, config->passw, sizeof(config->passw) - 1);
+
+// which command did we receive, if any?
+// we need to wait for the OK from the modem first before we can handle this any further, so signal to the OK processing
+  c = find_command(sms_text, config, &j);
+  if (c >= 0) {
+    multi_stage_handling_type = run_command(c, sms_text, j, config, &format, config_changed);
+    recognised_instruction = false;
+  }
+
+// we received the correct password but no recognised instruction, so send a response to that
+  if (recognised_instruction) {
+#ifdef DEBUG
+    printf("Received correct password but no valid instruction: %s\n", sms_text);
+#endif
+// we need to wait for the OK from the modem first before we can respond to the request
+    multi_stage_handling_type = MULTI_STAGE_INVALID_COMMAND;
+    format_str(&format, "Invalid instruction");
+  }
+
+  return multi_stage_handling_type;
+}
+
+// figures out whether a missed call is to trigger the configured command, which it does for the configured telephone
+// number and the callers of the allow-list, without a password, as the caller number cannot be chosen as freely as
+// the text of an SMS
+// number is the caller as the modem reports it (in quotes, empty if withheld)
+// returns the multi-stage action that is to follow once the modem has hung up (0 if none), the text of the SMS to send
+// in response is written to reply (room for max_str_l characters including the terminating 0), and the caller it goes
+// to, without the quotes, to caller (room for CONFIG_TEL_NO_SIZE characters)
+int handle_missed_call(const char* number, config_t* config, char* reply, char* caller) {
+  bool allowed, config_changed = false;
+  format_t format;
+  int i, l;
+
+  format_init(&format, reply, max_str_l);
+  if (*number == '"')
+    number++;
+  l = strlen(number);
+  if (l && (number[l-1] == '"'))
+    l--;
+  allowed = l && (strlen(config->tel_no) == (size_t)l) && !strncmp(config->tel_no, number, l);
+  for (i = 0; (i < CONFIG_NUMBER_CALLERS) && !allowed; i++)
+    allowed = l && (strlen(config->callers[i]) == (size_t)l) && !strncmp(config->callers[i], number, l);
+  for (i = 0; (i < MISSED_CALL_NUMBER_COMMANDS) && (missed_call_commands[i] != config->missed_call_command); i++);
+  if (!allowed || (i == MISSED_CALL_NUMBER_COMMANDS))
+    return 0;
+#ifdef DEBUG
+  printf("Missed call from an allowed caller\n");
+#endif
+  memcpy(caller, number, l);
+  caller[l] = 0;
+
+  return run_command(config->missed_call_command, "", 0, config, &format, &config_changed);
+}
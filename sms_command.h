@@ -0,0 +1,18 @@
+#ifndef SMS_COMMAND_H
+#define SMS_COMMAND_H
+
+#include <stdbool.h>
+#include "config.h"
+
+// an SMS command, following the password (see SMS_COMMANDS of alarmdial_tables.h)
+typedef struct {
+  const char* text;
+  int length;
+  int argument;
+  int action;
+} sms_command_t;
+
+int handle_sms_command(const char* sms_text, config_t* config, char* reply, bool* config_changed);
+int handle_missed_call(const char* number, config_t* config, char* reply, char* caller);
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "wallclock.h"
+
+uint32_t wallclock_syncs;
+int32_t wallclock_drift_ppb;
+
+// the clock was set at sync_us (time since boot) to sync_ms (UTC in milliseconds since 1970), the drift is measured
+// from the sync at reference_us, the time zone is in quarter hours east of UTC
+static bool synced;
+static uint64_t sync_us, sync_ms;
+static uint64_t reference_us, reference_ms;
+static int time_zone;
+
+void wallclock_init(void) {
+  synced = false;
+  wallclock_syncs = 0;
+  wallclock_drift_ppb = 0;
+  time_zone = 0;
+}
+
+// reads n decimal digits
+static bool read_digits(const char* p, int n, int* value) {
+  *value = 0;
+  while (n--) {
+    if ((*p < '0') || (*p > '9'))
+      return false;
+    *value = *value * 10 + *p++ - '0';
+  }
+
+  return true;
+}
+
+// days since 1970-01-01 of a date in the Gregorian calendar, from 2000 on
+static uint32_t days_from_civil(int year, int month, int day) {
+  uint32_t y = year - (month <= 2), doy, doe;
+
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = (y % 400) * 365 + (y % 400) / 4 - (y % 400) / 100 + doy;
+
+  return y / 400 * 146097 + doe - 719468;
+}
+
+// the date of a number of days since 1970-01-01
+static void civil_from_days(uint32_t days, int* year, int* month, int* day) {
+  uint32_t z = days + 719468, doe, yoe, doy, mp;
+
+  doe = z % 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  *day = doy - (153 * mp + 2) / 5 + 1;
+  *month = mp < 10 ? mp + 3 : mp - 9;
+  *year = z / 146097 * 400 + yoe + (*month <= 2);
+}
+
+// finds the local time "yy/MM/dd,hh:mm:ss±zz" of +CCLK in text, the zone is in quarter hours
+// returns the time as UTC in milliseconds since 1970, in the middle of the second reported, or 0 if there is none
+// a time without its zone and closing quote (a truncated line) is not taken, as it could be hours out
+static uint64_t parse_time(const char* text, int* zone) {
+  int year, month, day, hour, minute, second;
+  const char* p;
+
+  for (p = text; *p; p++)
+    if (read_digits(p, 2, &year) && (p[2] == '/') && read_digits(&p[3], 2, &month) && (p[5] == '/') &&
+        read_digits(&p[6], 2, &day) && (p[8] == ',') && read_digits(&p[9], 2, &hour) && (p[11] == ':') &&
+        read_digits(&p[12], 2, &minute) && (p[14] == ':') && read_digits(&p[15], 2, &second))
+      break;
+  if (!*p || (2000 + year < WALLCLOCK_MIN_YEAR) || (2000 + year > WALLCLOCK_MAX_YEAR) || (month < 1) ||
+      (month > 12) || (day < 1) || (day > 31) || (hour > 23) || (minute > 59) || (second > 59))
+    return 0;
+  if (((p[17] != '+') && (p[17] != '-')) || !read_digits(&p[18], 2, zone) || (p[20] != '"'))
+    return 0;
+  if (p[17] == '-')
+    *zone = -*zone;
+
+  return ((uint64_t)days_from_civil(2000 + year, month, day) * 86400 + hour * 3600 + minute * 60 + second -
+          *zone * 900) * 1000 + 500;
+}
+
+// sets the clock from the modem clock in text (+CCLK), which the modem keeps at the network time (AT+CTZU=1), read out
+// with a command sent at request_us
+// each sync after WALLCLOCK_DRIFT_BASELINE_US updates the drift, measured from the first sync of the time since boot
+// returns false if text holds no valid time, or if it has been too long under way
+bool wallclock_sync(const char* text, uint64_t request_us, uint64_t now_us) {
+  uint64_t network_ms, elapsed_s;
+  int64_t offset_us;
+  int zone;
+
+  network_ms = parse_time(text, &zone);
+  if (!network_ms || (synced && (now_us - request_us > WALLCLOCK_MAX_DELAY_US)))
+    return false;
+#ifdef DEBUG
+  if (synced)
+    printf("Wall clock off by %lld ms, drift %ld ppb\n", (long long)(network_ms - wallclock_ms(now_us)),
+           (long)wallclock_drift_ppb);
+#endif
+  if (!synced || (network_ms < reference_ms)) {
+    reference_us = now_us;
+    reference_ms = network_ms;
+  }
+  else if (now_us - reference_us >= WALLCLOCK_DRIFT_BASELINE_US) {
+    elapsed_s = (now_us - reference_us) / 1000000;
+    offset_us = (int64_t)(network_ms - reference_ms) * 1000 - (int64_t)(now_us - reference_us);
+    if (llabs(offset_us) > (int64_t)elapsed_s * WALLCLOCK_MAX_DRIFT_PPM) {
+      reference_us = now_us;
+      reference_ms = network_ms;
+    }
+    else
+      wallclock_drift_ppb = (int32_t)(offset_us * 1000 / (int64_t)elapsed_s);
+  }
+  time_zone = zone;
+  sync_us = now_us;
+  sync_ms = network_ms;
+  synced = true;
+  wallclock_syncs++;
+
+  return true;
+}
+
+// sets the time zone from the first parameter of +CTZV, in quarter hours (quotes and sign are optional)
+void wallclock_set_zone(const char* text) {
+  int zone;
+  bool negative;
+
+  if (*text == '"')
+    text++;
+  negative = *text == '-';
+  if ((*text == '+') || (*text == '-'))
+    text++;
+  if (!read_digits(text, 2, &zone) && !read_digits(text, 1, &zone))
+    return;
+  time_zone = negative ? -zone : zone;
+}
+
+bool wallclock_valid(void) {
+  return synced;
+}
+
+// UTC in milliseconds since 1970, 0 before the first sync
+uint64_t wallclock_ms(uint64_t now_us) {
+  uint64_t elapsed_ms;
+
+  if (!synced)
+    return 0;
+  elapsed_ms = (now_us - sync_us) / 1000;
+
+  return sync_ms + elapsed_ms + (int64_t)elapsed_ms * wallclock_drift_ppb / 1000000000;
+}
+
+// writes a value 0-99 as two digits
+static void format_two_digits(format_t* format, uint32_t value) {
+  format_char(format, (char)('0' + value / 10));
+  format_char(format, (char)('0' + value % 10));
+}
+
+// writes the local time as "2026-10-18 12:34:56", nothing before the first sync
+void wallclock_format(format_t* format, uint64_t now_us) {
+  uint64_t local_s;
+  uint32_t seconds;
+  int year, month, day;
+
+  if (!synced)
+    return;
+  local_s = wallclock_ms(now_us) / 1000 + time_zone * 900;
+  civil_from_days((uint32_t)(local_s / 86400), &year, &month, &day);
+  seconds = (uint32_t)(local_s % 86400);
+  format_uint(format, year);
+  format_char(format, '-');
+  format_two_digits(format, month);
+  format_char(format, '-');
+  format_two_digits(format, day);
+  format_char(format, ' ');
+  format_two_digits(format, seconds / 3600);
+  format_char(format, ':');
+  format_two_digits(format, seconds % 3600 / 60);
+  format_char(format, ':');
+  format_two_digits(format, seconds % 60);
+}
+
+// writes the local time of day of a time taken with wallclock_ms as "12:34", nothing for 0 (no sync yet)
+void wallclock_format_time(format_t* format, uint64_t utc_ms) {
+  uint32_t seconds;
+
+  if (!utc_ms)
+    return;
+  seconds = (uint32_t)((utc_ms / 1000 + time_zone * 900) % 86400);
+  format_two_digits(format, seconds / 3600);
+  format_char(format, ':');
+  format_two_digits(format, seconds % 3600 / 60);
+}
+
+// time since boot of the next full local hour given (0-23), within the next 24 hours, or 0 before the first sync
+uint64_t wallclock_next_hour_us(int hour, uint64_t now_us) {
+  uint32_t seconds, wait_s;
+
+  if (!synced)
+    return 0;
+  seconds = (uint32_t)((wallclock_ms(now_us) / 1000 + time_zone * 900) % 86400);
+  wait_s = (hour * 3600 + 86400 - seconds) % 86400;
+
+  return now_us + (uint64_t)(wait_s ? wait_s : 86400) * 1000000;
+}
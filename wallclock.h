@@ -0,0 +1,38 @@
+#ifndef WALLCLOCK_H
+#define WALLCLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "format.h"
+
+// software wall clock, set from the network time the modem reports (+CCLK, +CTZV) and kept in between by the time
+// since boot, corrected for the drift of the Pico's crystal against the network time measured between syncs
+
+// times the modem reports before any network time has reached it (e.g. 1970, 1980 or 2000) are not taken, the modem
+// gives the year in two digits, so 1970 and 1980 read as 2070 and 2080 and are ruled out by the upper bound
+#define WALLCLOCK_MIN_YEAR 2024
+#define WALLCLOCK_MAX_YEAR 2069
+
+// the drift is measured over at least this time since the sync it is measured from (the network time only comes in
+// whole seconds), and a drift beyond WALLCLOCK_MAX_DRIFT_PPM means the network time has jumped, the measurement then
+// starts afresh
+#define WALLCLOCK_DRIFT_BASELINE_US 21600000000
+#define WALLCLOCK_MAX_DRIFT_PPM 500
+
+// a modem clock read out later than this after the request (a slow modem) is not taken once the clock has been set
+#define WALLCLOCK_MAX_DELAY_US 2000000
+
+// number of syncs and the drift of the network time against the time since boot, in parts per billion
+extern uint32_t wallclock_syncs;
+extern int32_t wallclock_drift_ppb;
+
+void wallclock_init(void);
+bool wallclock_sync(const char* text, uint64_t request_us, uint64_t now_us);
+void wallclock_set_zone(const char* text);
+bool wallclock_valid(void);
+uint64_t wallclock_ms(uint64_t now_us);
+void wallclock_format(format_t* format, uint64_t now_us);
+void wallclock_format_time(format_t* format, uint64_t utc_ms);
+uint64_t wallclock_next_hour_us(int hour, uint64_t now_us);
+
+#endif